@@ -0,0 +1,46 @@
+#include <RaHardware.h>
+#include <RaLedMatrix.h>
+
+#if !defined(RA_HOST) && !defined(RA_HARDWARE_HEADER)
+
+void (*RaArduinoHardware::changeHandler)(void*) = NULL;
+void* RaArduinoHardware::changeContext = NULL;
+
+/**
+ * Interruption sur changement d'état d'une broche : appelle le gestionnaire enregistré par attachChange.
+ */
+void RaArduinoHardware::onChange()
+{
+  if(changeHandler)
+  {
+    changeHandler(changeContext);
+  }
+}
+
+/**
+ * @brief Crée le pilote de la matrice de LEDs, qui passe par cette couche pour ses broches.
+ */
+RaLedMatrix* RaArduinoHardware::createMatrix(uint8_t clockPin, uint8_t dataPin)
+{
+  return new RaLedMatrix(*this, clockPin, dataPin);
+}
+
+// Only the ranging array listens to pin changes: without it, the vectors stay free
+#if defined(__AVR__) && RA_USE_RANGING
+ISR(PCINT0_vect)
+{
+  RaArduinoHardware::onChange();
+}
+
+ISR(PCINT1_vect)
+{
+  RaArduinoHardware::onChange();
+}
+
+ISR(PCINT2_vect)
+{
+  RaArduinoHardware::onChange();
+}
+#endif
+
+#endif
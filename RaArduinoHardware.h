@@ -0,0 +1,192 @@
+#ifndef RA_ARDUINO_HARDWARE_H
+#define RA_ARDUINO_HARDWARE_H
+
+#include <Arduino.h>
+#include <RaConfig.h>
+#if RA_USE_SERVO
+#include <Servo.h>
+#endif
+#if RA_USE_IR
+#include <RaKsRemoteControl.h>
+#endif
+#include <EEPROM.h>
+#if defined(__AVR__)
+#include <avr/wdt.h>
+#include <avr/sleep.h>
+#endif
+
+class RaLedMatrix;
+
+/**
+ * Couche matérielle des cartes Arduino : chaque méthode transmet l'appel au cœur Arduino.
+ *
+ * La classe n'a ni état (hors interruptions) ni méthode virtuelle et toutes ses méthodes sont définies ici : le
+ * compilateur les remplace par l'appel d'origine, le code produit est le même qu'un appel direct.
+ * Une autre carte (ou un simulateur) fournit une classe qui a les mêmes types et les mêmes méthodes,
+ * voir RaHardware.h.
+ */
+class RaArduinoHardware
+{
+private:
+  // A board has a single set of interrupt vectors: one pin-change client at a time
+  static void (*changeHandler)(void*);
+  static void* changeContext;
+
+public:
+  static void onChange();
+
+#if RA_USE_SERVO
+  typedef Servo ServoType;
+#endif
+#if RA_USE_IR
+  typedef RaKsRemoteControl RemoteType;
+#endif
+  typedef RaLedMatrix MatrixType;
+
+  // Pin I/O
+  void pinMode(uint8_t pin, uint8_t mode) { ::pinMode(pin, mode); }
+  void digitalWrite(uint8_t pin, uint8_t value) { ::digitalWrite(pin, value); }
+  int digitalRead(uint8_t pin) { return ::digitalRead(pin); }
+
+  // PWM
+  void analogWrite(uint8_t pin, int value) { ::analogWrite(pin, value); }
+
+  /**
+   * @brief Indique si analogWrite produit un signal PWM sur une broche.
+   * Sur AVR, le timer 1 est pris par la bibliothèque Servo (RA_USE_SERVO) : ses broches perdent la PWM.
+   */
+  bool hasPwm(uint8_t pin)
+  {
+#if defined(__AVR__)
+    uint8_t timer = digitalPinToTimer(pin);
+#if RA_USE_SERVO
+    return timer != NOT_ON_TIMER && timer != TIMER1A && timer != TIMER1B;
+#else
+    return timer != NOT_ON_TIMER;
+#endif
+#else
+    (void)pin;
+    return true;
+#endif
+  }
+
+  // Timing
+  unsigned long millis() { return ::millis(); }
+  unsigned long micros() { return ::micros(); }
+  void delay(unsigned long ms) { ::delay(ms); }
+  void delayMicroseconds(unsigned int us) { ::delayMicroseconds(us); }
+  unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout) { return ::pulseIn(pin, state, timeout); }
+
+  // Interrupts
+  // (interrupts() and noInterrupts() are macros in the AVR core)
+  void disableInterrupts() { noInterrupts(); }
+  void enableInterrupts() { interrupts(); }
+
+  /**
+   * @brief Appelle un gestionnaire à chaque changement d'état d'une broche.
+   * Sur AVR, l'interruption par changement d'état (PCINT) est utilisée : toutes les broches sont
+   * acceptées. Un seul gestionnaire est actif à la fois, celui du dernier appel.
+   *
+   * @param pin la broche.
+   * @param handler le gestionnaire, appelé sous interruption.
+   * @param context le paramètre passé au gestionnaire.
+   */
+  void attachChange(uint8_t pin, void (*handler)(void*), void* context)
+  {
+    changeHandler = handler;
+    changeContext = context;
+#if defined(__AVR__)
+    *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+    *digitalPinToPCICR(pin) |= _BV(digitalPinToPCICRbit(pin));
+#else
+    ::attachInterrupt(digitalPinToInterrupt(pin), onChange, CHANGE);
+#endif
+  }
+
+  void detachChange(uint8_t pin)
+  {
+#if defined(__AVR__)
+    *digitalPinToPCMSK(pin) &= ~_BV(digitalPinToPCMSKbit(pin));
+#else
+    ::detachInterrupt(digitalPinToInterrupt(pin));
+#endif
+  }
+
+  /**
+   * @brief Met le microcontrôleur en sommeil (mode IDLE) jusqu'à la prochaine interruption : au plus
+   * ~1 ms (timer 0 de millis), ou plus tôt sur réception série, télécommande ou changement de broche.
+   */
+  void idle()
+  {
+#if defined(__AVR__)
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    sleep_cpu();
+    sleep_disable();
+#endif
+  }
+
+  // Serial
+  void beginSerial(unsigned long baud) { Serial.begin(baud); }
+  Stream& serial() { return Serial; }
+
+  // EEPROM
+  uint8_t eepromRead(int address) { return EEPROM.read(address); }
+  void eepromWrite(int address, uint8_t value)
+  {
+#if defined(__AVR__)
+    // Only erase/write the cells that change: fewer wear cycles, 3.4 ms saved per unchanged byte
+    EEPROM.update(address, value);
+#else
+    EEPROM.write(address, value);
+#endif
+  }
+
+  // Watchdog
+  /**
+   * @brief Indique si la carte vient de redémarrer sur le chien de garde, puis le désactive.
+   * La lecture est faite au mieux : certains chargeurs de démarrage effacent le registre MCUSR.
+   */
+  bool takeWatchdogReset()
+  {
+#if defined(__AVR__)
+    bool reset = MCUSR & _BV(WDRF);
+    MCUSR = 0;
+    wdt_disable();
+    return reset;
+#else
+    return false;
+#endif
+  }
+
+  void enableWatchdog(bool enable)
+  {
+#if defined(__AVR__)
+    if(enable)
+    {
+      wdt_enable(WDTO_500MS);
+    }
+    else
+    {
+      wdt_disable();
+    }
+#else
+    (void)enable;
+#endif
+  }
+
+  void feedWatchdog()
+  {
+#if defined(__AVR__)
+    wdt_reset();
+#endif
+  }
+
+  // Devices
+#if RA_USE_IR
+  RemoteType* createRemote(uint8_t pin) { return new RaKsRemoteControl(pin); }
+#endif
+  MatrixType* createMatrix(uint8_t clockPin, uint8_t dataPin);
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef RA_CONFIG_H
+#define RA_CONFIG_H
+
+/*
+ * Subsystems compiled into the library, 1 = included (default), 0 = left out.
+ * A subsystem left out takes no SRAM, is not initialised by init() and its methods
+ * (and the modes that need it) do not exist: a sketch that calls them does not compile.
+ *
+ * The library is compiled apart from the sketch: a #define in the sketch has no effect.
+ * Set the flags for the whole build, e.g. "-DRA_USE_SERVO=0" in PlatformIO build_flags
+ * or in the arduino-cli "build.extra_flags" property, or edit the defaults below.
+ *
+ *  - RA_USE_IR: IR remote control (RaKsRemoteControl, its timer interrupt), BT_MODE_REMOTE,
+ *  - RA_USE_BLUETOOTH: commands of the Bluetooth application on the serial port,
+ *  - RA_USE_MATRIX: LED matrix, animations and movement symbols,
+ *  - RA_USE_SERVO: head servo (Servo library, which takes Timer 1 and its PWM pins),
+ *  - RA_USE_RANGING: ultrasonic sensors, BT_MODE_FOLLOWING (and BT_MODE_AVOID with the servo),
+ *  - RA_USE_GRID: occupancy grid, needs RA_USE_RANGING,
+ *  - RA_USE_DEBUG: debug messages (setDebug) and console checks (checkTrack, checkRemoteControl,
+ *    debugBluetooth).
+ * Without RA_USE_BLUETOOTH and RA_USE_DEBUG, the serial port is not started.
+ *
+ * extras/size/size_table.sh builds each configuration and tabulates its flash and SRAM sizes
+ * (avr-size), and the duration of init() when a board is connected.
+ */
+#ifndef RA_USE_IR
+#define RA_USE_IR 1
+#endif
+
+#ifndef RA_USE_BLUETOOTH
+#define RA_USE_BLUETOOTH 1
+#endif
+
+#ifndef RA_USE_MATRIX
+#define RA_USE_MATRIX 1
+#endif
+
+#ifndef RA_USE_SERVO
+#define RA_USE_SERVO 1
+#endif
+
+#ifndef RA_USE_RANGING
+#define RA_USE_RANGING 1
+#endif
+
+#ifndef RA_USE_GRID
+#define RA_USE_GRID RA_USE_RANGING
+#endif
+
+#ifndef RA_USE_DEBUG
+#define RA_USE_DEBUG 1
+#endif
+
+#if RA_USE_GRID && !RA_USE_RANGING
+#error "RA_USE_GRID needs RA_USE_RANGING"
+#endif
+
+#endif
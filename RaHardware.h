@@ -0,0 +1,27 @@
+#ifndef RA_HARDWARE_H
+#define RA_HARDWARE_H
+
+/*
+ * Hardware layer of the library, chosen at compile time (no virtual call):
+ *  - RA_HARDWARE_HEADER / RA_HARDWARE: header and class of a board-specific layer,
+ *  - RA_HOST: simulated hardware, to build and run the library natively,
+ *  - otherwise the Arduino core.
+ * A layer provides the types and methods of RaArduinoHardware.
+ */
+#if defined(RA_HARDWARE_HEADER)
+#include RA_HARDWARE_HEADER
+#elif defined(RA_HOST)
+#include <RaHostHardware.h>
+#ifndef RA_HARDWARE
+#define RA_HARDWARE RaHostHardware
+#endif
+#else
+#include <RaArduinoHardware.h>
+#ifndef RA_HARDWARE
+#define RA_HARDWARE RaArduinoHardware
+#endif
+#endif
+
+typedef RA_HARDWARE RaHardware;
+
+#endif
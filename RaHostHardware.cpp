@@ -0,0 +1,683 @@
+#if defined(RA_HOST)
+
+#include <RaSmartCar4WD.h>
+
+static_assert(HOST_MATRIX_SIZE == LED_MATRIX_SIZE, "the simulated matrix has the columns of the real one");
+
+/**
+ * Constructeur de la classe RaHostServo.
+ */
+RaHostServo::RaHostServo()
+{
+  pin = NOT_A_PIN;
+  angle = 90;
+}
+
+uint8_t RaHostServo::attach(int servoPin)
+{
+  pin = servoPin;
+  return 0;
+}
+
+void RaHostServo::detach()
+{
+  pin = NOT_A_PIN;
+}
+
+bool RaHostServo::attached()
+{
+  return pin != NOT_A_PIN;
+}
+
+void RaHostServo::write(int value)
+{
+  angle = constrain(value, 0, 180);
+}
+
+int RaHostServo::read()
+{
+  return angle;
+}
+
+/**
+ * Constructeur de la classe RaHostRemote : aucune touche n'est pressée.
+ */
+RaHostRemote::RaHostRemote()
+{
+  key = IR_KEY_NONE;
+}
+
+void RaHostRemote::init()
+{
+}
+
+void RaHostRemote::setDebug(bool debug)
+{
+  (void)debug;
+}
+
+/**
+ * @brief Simule l'appui sur une touche.
+ *
+ * @param irKey la touche (constantes IR_KEY_*).
+ */
+void RaHostRemote::press(uint8_t irKey)
+{
+  key = irKey;
+}
+
+bool RaHostRemote::hasSignal()
+{
+  return key != IR_KEY_NONE;
+}
+
+void RaHostRemote::resume()
+{
+  key = IR_KEY_NONE;
+}
+
+bool RaHostRemote::isArrowUp()
+{
+  return key == IR_KEY_UP;
+}
+
+bool RaHostRemote::isArrowDown()
+{
+  return key == IR_KEY_DOWN;
+}
+
+bool RaHostRemote::isArrowLeft()
+{
+  return key == IR_KEY_LEFT;
+}
+
+bool RaHostRemote::isArrowRight()
+{
+  return key == IR_KEY_RIGHT;
+}
+
+bool RaHostRemote::isKeyOk()
+{
+  return key == IR_KEY_OK;
+}
+
+bool RaHostRemote::isKey0()
+{
+  return isKeyNumber(0);
+}
+
+bool RaHostRemote::isKey1()
+{
+  return isKeyNumber(1);
+}
+
+bool RaHostRemote::isKey2()
+{
+  return isKeyNumber(2);
+}
+
+bool RaHostRemote::isKey3()
+{
+  return isKeyNumber(3);
+}
+
+bool RaHostRemote::isKey4()
+{
+  return isKeyNumber(4);
+}
+
+bool RaHostRemote::isKeyNumber(int number)
+{
+  return key == IR_KEY_0 + number;
+}
+
+bool RaHostRemote::isKeyStar()
+{
+  return key == IR_KEY_STAR;
+}
+
+bool RaHostRemote::isKeySharp()
+{
+  return key == IR_KEY_SHARP;
+}
+
+/**
+ * Constructeur de la classe RaHostMatrix : la matrice est éteinte.
+ */
+RaHostMatrix::RaHostMatrix()
+{
+  memset(frame, 0, sizeof(frame));
+  frames = 0;
+  busBytes = 0;
+  brightness = LED_MATRIX_BRIGHTNESS;
+  on = true;
+}
+
+void RaHostMatrix::init()
+{
+}
+
+void RaHostMatrix::display(unsigned char entries[])
+{
+  write(0, entries, HOST_MATRIX_SIZE);
+}
+
+void RaHostMatrix::write(uint8_t first, const uint8_t* data, uint8_t count)
+{
+  int changedFirst = -1;
+  int changedLast = -1;
+
+  for (uint8_t i = 0; i < count && first + i < HOST_MATRIX_SIZE; i++)
+  {
+    if (frame[first + i] != data[i])
+    {
+      changedFirst = changedFirst < 0 ? first + i : changedFirst;
+      changedLast = first + i;
+    }
+    frame[first + i] = data[i];
+  }
+  frames++;
+  if (changedFirst >= 0)
+  {
+    // Data command, address, then the columns from the first to the last changed one
+    busBytes += 2 + changedLast - changedFirst + 1;
+  }
+}
+
+void RaHostMatrix::setBrightness(uint8_t level)
+{
+  if (brightness != (level & 0x07))
+  {
+    busBytes++;
+  }
+  brightness = level & 0x07;
+}
+
+void RaHostMatrix::setOn(bool enable)
+{
+  if (on != enable)
+  {
+    busBytes++;
+  }
+  on = enable;
+}
+
+void RaHostMatrix::setAsync(bool enable)
+{
+  (void)enable;
+}
+
+bool RaHostMatrix::isBusy()
+{
+  return false;
+}
+
+const unsigned char* RaHostMatrix::getFrame()
+{
+  return frame;
+}
+
+unsigned long RaHostMatrix::getFrameCount()
+{
+  return frames;
+}
+
+unsigned long RaHostMatrix::getBusBytes()
+{
+  return busBytes;
+}
+
+uint8_t RaHostMatrix::getBrightness()
+{
+  return brightness;
+}
+
+bool RaHostMatrix::isOn()
+{
+  return on;
+}
+
+/**
+ * Constructeur de la classe RaHostSerial : les deux tampons sont vides.
+ */
+RaHostSerial::RaHostSerial()
+{
+  inputHead = 0;
+  inputCount = 0;
+  written = 0;
+  clearOutput();
+}
+
+/**
+ * @brief Dépose des octets à lire par la voiture (les octets en trop sont perdus).
+ *
+ * @param text les octets, terminés par un zéro.
+ */
+void RaHostSerial::feed(const char* text)
+{
+  while (*text && inputCount < HOST_SERIAL_SIZE)
+  {
+    input[(inputHead + inputCount) % HOST_SERIAL_SIZE] = *text++;
+    inputCount++;
+  }
+}
+
+/**
+ * @brief Récupère les derniers octets écrits par la voiture.
+ *
+ * @return const char* les octets, terminés par un zéro.
+ */
+const char* RaHostSerial::getOutput()
+{
+  output[outputCount] = '\0';
+  return output;
+}
+
+void RaHostSerial::clearOutput()
+{
+  outputCount = 0;
+}
+
+int RaHostSerial::available()
+{
+  return inputCount;
+}
+
+int RaHostSerial::read()
+{
+  if (inputCount == 0)
+  {
+    return -1;
+  }
+  uint8_t value = input[inputHead];
+  inputHead = (inputHead + 1) % HOST_SERIAL_SIZE;
+  inputCount--;
+  return value;
+}
+
+int RaHostSerial::peek()
+{
+  return inputCount ? input[inputHead] : -1;
+}
+
+size_t RaHostSerial::write(uint8_t value)
+{
+  if (outputCount == HOST_SERIAL_SIZE)
+  {
+    // Keep the latest bytes
+    memmove(output, output + 1, HOST_SERIAL_SIZE - 1);
+    outputCount--;
+  }
+  output[outputCount++] = value;
+  written++;
+  return 1;
+}
+
+/**
+ * @brief Récupère le nombre d'octets écrits par la voiture depuis le démarrage.
+ *
+ * @return unsigned long le nombre d'octets.
+ */
+unsigned long RaHostSerial::getWriteCount()
+{
+  return written;
+}
+
+/**
+ * Constructeur de la classe RaHostHardware : toutes les broches sont des entrées à l'état bas
+ * et l'horloge est à zéro.
+ */
+RaHostHardware::RaHostHardware()
+{
+  for (uint8_t i = 0; i < HOST_PIN_COUNT; i++)
+  {
+    modes[i] = INPUT;
+    levels[i] = LOW;
+    pwm[i] = 0;
+    pulses[i] = 0;
+    handlers[i] = NULL;
+    contexts[i] = NULL;
+  }
+  clock = 0;
+  simulation = NULL;
+  simulationContext = NULL;
+  simulationNext = 0;
+  watchdog = false;
+  baud = 0;
+  resetCounters();
+  // An erased EEPROM reads 0xFF
+  memset(eeprom, 0xFF, sizeof(eeprom));
+}
+
+void RaHostHardware::pinMode(uint8_t pin, uint8_t mode)
+{
+  counters.pinModes++;
+  if (pin < HOST_PIN_COUNT)
+  {
+    modes[pin] = mode;
+  }
+}
+
+void RaHostHardware::digitalWrite(uint8_t pin, uint8_t value)
+{
+  counters.digitalWrites++;
+  if (pin < HOST_PIN_COUNT)
+  {
+    uint8_t level = value ? HIGH : LOW;
+    bool changed = levels[pin] != level;
+    wakeSimulation(pin, value ? 255 : 0);
+    levels[pin] = level;
+    pwm[pin] = value ? 255 : 0;
+    // Like a pin change interrupt, which also fires for an output: lets a test follow a bus
+    if (changed && handlers[pin])
+    {
+      handlers[pin](contexts[pin]);
+    }
+  }
+}
+
+int RaHostHardware::digitalRead(uint8_t pin)
+{
+  counters.digitalReads++;
+  return pin < HOST_PIN_COUNT ? levels[pin] : LOW;
+}
+
+void RaHostHardware::analogWrite(uint8_t pin, int value)
+{
+  counters.analogWrites++;
+  if (pin < HOST_PIN_COUNT)
+  {
+    wakeSimulation(pin, constrain(value, 0, 255));
+    pwm[pin] = constrain(value, 0, 255);
+    levels[pin] = value >= 128 ? HIGH : LOW;
+  }
+}
+
+bool RaHostHardware::hasPwm(uint8_t pin)
+{
+  (void)pin;
+  return true;
+}
+
+unsigned long RaHostHardware::millis()
+{
+  return clock / 1000;
+}
+
+unsigned long RaHostHardware::micros()
+{
+  return clock;
+}
+
+void RaHostHardware::delay(unsigned long ms)
+{
+  counters.delays++;
+  advance(ms * 1000);
+}
+
+void RaHostHardware::delayMicroseconds(unsigned int us)
+{
+  counters.delays++;
+  advance(us);
+}
+
+/**
+ * @brief Renvoie la durée d'impulsion déposée par setPulse() (0 si aucune ou trop longue)
+ * et avance l'horloge d'autant.
+ */
+unsigned long RaHostHardware::pulseIn(uint8_t pin, uint8_t state, unsigned long timeout)
+{
+  (void)state;
+  unsigned long width = pin < HOST_PIN_COUNT ? pulses[pin] : 0;
+
+  counters.pulseIns++;
+  if (width == 0 || width > timeout)
+  {
+    advance(timeout);
+    return 0;
+  }
+  pulses[pin] = 0;
+  advance(width);
+  return width;
+}
+
+void RaHostHardware::disableInterrupts()
+{
+}
+
+void RaHostHardware::enableInterrupts()
+{
+}
+
+void RaHostHardware::attachChange(uint8_t pin, void (*handler)(void*), void* context)
+{
+  if (pin < HOST_PIN_COUNT)
+  {
+    handlers[pin] = handler;
+    contexts[pin] = context;
+  }
+}
+
+void RaHostHardware::detachChange(uint8_t pin)
+{
+  if (pin < HOST_PIN_COUNT)
+  {
+    handlers[pin] = NULL;
+  }
+}
+
+/**
+ * @brief Sommeil simulé : l'horloge avance jusqu'à la prochaine milliseconde (interruption du timer 0).
+ */
+void RaHostHardware::idle()
+{
+  counters.delays++;
+  advance(1000 - clock % 1000);
+}
+
+void RaHostHardware::beginSerial(unsigned long rate)
+{
+  baud = rate;
+}
+
+Stream& RaHostHardware::serial()
+{
+  return port;
+}
+
+uint8_t RaHostHardware::eepromRead(int address)
+{
+  return address >= 0 && address < HOST_EEPROM_SIZE ? eeprom[address] : 0xFF;
+}
+
+void RaHostHardware::eepromWrite(int address, uint8_t value)
+{
+  counters.eepromWrites++;
+  if (address >= 0 && address < HOST_EEPROM_SIZE)
+  {
+    eeprom[address] = value;
+  }
+}
+
+bool RaHostHardware::takeWatchdogReset()
+{
+  return false;
+}
+
+void RaHostHardware::enableWatchdog(bool enable)
+{
+  watchdog = enable;
+}
+
+void RaHostHardware::feedWatchdog()
+{
+}
+
+RaHostHardware::RemoteType* RaHostHardware::createRemote(uint8_t pin)
+{
+  (void)pin;
+  return &remote;
+}
+
+RaHostHardware::MatrixType* RaHostHardware::createMatrix(uint8_t clockPin, uint8_t dataPin)
+{
+  (void)clockPin;
+  (void)dataPin;
+  return &matrix;
+}
+
+/**
+ * @brief Avance l'horloge simulée, en passant par chaque date demandée par la simulation
+ * (voir setSimulation) : les attentes de la voiture laissent évoluer le monde.
+ *
+ * @param us la durée en microsecondes.
+ */
+void RaHostHardware::advance(unsigned long us)
+{
+  unsigned long target = clock + us;
+
+  while (simulation && (long)(target - simulationNext) >= 0)
+  {
+    clock = simulationNext;
+    simulationNext = simulation(simulationContext, clock);
+  }
+  clock = target;
+}
+
+/**
+ * @brief Avance le prochain appel de la simulation à maintenant quand une sortie change :
+ * elle voit le déclenchement d'un capteur ou la commande d'un moteur à la date exacte.
+ *
+ * @param pin la broche.
+ * @param value sa nouvelle valeur (0-255).
+ */
+void RaHostHardware::wakeSimulation(uint8_t pin, int value)
+{
+  if (simulation && pwm[pin] != value)
+  {
+    simulationNext = clock;
+  }
+}
+
+/**
+ * @brief Branche une simulation sur l'horloge, appelée aussitôt puis à chaque date qu'elle demande
+ * et à chaque changement d'une sortie. Elle doit rendre une date postérieure à celle de l'appel.
+ *
+ * @param step la simulation, NULL pour la débrancher.
+ * @param context le paramètre qui lui est passé.
+ */
+void RaHostHardware::setSimulation(RaHostSimulation step, void* context)
+{
+  simulation = step;
+  simulationContext = context;
+  if (simulation)
+  {
+    simulationNext = simulation(simulationContext, clock);
+  }
+}
+
+/**
+ * @brief Fixe l'état d'une entrée ; un changement d'état appelle le gestionnaire de la broche
+ * (voir attachChange), comme une interruption.
+ *
+ * @param pin la broche.
+ * @param level HIGH ou LOW.
+ */
+void RaHostHardware::setInput(uint8_t pin, uint8_t level)
+{
+  if (pin >= HOST_PIN_COUNT || levels[pin] == level)
+  {
+    return;
+  }
+  levels[pin] = level;
+  if (handlers[pin])
+  {
+    handlers[pin](contexts[pin]);
+  }
+}
+
+/**
+ * @brief Dépose la durée de la prochaine impulsion lue par pulseIn() sur une broche.
+ *
+ * @param pin la broche.
+ * @param width la durée en microsecondes, 0 = pas d'impulsion.
+ */
+void RaHostHardware::setPulse(uint8_t pin, unsigned long width)
+{
+  if (pin < HOST_PIN_COUNT)
+  {
+    pulses[pin] = width;
+  }
+}
+
+uint8_t RaHostHardware::getOutput(uint8_t pin)
+{
+  return pin < HOST_PIN_COUNT ? levels[pin] : LOW;
+}
+
+int RaHostHardware::getPwm(uint8_t pin)
+{
+  return pin < HOST_PIN_COUNT ? pwm[pin] : 0;
+}
+
+RaHostRemote& RaHostHardware::getRemote()
+{
+  return remote;
+}
+
+RaHostMatrix& RaHostHardware::getMatrix()
+{
+  return matrix;
+}
+
+RaHostSerial& RaHostHardware::getSerial()
+{
+  return port;
+}
+
+/**
+ * @brief Récupère la vitesse du port série simulé (dernier appel de beginSerial).
+ *
+ * @return unsigned long la vitesse en bauds, 0 si le port n'a pas été ouvert.
+ */
+unsigned long RaHostHardware::getSerialBaud()
+{
+  return baud;
+}
+
+/**
+ * @brief Donne accès au contenu de l'EEPROM simulée (HOST_EEPROM_SIZE octets), par exemple pour
+ * l'écrire dans un fichier .eep à programmer sur la carte.
+ *
+ * @return const uint8_t* le contenu de l'EEPROM.
+ */
+const uint8_t* RaHostHardware::getEeprom()
+{
+  return eeprom;
+}
+
+/**
+ * @brief Récupère le nombre d'appels de chaque primitive et d'octets envoyés depuis resetCounters().
+ *
+ * @return RaHostCounters les compteurs.
+ */
+RaHostCounters RaHostHardware::getCounters()
+{
+  RaHostCounters result = counters;
+
+  result.serialBytes = port.getWriteCount() - counters.serialBytes;
+  result.matrixBytes = matrix.getBusBytes() - counters.matrixBytes;
+  return result;
+}
+
+/**
+ * @brief Remet les compteurs à zéro.
+ */
+void RaHostHardware::resetCounters()
+{
+  memset(&counters, 0, sizeof(counters));
+  // Device counts run from startup: keep their current values as the origin
+  counters.serialBytes = port.getWriteCount();
+  counters.matrixBytes = matrix.getBusBytes();
+}
+#endif
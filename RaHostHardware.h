@@ -0,0 +1,244 @@
+#ifndef RA_HOST_HARDWARE_H
+#define RA_HOST_HARDWARE_H
+
+#include <Arduino.h>
+
+#define HOST_PIN_COUNT 20
+#define HOST_SERIAL_SIZE 64
+#define HOST_MATRIX_SIZE 16 // columns, as LED_MATRIX_SIZE
+#define HOST_EEPROM_SIZE 1024 // ATmega328
+
+/**
+ * Servomoteur simulé : retient l'angle demandé.
+ */
+class RaHostServo
+{
+private:
+  uint8_t pin;
+  int angle;
+
+public:
+  RaHostServo();
+
+  uint8_t attach(int servoPin);
+  void detach();
+  bool attached();
+  void write(int value);
+  int read();
+};
+
+/**
+ * Télécommande infrarouge simulée : press() dépose une touche (constantes IR_KEY_*),
+ * lue comme un signal reçu jusqu'à l'appel de resume().
+ */
+class RaHostRemote
+{
+private:
+  uint8_t key;
+
+public:
+  RaHostRemote();
+
+  void init();
+  void setDebug(bool debug);
+  void press(uint8_t irKey);
+
+  bool hasSignal();
+  void resume();
+  bool isArrowUp();
+  bool isArrowDown();
+  bool isArrowLeft();
+  bool isArrowRight();
+  bool isKeyOk();
+  bool isKey0();
+  bool isKey1();
+  bool isKey2();
+  bool isKey3();
+  bool isKey4();
+  bool isKeyNumber(int number);
+  bool isKeyStar();
+  bool isKeySharp();
+};
+
+/**
+ * Matrice de LED simulée : retient la dernière image affichée, sa luminosité, et compte les images
+ * et les octets qu'enverrait le pilote AiP1640 (commande, adresse et colonnes modifiées de chaque image,
+ * un octet de contrôle par changement de luminosité ou d'allumage).
+ */
+class RaHostMatrix
+{
+private:
+  unsigned char frame[HOST_MATRIX_SIZE];
+  unsigned long frames;
+  unsigned long busBytes;
+  uint8_t brightness;
+  bool on;
+
+public:
+  RaHostMatrix();
+
+  void init();
+  void display(unsigned char entries[]);
+  void write(uint8_t first, const uint8_t* data, uint8_t count);
+  void setBrightness(uint8_t level);
+  void setOn(bool enable);
+  void setAsync(bool enable);
+  bool isBusy();
+
+  const unsigned char* getFrame();
+  unsigned long getFrameCount();
+  unsigned long getBusBytes();
+  uint8_t getBrightness();
+  bool isOn();
+};
+
+/**
+ * Port série simulé : les octets déposés par feed() sont lus par la voiture,
+ * les octets écrits par la voiture sont gardés dans un tampon (les plus anciens d'abord).
+ */
+class RaHostSerial : public Stream
+{
+private:
+  uint8_t input[HOST_SERIAL_SIZE];
+  uint8_t inputHead;
+  uint8_t inputCount;
+  char output[HOST_SERIAL_SIZE + 1];
+  uint8_t outputCount;
+  unsigned long written;
+
+public:
+  RaHostSerial();
+
+  void feed(const char* text);
+  const char* getOutput();
+  void clearOutput();
+  unsigned long getWriteCount();
+
+  int available();
+  int read();
+  int peek();
+  size_t write(uint8_t value);
+  using Print::write;
+};
+
+/**
+ * Nombre d'appels de chaque primitive de la couche matérielle simulée et octets envoyés
+ * aux périphériques, depuis RaHostHardware::resetCounters().
+ */
+struct RaHostCounters
+{
+  unsigned long pinModes;
+  unsigned long digitalWrites;
+  unsigned long digitalReads;
+  unsigned long analogWrites;
+  unsigned long pulseIns;
+  unsigned long delays;      // delay, delayMicroseconds and idle calls
+  unsigned long eepromWrites;
+  unsigned long serialBytes; // written by the car
+  unsigned long matrixBytes; // sent to the AiP1640
+};
+
+/**
+ * Simulation branchée sur l'horloge (voir RaHostHardware::setSimulation) : appelée quand l'horloge
+ * atteint la date qu'elle a demandée ou qu'une sortie change, elle fait évoluer le monde et les entrées,
+ * puis rend la date (µs) de son prochain appel.
+ */
+typedef unsigned long (*RaHostSimulation)(void* context, unsigned long now);
+
+/**
+ * Couche matérielle simulée, pour compiler et exécuter la bibliothèque sur un ordinateur
+ * (définir RA_HOST, avec un cœur Arduino minimal qui fournit Arduino.h).
+ *
+ * Chaque instance a ses propres broches, sa propre horloge et ses propres périphériques, sans
+ * variable globale : plusieurs voitures peuvent être simulées en même temps, une par thread.
+ * Le programme de simulation fixe les entrées (setInput), avance le temps (advance) et lit
+ * les sorties (getOutput, getPwm). Les attentes de la voiture avancent l'horloge au lieu de bloquer.
+ */
+class RaHostHardware
+{
+private:
+  uint8_t modes[HOST_PIN_COUNT];
+  uint8_t levels[HOST_PIN_COUNT];
+  int pwm[HOST_PIN_COUNT];
+  unsigned long pulses[HOST_PIN_COUNT];
+  void (*handlers[HOST_PIN_COUNT])(void*);
+  void* contexts[HOST_PIN_COUNT];
+  unsigned long clock; // us
+  RaHostSimulation simulation;
+  void* simulationContext;
+  unsigned long simulationNext;
+  RaHostCounters counters;
+  bool watchdog;
+  unsigned long baud;
+  uint8_t eeprom[HOST_EEPROM_SIZE];
+
+  RaHostRemote remote;
+  RaHostMatrix matrix;
+  RaHostSerial port;
+
+  void wakeSimulation(uint8_t pin, int value);
+
+public:
+  typedef RaHostServo ServoType;
+  typedef RaHostRemote RemoteType;
+  typedef RaHostMatrix MatrixType;
+
+  RaHostHardware();
+
+  // Pin I/O
+  void pinMode(uint8_t pin, uint8_t mode);
+  void digitalWrite(uint8_t pin, uint8_t value);
+  int digitalRead(uint8_t pin);
+
+  // PWM
+  void analogWrite(uint8_t pin, int value);
+  bool hasPwm(uint8_t pin);
+
+  // Timing
+  unsigned long millis();
+  unsigned long micros();
+  void delay(unsigned long ms);
+  void delayMicroseconds(unsigned int us);
+  unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout);
+
+  // Interrupts
+  void disableInterrupts();
+  void enableInterrupts();
+  void attachChange(uint8_t pin, void (*handler)(void*), void* context);
+  void detachChange(uint8_t pin);
+  void idle();
+
+  // Serial
+  void beginSerial(unsigned long baud);
+  Stream& serial();
+
+  // EEPROM
+  uint8_t eepromRead(int address);
+  void eepromWrite(int address, uint8_t value);
+
+  // Watchdog
+  bool takeWatchdogReset();
+  void enableWatchdog(bool enable);
+  void feedWatchdog();
+
+  // Devices
+  RemoteType* createRemote(uint8_t pin);
+  MatrixType* createMatrix(uint8_t clockPin, uint8_t dataPin);
+
+  // Simulation
+  void advance(unsigned long us);
+  void setSimulation(RaHostSimulation step, void* context);
+  void setInput(uint8_t pin, uint8_t level);
+  void setPulse(uint8_t pin, unsigned long width);
+  uint8_t getOutput(uint8_t pin);
+  int getPwm(uint8_t pin);
+  RaHostRemote& getRemote();
+  RaHostMatrix& getMatrix();
+  RaHostSerial& getSerial();
+  unsigned long getSerialBaud();
+  const uint8_t* getEeprom();
+  RaHostCounters getCounters();
+  void resetCounters();
+};
+
+#endif
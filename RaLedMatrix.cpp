@@ -0,0 +1,377 @@
+#include <RaLedMatrix.h>
+#include <RaConfig.h>
+
+// Without RA_USE_MATRIX, the Timer 0 compare B interrupt is not taken
+#if RA_USE_MATRIX
+
+// Transfer steps
+#define STEP_IDLE 0
+#define STEP_COMMAND 1
+#define STEP_ADDRESS 2
+#define STEP_DATA 3
+#define STEP_CONTROL 4
+
+// Half clock period: the AiP1640 needs >= 400 ns clock pulses
+#if defined(__AVR__)
+#define HALF_BIT() __builtin_avr_delay_cycles(F_CPU / 2000000UL)
+#else
+#define HALF_BIT() hw.delayMicroseconds(1)
+#endif
+
+#if LED_MATRIX_ASYNC
+static RaLedMatrix* asyncMatrix;
+
+ISR(TIMER0_COMPB_vect)
+{
+  if(asyncMatrix && !asyncMatrix->transferStep())
+  {
+    // Nothing left to send: stop the interrupt until the next frame
+    TIMSK0 &= ~_BV(OCIE0B);
+  }
+}
+#endif
+
+/**
+ * Constructeur de la classe RaLedMatrix.
+ *
+ * @param hardware la couche matérielle.
+ * @param clock la broche d'horloge (SCL sur la carte).
+ * @param data la broche de données (SDA sur la carte).
+ */
+RaLedMatrix::RaLedMatrix(RaHardware& hardware, uint8_t clock, uint8_t data)
+  : hw(hardware)
+{
+  clockPin = clock;
+  dataPin = data;
+  clockLevel = true;
+  dataLevel = true;
+  for (uint8_t i = 0; i < LED_MATRIX_SIZE; i++)
+  {
+    frame[i] = 0;
+    sent[i] = 0;
+  }
+  pending = false;
+  controlPending = false;
+  control = AIP1640_DISPLAY_ON | LED_MATRIX_BRIGHTNESS;
+  async = false;
+  step = STEP_IDLE;
+  position = 0;
+  last = 0;
+}
+
+/**
+ * @brief Configure les broches, efface la matrice et l'allume.
+ */
+void RaLedMatrix::init()
+{
+#if defined(__AVR__)
+  clockToggle = portInputRegister(digitalPinToPort(clockPin));
+  dataToggle = portInputRegister(digitalPinToPort(dataPin));
+  clockMask = digitalPinToBitMask(clockPin);
+  dataMask = digitalPinToBitMask(dataPin);
+#endif
+  // Idle bus: both lines high
+  hw.digitalWrite(clockPin, HIGH);
+  hw.digitalWrite(dataPin, HIGH);
+  hw.pinMode(clockPin, OUTPUT);
+  hw.pinMode(dataPin, OUTPUT);
+  clockLevel = true;
+  dataLevel = true;
+
+  // The matrix content is unknown: send every column
+  for (uint8_t i = 0; i < LED_MATRIX_SIZE; i++)
+  {
+    sent[i] = ~frame[i];
+  }
+  pending = true;
+  controlPending = true;
+  flush();
+}
+
+/**
+ * @brief Affiche une image (16 colonnes). Seules les colonnes qui ont changé sont envoyées.
+ *
+ * @param entries les 16 colonnes, le bit 0 étant la ligne du haut.
+ */
+void RaLedMatrix::display(unsigned char entries[])
+{
+  write(0, entries, LED_MATRIX_SIZE);
+}
+
+/**
+ * @brief Modifie une partie des colonnes de la matrice.
+ * En mode synchrone, les colonnes sont envoyées avant le retour ; en mode asynchrone, elles le sont
+ * par interruption, et une image plus récente remplace celle qui n'a pas encore été envoyée.
+ *
+ * @param first la première colonne (0 à 15).
+ * @param data les colonnes.
+ * @param count le nombre de colonnes.
+ */
+void RaLedMatrix::write(uint8_t first, const uint8_t* data, uint8_t count)
+{
+  for (uint8_t i = 0; i < count && first + i < LED_MATRIX_SIZE; i++)
+  {
+    frame[first + i] = data[i];
+  }
+  pending = true;
+  if(async)
+  {
+    arm();
+  }
+  else
+  {
+    flush();
+  }
+}
+
+/**
+ * @brief Règle la luminosité de la matrice.
+ *
+ * @param level la luminosité, de 0 (la plus faible) à 7.
+ */
+void RaLedMatrix::setBrightness(uint8_t level)
+{
+  control = (control & AIP1640_DISPLAY_ON) | (level & 0x07);
+  controlPending = true;
+  if(async)
+  {
+    arm();
+  }
+  else
+  {
+    flush();
+  }
+}
+
+/**
+ * @brief Allume ou éteint la matrice, sans perdre l'image.
+ *
+ * @param on true = allumée.
+ */
+void RaLedMatrix::setOn(bool on)
+{
+  control = on ? (control | AIP1640_DISPLAY_ON) : ((control & ~AIP1640_DISPLAY_ON) | AIP1640_DISPLAY_OFF);
+  controlPending = true;
+  if(async)
+  {
+    arm();
+  }
+  else
+  {
+    flush();
+  }
+}
+
+/**
+ * @brief Active ou désactive l'envoi asynchrone (par interruption sur AVR ; sur ordinateur, l'appelant
+ * avance l'envoi avec transferStep(), comme le ferait l'interruption).
+ *
+ * @param enable true = display() ne bloque plus.
+ */
+void RaLedMatrix::setAsync(bool enable)
+{
+#if LED_MATRIX_ASYNC
+  if(!enable && async)
+  {
+    TIMSK0 &= ~_BV(OCIE0B);
+    asyncMatrix = NULL;
+  }
+  async = enable;
+  if(async)
+  {
+    asyncMatrix = this;
+    arm();
+  }
+  else
+  {
+    flush();
+  }
+#elif defined(RA_HOST)
+  async = enable;
+  if(!async)
+  {
+    flush();
+  }
+#else
+  (void)enable;
+#endif
+}
+
+/**
+ * @brief Indique si un envoi est en cours ou en attente.
+ *
+ * @return bool true = la matrice n'affiche pas encore la dernière image.
+ */
+bool RaLedMatrix::isBusy()
+{
+  return step != STEP_IDLE || pending || controlPending;
+}
+
+/**
+ * @brief Envoie sans attendre l'interruption tout ce qui est en attente (mode synchrone).
+ */
+void RaLedMatrix::flush()
+{
+  while(transferStep())
+  {
+  }
+}
+
+/**
+ * @brief Avance l'envoi d'un pas : une commande, l'adresse ou une colonne.
+ * Appelée par l'interruption en mode asynchrone, en boucle par flush() sinon.
+ *
+ * @return bool true s'il reste quelque chose à envoyer.
+ */
+bool RaLedMatrix::transferStep()
+{
+  switch (step)
+  {
+  case STEP_IDLE:
+    if(pending)
+    {
+      pending = false;
+      // Changed columns only: [position, last]
+      position = LED_MATRIX_SIZE;
+      for (uint8_t i = 0; i < LED_MATRIX_SIZE; i++)
+      {
+        if(frame[i] != sent[i])
+        {
+          if(position == LED_MATRIX_SIZE)
+          {
+            position = i;
+          }
+          last = i;
+        }
+      }
+      if(position < LED_MATRIX_SIZE)
+      {
+        step = STEP_COMMAND;
+        return true;
+      }
+    }
+    if(controlPending)
+    {
+      step = STEP_CONTROL;
+      return true;
+    }
+    return false;
+
+  case STEP_COMMAND:
+    start();
+    writeByte(AIP1640_DATA_AUTO);
+    stop();
+    step = STEP_ADDRESS;
+    return true;
+
+  case STEP_ADDRESS:
+    start();
+    writeByte(AIP1640_ADDRESS | position);
+    step = STEP_DATA;
+    return true;
+
+  case STEP_DATA:
+  {
+    uint8_t value = frame[position];
+    writeByte(value);
+    sent[position] = value;
+    if(position++ == last)
+    {
+      stop();
+      step = controlPending ? STEP_CONTROL : STEP_IDLE;
+    }
+    return true;
+  }
+
+  case STEP_CONTROL:
+    controlPending = false;
+    start();
+    writeByte(control);
+    stop();
+    step = STEP_IDLE;
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Lance l'interruption d'envoi si elle est arrêtée.
+ */
+void RaLedMatrix::arm()
+{
+#if LED_MATRIX_ASYNC
+  // Timer 0 runs millis(): its compare B match happens every cycle whatever OCR0B holds
+  TIFR0 = _BV(OCF0B);
+  TIMSK0 |= _BV(OCIE0B);
+#endif
+}
+
+void RaLedMatrix::setClock(bool level)
+{
+  if(level == clockLevel)
+  {
+    return;
+  }
+  clockLevel = level;
+#if defined(__AVR__)
+  *clockToggle = clockMask;
+#else
+  hw.digitalWrite(clockPin, level);
+#endif
+}
+
+void RaLedMatrix::setData(bool level)
+{
+  if(level == dataLevel)
+  {
+    return;
+  }
+  dataLevel = level;
+#if defined(__AVR__)
+  *dataToggle = dataMask;
+#else
+  hw.digitalWrite(dataPin, level);
+#endif
+}
+
+/**
+ * @brief Condition de départ : données de haut en bas pendant que l'horloge est haute.
+ */
+void RaLedMatrix::start()
+{
+  setData(false);
+  HALF_BIT();
+  setClock(false);
+}
+
+/**
+ * @brief Condition d'arrêt : données de bas en haut pendant que l'horloge est haute.
+ */
+void RaLedMatrix::stop()
+{
+  setData(false);
+  HALF_BIT();
+  setClock(true);
+  HALF_BIT();
+  setData(true);
+}
+
+/**
+ * @brief Envoie un octet, bit de poids faible en premier, lu sur le front montant de l'horloge.
+ *
+ * @param value l'octet.
+ */
+void RaLedMatrix::writeByte(uint8_t value)
+{
+  for (uint8_t i = 0; i < 8; i++)
+  {
+    setData(value & 0x01);
+    HALF_BIT();
+    setClock(true);
+    HALF_BIT();
+    setClock(false);
+    value >>= 1;
+  }
+}
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef RA_LED_MATRIX_H
+#define RA_LED_MATRIX_H
+
+#include <Arduino.h>
+#include <RaHardware.h>
+
+#define LED_MATRIX_SIZE 16 // bytes, one per column
+
+// AiP1640 commands
+#define AIP1640_DATA_AUTO 0x40    // write data, auto-increment address
+#define AIP1640_ADDRESS 0xC0      // | first address
+#define AIP1640_DISPLAY_OFF 0x80
+#define AIP1640_DISPLAY_ON 0x88   // | brightness (0-7)
+
+#define LED_MATRIX_BRIGHTNESS 2 // default brightness (0-7)
+
+// Asynchronous transfer from the Timer 0 compare B interrupt (AVR)
+#if defined(__AVR__) && defined(OCIE0B)
+#define LED_MATRIX_ASYNC 1
+#else
+#define LED_MATRIX_ASYNC 0
+#endif
+
+/**
+ * Pilote de la matrice de LEDs 16x8 à contrôleur AiP1640 (protocole deux fils : horloge et données,
+ * bit de poids faible en premier, sans acquittement ni adresse, donc incompatible avec le TWI).
+ *
+ * Sur AVR, les broches sont pilotées directement par leur port : chaque front est une seule écriture
+ * dans le registre PINx, qui inverse la broche sans toucher aux autres broches du port (le servomoteur
+ * est sur le même port). Seules les colonnes qui ont changé depuis le dernier envoi sont transmises,
+ * en une rafale à adresse auto-incrémentée.
+ *
+ * En mode asynchrone, display() retourne aussitôt : les octets sont envoyés un par un par
+ * l'interruption de comparaison B du timer 0 (une fois par milliseconde, sans changer OCR0B ni la PWM
+ * de la broche 5), pendant que la boucle principale continue.
+ *
+ * Hors AVR, les broches passent par la couche matérielle : sur ordinateur (RA_HOST), les fronts
+ * du bus peuvent être relevés et décodés, et le mode asynchrone est avancé par transferStep().
+ */
+class RaLedMatrix
+{
+private:
+  RaHardware& hw;
+  uint8_t clockPin;
+  uint8_t dataPin;
+#if defined(__AVR__)
+  volatile uint8_t* clockToggle; // PINx
+  volatile uint8_t* dataToggle;
+  uint8_t clockMask;
+  uint8_t dataMask;
+#endif
+  bool clockLevel;
+  bool dataLevel;
+
+  volatile uint8_t frame[LED_MATRIX_SIZE];
+  uint8_t sent[LED_MATRIX_SIZE];
+  volatile bool pending;
+  volatile bool controlPending;
+  uint8_t control;
+  bool async;
+
+  // Transfer state machine
+  volatile uint8_t step;
+  uint8_t position;
+  uint8_t last;
+
+  void setClock(bool level);
+  void setData(bool level);
+  void start();
+  void stop();
+  void writeByte(uint8_t value);
+  void arm();
+
+public:
+  RaLedMatrix(RaHardware& hardware, uint8_t clock, uint8_t data);
+
+  void init();
+  void display(unsigned char entries[]);
+  void write(uint8_t first, const uint8_t* data, uint8_t count);
+  void setBrightness(uint8_t level);
+  void setOn(bool on);
+  void setAsync(bool enable);
+  bool isBusy();
+  void flush();
+
+  bool transferStep();
+};
+
+#endif
@@ -0,0 +1,405 @@
+#include <RaMatrixAnimation.h>
+
+/**
+ * Police 5x7 des caractères ' ' à '_' (ASCII 32 à 95) : 5 colonnes par caractère,
+ * le bit 0 étant la ligne du haut. Les minuscules sont affichées en majuscules.
+ */
+static const uint8_t font5x7[] PROGMEM = {
+  0x00, 0x00, 0x00, 0x00, 0x00, // ' '
+  0x00, 0x00, 0x5F, 0x00, 0x00, // '!'
+  0x00, 0x07, 0x00, 0x07, 0x00, // '"'
+  0x14, 0x7F, 0x14, 0x7F, 0x14, // '#'
+  0x24, 0x2A, 0x7F, 0x2A, 0x12, // '$'
+  0x23, 0x13, 0x08, 0x64, 0x62, // '%'
+  0x36, 0x49, 0x55, 0x22, 0x50, // '&'
+  0x00, 0x05, 0x03, 0x00, 0x00, // '''
+  0x00, 0x1C, 0x22, 0x41, 0x00, // '('
+  0x00, 0x41, 0x22, 0x1C, 0x00, // ')'
+  0x08, 0x2A, 0x1C, 0x2A, 0x08, // '*'
+  0x08, 0x08, 0x3E, 0x08, 0x08, // '+'
+  0x00, 0x50, 0x30, 0x00, 0x00, // ','
+  0x08, 0x08, 0x08, 0x08, 0x08, // '-'
+  0x00, 0x60, 0x60, 0x00, 0x00, // '.'
+  0x20, 0x10, 0x08, 0x04, 0x02, // '/'
+  0x3E, 0x51, 0x49, 0x45, 0x3E, // '0'
+  0x00, 0x42, 0x7F, 0x40, 0x00, // '1'
+  0x42, 0x61, 0x51, 0x49, 0x46, // '2'
+  0x21, 0x41, 0x45, 0x4B, 0x31, // '3'
+  0x18, 0x14, 0x12, 0x7F, 0x10, // '4'
+  0x27, 0x45, 0x45, 0x45, 0x39, // '5'
+  0x3C, 0x4A, 0x49, 0x49, 0x30, // '6'
+  0x01, 0x71, 0x09, 0x05, 0x03, // '7'
+  0x36, 0x49, 0x49, 0x49, 0x36, // '8'
+  0x06, 0x49, 0x49, 0x29, 0x1E, // '9'
+  0x00, 0x36, 0x36, 0x00, 0x00, // ':'
+  0x00, 0x56, 0x36, 0x00, 0x00, // ';'
+  0x08, 0x14, 0x22, 0x41, 0x00, // '<'
+  0x14, 0x14, 0x14, 0x14, 0x14, // '='
+  0x00, 0x41, 0x22, 0x14, 0x08, // '>'
+  0x02, 0x01, 0x51, 0x09, 0x06, // '?'
+  0x32, 0x49, 0x79, 0x41, 0x3E, // '@'
+  0x7E, 0x11, 0x11, 0x11, 0x7E, // 'A'
+  0x7F, 0x49, 0x49, 0x49, 0x36, // 'B'
+  0x3E, 0x41, 0x41, 0x41, 0x22, // 'C'
+  0x7F, 0x41, 0x41, 0x22, 0x1C, // 'D'
+  0x7F, 0x49, 0x49, 0x49, 0x41, // 'E'
+  0x7F, 0x09, 0x09, 0x01, 0x01, // 'F'
+  0x3E, 0x41, 0x41, 0x51, 0x32, // 'G'
+  0x7F, 0x08, 0x08, 0x08, 0x7F, // 'H'
+  0x00, 0x41, 0x7F, 0x41, 0x00, // 'I'
+  0x20, 0x40, 0x41, 0x3F, 0x01, // 'J'
+  0x7F, 0x08, 0x14, 0x22, 0x41, // 'K'
+  0x7F, 0x40, 0x40, 0x40, 0x40, // 'L'
+  0x7F, 0x02, 0x04, 0x02, 0x7F, // 'M'
+  0x7F, 0x04, 0x08, 0x10, 0x7F, // 'N'
+  0x3E, 0x41, 0x41, 0x41, 0x3E, // 'O'
+  0x7F, 0x09, 0x09, 0x09, 0x06, // 'P'
+  0x3E, 0x41, 0x51, 0x21, 0x5E, // 'Q'
+  0x7F, 0x09, 0x19, 0x29, 0x46, // 'R'
+  0x46, 0x49, 0x49, 0x49, 0x31, // 'S'
+  0x01, 0x01, 0x7F, 0x01, 0x01, // 'T'
+  0x3F, 0x40, 0x40, 0x40, 0x3F, // 'U'
+  0x1F, 0x20, 0x40, 0x20, 0x1F, // 'V'
+  0x7F, 0x20, 0x18, 0x20, 0x7F, // 'W'
+  0x63, 0x14, 0x08, 0x14, 0x63, // 'X'
+  0x03, 0x04, 0x78, 0x04, 0x03, // 'Y'
+  0x61, 0x51, 0x49, 0x45, 0x43, // 'Z'
+  0x00, 0x7F, 0x41, 0x41, 0x00, // '['
+  0x02, 0x04, 0x08, 0x10, 0x20, // '\'
+  0x00, 0x41, 0x41, 0x7F, 0x00, // ']'
+  0x04, 0x02, 0x01, 0x02, 0x04, // '^'
+  0x40, 0x40, 0x40, 0x40, 0x40  // '_'
+};
+
+/**
+ * @brief Récupère les colonnes d'un caractère dans la police.
+ *
+ * @param c le caractère ; les minuscules donnent les majuscules, les caractères inconnus un '?'.
+ * @return const uint8_t* les 5 colonnes du caractère, en mémoire flash.
+ */
+static const uint8_t* glyph(char c)
+{
+  if (c >= 'a' && c <= 'z')
+  {
+    c -= 'a' - 'A';
+  }
+  if (c < FONT_FIRST_CHAR || c > FONT_LAST_CHAR)
+  {
+    c = '?';
+  }
+  return font5x7 + (c - FONT_FIRST_CHAR) * FONT_WIDTH;
+}
+
+/**
+ * Constructeur de la classe RaMatrixAnimation. L'image de travail est vide et sera envoyée au premier affichage.
+ */
+RaMatrixAnimation::RaMatrixAnimation()
+{
+  state = ANIM_IDLE;
+  started = true;
+  lastStep = 0;
+  period = 0;
+  frames = NULL;
+  frameCount = 0;
+  frameIndex = 0;
+  repeat = false;
+  textWidth = 0;
+  textOffset = 0;
+  text[0] = '\0';
+  for (uint8_t x = 0; x < MATRIX_COLUMNS; x++)
+  {
+    buffer[x] = 0;
+  }
+  dirty = true; // the matrix content is unknown until the first frame is sent
+}
+
+/**
+ * @brief Efface l'image de travail.
+ */
+void RaMatrixAnimation::clear()
+{
+  for (uint8_t x = 0; x < MATRIX_COLUMNS; x++)
+  {
+    setColumn(x, 0);
+  }
+}
+
+/**
+ * @brief Définit les 8 pixels d'une colonne.
+ *
+ * @param x la colonne (0 à 15).
+ * @param bits les pixels, le bit 0 étant la ligne du haut.
+ */
+void RaMatrixAnimation::setColumn(uint8_t x, uint8_t bits)
+{
+  if (x < MATRIX_COLUMNS && buffer[x] != bits)
+  {
+    buffer[x] = bits;
+    dirty = true;
+  }
+}
+
+/**
+ * @brief Allume ou éteint un pixel.
+ *
+ * @param x la colonne (0 à 15).
+ * @param y la ligne (0 à 7, 0 = en haut).
+ * @param on true = allume le pixel.
+ */
+void RaMatrixAnimation::setPixel(uint8_t x, uint8_t y, bool on)
+{
+  if (x >= MATRIX_COLUMNS || y >= MATRIX_ROWS)
+  {
+    return;
+  }
+  if (on)
+  {
+    setColumn(x, buffer[x] | (1 << y));
+  }
+  else
+  {
+    setColumn(x, buffer[x] & ~(1 << y));
+  }
+}
+
+/**
+ * @brief Indique si un pixel est allumé.
+ *
+ * @param x la colonne (0 à 15).
+ * @param y la ligne (0 à 7, 0 = en haut).
+ * @return bool true = le pixel est allumé.
+ */
+bool RaMatrixAnimation::getPixel(uint8_t x, uint8_t y)
+{
+  if (x >= MATRIX_COLUMNS || y >= MATRIX_ROWS)
+  {
+    return false;
+  }
+  return buffer[x] & (1 << y);
+}
+
+/**
+ * @brief Copie une image complète dans l'image de travail.
+ *
+ * @param entries un tableau de 16 x 8 bits (en RAM).
+ */
+void RaMatrixAnimation::load(const uint8_t entries[])
+{
+  for (uint8_t x = 0; x < MATRIX_COLUMNS; x++)
+  {
+    setColumn(x, entries[x]);
+  }
+}
+
+/**
+ * @brief Dessine un caractère de la police 5x7 ; les colonnes hors de la matrice sont ignorées.
+ *
+ * @param x la colonne de gauche du caractère (peut être négative).
+ * @param c le caractère.
+ * @return uint8_t la largeur occupée, espacement compris.
+ */
+uint8_t RaMatrixAnimation::drawChar(int x, char c)
+{
+  const uint8_t* columns = glyph(c);
+
+  for (uint8_t i = 0; i < FONT_WIDTH; i++)
+  {
+    // Checked on the int: x + i would wrap to the left columns once truncated to uint8_t
+    int column = x + i;
+    if (column >= 0 && column < MATRIX_COLUMNS)
+    {
+      setColumn(column, pgm_read_byte(columns + i));
+    }
+  }
+  return FONT_WIDTH + FONT_SPACING;
+}
+
+/**
+ * @brief Joue une séquence d'images stockée en mémoire flash (PROGMEM), 16 octets par image.
+ *
+ * @param progmemFrames les images, en mémoire flash.
+ * @param count le nombre d'images.
+ * @param framePeriod la durée d'une image en millisecondes.
+ * @param loop true = rejoue la séquence sans fin.
+ */
+void RaMatrixAnimation::playFrames(const uint8_t* progmemFrames, uint8_t count, unsigned int framePeriod, bool loop)
+{
+  if (count == 0)
+  {
+    return;
+  }
+  frames = progmemFrames;
+  frameCount = count;
+  frameIndex = 0;
+  repeat = loop;
+  period = framePeriod;
+  started = false;
+  state = ANIM_FRAMES;
+  showFrame(0);
+}
+
+/**
+ * @brief Fait défiler un texte de droite à gauche, une fois.
+ * Le texte est copié (ANIM_TEXT_MAX caractères au plus) : il peut être construit à la volée.
+ *
+ * @param message le texte.
+ * @param columnPeriod la durée d'un décalage d'une colonne, en millisecondes.
+ */
+void RaMatrixAnimation::scrollText(const char* message, unsigned int columnPeriod)
+{
+  uint8_t length = 0;
+
+  while (length < ANIM_TEXT_MAX && message[length] != '\0')
+  {
+    text[length] = message[length];
+    length++;
+  }
+  text[length] = '\0';
+
+  textWidth = length * (FONT_WIDTH + FONT_SPACING);
+  textOffset = -MATRIX_COLUMNS;
+  period = columnPeriod;
+  started = false;
+  state = ANIM_TEXT;
+  renderText();
+}
+
+/**
+ * @brief Arrête l'animation en cours ; la dernière image reste affichée.
+ */
+void RaMatrixAnimation::stop()
+{
+  state = ANIM_IDLE;
+}
+
+/**
+ * @brief Indique si une animation ou un texte est en cours.
+ *
+ * @return bool true = une animation est en cours.
+ */
+bool RaMatrixAnimation::isRunning()
+{
+  return state != ANIM_IDLE;
+}
+
+/**
+ * @brief Fait avancer l'animation si sa période est écoulée. Ne bloque jamais.
+ *
+ * @param now le temps courant en millisecondes.
+ * @return bool true si l'image de travail a changé et doit être envoyée à la matrice.
+ */
+bool RaMatrixAnimation::tick(unsigned long now)
+{
+  if (!started)
+  {
+    // The first image is already drawn: its period starts now
+    started = true;
+    lastStep = now;
+  }
+  else if (state != ANIM_IDLE && now - lastStep >= period)
+  {
+    lastStep = now;
+
+    if (state == ANIM_FRAMES)
+    {
+      frameIndex++;
+      if (frameIndex >= frameCount)
+      {
+        if (!repeat)
+        {
+          state = ANIM_IDLE;
+          return dirty;
+        }
+        frameIndex = 0;
+      }
+      showFrame(frameIndex);
+    }
+    else
+    {
+      textOffset++;
+      if (textOffset > textWidth)
+      {
+        state = ANIM_IDLE;
+        return dirty;
+      }
+      renderText();
+    }
+  }
+  return dirty;
+}
+
+/**
+ * @brief Indique si l'image de travail a changé depuis le dernier envoi.
+ *
+ * @return bool true = l'image doit être envoyée.
+ */
+bool RaMatrixAnimation::isDirty()
+{
+  return dirty;
+}
+
+/**
+ * @brief Signale que l'image de travail vient d'être envoyée à la matrice.
+ */
+void RaMatrixAnimation::clean()
+{
+  dirty = false;
+}
+
+/**
+ * @brief Récupère l'image de travail (16 x 8 bits).
+ *
+ * @return uint8_t* l'image.
+ */
+uint8_t* RaMatrixAnimation::getBuffer()
+{
+  return buffer;
+}
+
+/**
+ * @brief Copie une image de la séquence en cours dans l'image de travail.
+ *
+ * @param index le numéro de l'image.
+ */
+void RaMatrixAnimation::showFrame(uint8_t index)
+{
+  const uint8_t* frame = frames + index * MATRIX_COLUMNS;
+
+  for (uint8_t x = 0; x < MATRIX_COLUMNS; x++)
+  {
+    setColumn(x, pgm_read_byte(frame + x));
+  }
+}
+
+/**
+ * @brief Dessine la portion visible du texte défilant.
+ */
+void RaMatrixAnimation::renderText()
+{
+  for (uint8_t x = 0; x < MATRIX_COLUMNS; x++)
+  {
+    setColumn(x, textColumn(textOffset + x));
+  }
+}
+
+/**
+ * @brief Calcule une colonne du texte défilant.
+ *
+ * @param column la colonne dans le texte complet.
+ * @return uint8_t les pixels de la colonne.
+ */
+uint8_t RaMatrixAnimation::textColumn(int column)
+{
+  if (column < 0 || column >= textWidth)
+  {
+    return 0;
+  }
+
+  uint8_t i = column % (FONT_WIDTH + FONT_SPACING);
+  if (i >= FONT_WIDTH)
+  {
+    return 0;
+  }
+
+  return pgm_read_byte(glyph(text[column / (FONT_WIDTH + FONT_SPACING)]) + i);
+}
@@ -0,0 +1,83 @@
+#ifndef RA_MATRIX_ANIMATION_H
+#define RA_MATRIX_ANIMATION_H
+
+#include <Arduino.h>
+
+// Matrix size
+#define MATRIX_COLUMNS 16
+#define MATRIX_ROWS 8
+
+// Font: 5x7 characters, one blank column between them
+#define FONT_WIDTH 5
+#define FONT_SPACING 1
+#define FONT_FIRST_CHAR ' '
+#define FONT_LAST_CHAR '_'
+
+#define ANIM_TEXT_MAX 24
+#define ANIM_SCROLL_PERIOD 80 // ms per column
+
+// Animation states
+#define ANIM_IDLE 0
+#define ANIM_FRAMES 1
+#define ANIM_TEXT 2
+
+/**
+ * Moteur d'animation pour la matrice de LEDs 16x8 : une image de travail (16 colonnes de 8 bits,
+ * le bit 0 étant la ligne du haut), des primitives de dessin, des séquences d'images et un texte
+ * défilant en police 5x7, toutes deux lues en mémoire flash.
+ *
+ * La méthode tick() fait avancer l'animation sans jamais attendre ; l'image n'est marquée
+ * modifiée (isDirty) que si un pixel a réellement changé, pour ne l'envoyer à la matrice
+ * qu'à bon escient.
+ */
+class RaMatrixAnimation
+{
+private:
+  uint8_t buffer[MATRIX_COLUMNS];
+  bool dirty;
+
+  uint8_t state;
+  bool started;
+  unsigned long lastStep;
+  unsigned int period;
+
+  // Frame sequence
+  const uint8_t* frames;
+  uint8_t frameCount;
+  uint8_t frameIndex;
+  bool repeat;
+
+  // Scrolling text
+  char text[ANIM_TEXT_MAX + 1];
+  int textWidth;
+  int textOffset;
+
+  void showFrame(uint8_t index);
+  void renderText();
+  uint8_t textColumn(int column);
+
+public:
+  RaMatrixAnimation();
+
+  // Drawing
+  void clear();
+  void setColumn(uint8_t x, uint8_t bits);
+  void setPixel(uint8_t x, uint8_t y, bool on);
+  bool getPixel(uint8_t x, uint8_t y);
+  void load(const uint8_t entries[]);
+  uint8_t drawChar(int x, char c);
+
+  // Animations
+  void playFrames(const uint8_t* progmemFrames, uint8_t count, unsigned int framePeriod, bool loop);
+  void scrollText(const char* message, unsigned int columnPeriod = ANIM_SCROLL_PERIOD);
+  void stop();
+  bool isRunning();
+  bool tick(unsigned long now);
+
+  // Output
+  bool isDirty();
+  void clean();
+  uint8_t* getBuffer();
+};
+
+#endif
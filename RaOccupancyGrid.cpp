@@ -0,0 +1,355 @@
+#include <RaOccupancyGrid.h>
+
+// Cell size in um (position unit)
+#define GRID_CELL_UM (GRID_CELL * 10000L)
+
+/**
+ * Quart de sinusoïde, 64 pas par quart de tour, en virgule fixe 2.14 (16384 = 1).
+ */
+static const int16_t sinTable[65] PROGMEM = {
+  0, 402, 804, 1205, 1606, 2006, 2404, 2801, 3196, 3590, 3981, 4370, 4756,
+  5139, 5520, 5897, 6270, 6639, 7005, 7366, 7723, 8076, 8423, 8765, 9102, 9434,
+  9760, 10080, 10394, 10702, 11003, 11297, 11585, 11866, 12140, 12406, 12665, 12916, 13160,
+  13395, 13623, 13842, 14053, 14256, 14449, 14635, 14811, 14978, 15137, 15286, 15426, 15557,
+  15679, 15791, 15893, 15986, 16069, 16143, 16207, 16261, 16305, 16340, 16364, 16379, 16384
+};
+
+/**
+ * Constructeur de la classe RaOccupancyGrid : la carte est inconnue, la voiture est à l'origine
+ * et regarde vers les x croissants.
+ */
+RaOccupancyGrid::RaOccupancyGrid()
+{
+  reset();
+}
+
+/**
+ * @brief Oublie la carte et replace la voiture à l'origine.
+ */
+void RaOccupancyGrid::reset()
+{
+  memset(cells, 0, sizeof(cells));
+  x = 0;
+  y = 0;
+  heading = 0;
+  originX = -GRID_SIZE / 2;
+  originY = -GRID_SIZE / 2;
+  leftSpeed = 0;
+  rightSpeed = 0;
+  lastMove = 0;
+  started = false;
+}
+
+/**
+ * @brief Intègre le déplacement de la voiture depuis l'appel précédent (aux vitesses commandées
+ * alors), puis retient les nouvelles vitesses. À appeler à chaque changement de commande des moteurs
+ * et régulièrement entre deux changements.
+ *
+ * @param now le temps courant en millisecondes.
+ * @param newLeftSpeed la vitesse commandée du côté gauche (-255 à 255, négatif = en arrière).
+ * @param newRightSpeed la vitesse commandée du côté droit (-255 à 255, négatif = en arrière).
+ */
+void RaOccupancyGrid::move(unsigned long now, int newLeftSpeed, int newRightSpeed)
+{
+  if(started && (leftSpeed || rightSpeed))
+  {
+    unsigned long dt = now - lastMove;
+    if(dt > ODOMETRY_MAX_STEP)
+    {
+      dt = ODOMETRY_MAX_STEP;
+    }
+
+    // mm/s * ms = um
+    long distance = (long)(leftSpeed + rightSpeed) * ODOMETRY_SPEED / (2 * 255) * (long)dt;
+    uint8_t angle = heading >> 24;
+    x += (distance >> 4) * sinQ14(angle + 64) >> 10;
+    y += (distance >> 4) * sinQ14(angle) >> 10;
+
+    // heading units/s * ms, then to 1/65536 heading unit: * 65536 / 1000
+    long turn = (long)(rightSpeed - leftSpeed) * HEADING_DEGREES(ODOMETRY_TURN_RATE) / (2 * 255) * (long)dt;
+    if(turn >= 0)
+    {
+      heading += ((unsigned long)turn / 125) * 8192;
+    }
+    else
+    {
+      heading -= ((unsigned long)-turn / 125) * 8192;
+    }
+
+    scroll();
+  }
+
+  leftSpeed = newLeftSpeed;
+  rightSpeed = newRightSpeed;
+  lastMove = now;
+  started = true;
+}
+
+/**
+ * @brief Trace une mesure de distance dans la carte : les cellules entre la voiture et l'obstacle
+ * deviennent plus libres, celle de l'obstacle plus occupée.
+ *
+ * @param bearing la direction de la mesure par rapport à l'avant de la voiture, en degrés
+ * (sens inverse des aiguilles d'une montre : 90 = à gauche, -90 = à droite).
+ * @param distance la distance de l'obstacle en cm, 0 ou moins si aucun obstacle n'a été vu.
+ */
+void RaOccupancyGrid::addRange(int bearing, long distance)
+{
+  bool hit = distance > 0 && distance < GRID_SIZE * GRID_CELL;
+  long x0 = cellX();
+  long y0 = cellY();
+  long x1;
+  long y1;
+
+  rayEnd(bearing, hit ? distance : GRID_SIZE * GRID_CELL, &x1, &y1);
+
+  // Bresenham, all octants
+  long dx = abs(x1 - x0);
+  long dy = -abs(y1 - y0);
+  int sx = x0 < x1 ? 1 : -1;
+  int sy = y0 < y1 ? 1 : -1;
+  long err = dx + dy;
+
+  while(inWindow(x0, y0))
+  {
+    bool last = x0 == x1 && y0 == y1;
+    int8_t* c = cell(x0, y0);
+    int value = *c + (last && hit ? GRID_HIT : -GRID_MISS);
+
+    *c = constrain(value, -GRID_LIMIT, GRID_LIMIT);
+    if(last)
+    {
+      break;
+    }
+
+    long e2 = 2 * err;
+    if(e2 >= dy)
+    {
+      err += dy;
+      x0 += sx;
+    }
+    if(e2 <= dx)
+    {
+      err += dx;
+      y0 += sy;
+    }
+  }
+}
+
+/**
+ * @brief Mesure dans la carte l'espace libre dans une direction, sans nouvelle mesure des capteurs.
+ *
+ * @param bearing la direction par rapport à l'avant de la voiture, en degrés (90 = à gauche).
+ * @return long la distance en cm jusqu'à la première cellule occupée (ou jusqu'au bord de la carte),
+ * -1 si la direction n'a pas été assez observée (moins de GRID_PLAN_KNOWN cellules connues).
+ */
+long RaOccupancyGrid::clearance(int bearing)
+{
+  long x0 = cellX();
+  long y0 = cellY();
+  long x1;
+  long y1;
+
+  rayEnd(bearing, GRID_SIZE * GRID_CELL, &x1, &y1);
+
+  long dx = abs(x1 - x0);
+  long dy = -abs(y1 - y0);
+  long major = max(dx, -dy);
+  int sx = x0 < x1 ? 1 : -1;
+  int sy = y0 < y1 ? 1 : -1;
+  long err = dx + dy;
+  uint8_t known = 0;
+
+  // Each step moves one cell along the major axis
+  for (long step = 0; major > 0; step++)
+  {
+    long e2 = 2 * err;
+    if(e2 >= dy)
+    {
+      err += dy;
+      x0 += sx;
+    }
+    if(e2 <= dx)
+    {
+      err += dx;
+      y0 += sy;
+    }
+
+    long distance = (step + 1) * GRID_CELL * GRID_SIZE / major;
+    if(!inWindow(x0, y0))
+    {
+      return known < GRID_PLAN_KNOWN ? -1 : distance;
+    }
+
+    int8_t value = *cell(x0, y0);
+    if(value > GRID_OCCUPIED)
+    {
+      return distance;
+    }
+    if(value == 0 && known < GRID_PLAN_KNOWN)
+    {
+      return -1;
+    }
+    if(value != 0)
+    {
+      known++;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Lit une cellule de la carte.
+ *
+ * @param cx l'abscisse de la cellule (en cellules depuis l'origine).
+ * @param cy l'ordonnée de la cellule.
+ * @return int8_t le log-odds de la cellule, 0 (inconnue) hors de la fenêtre.
+ */
+int8_t RaOccupancyGrid::getCell(long cx, long cy)
+{
+  return inWindow(cx, cy) ? *cell(cx, cy) : 0;
+}
+
+/**
+ * @brief Récupère l'abscisse estimée de la voiture.
+ *
+ * @return long l'abscisse en cm depuis l'origine.
+ */
+long RaOccupancyGrid::getX()
+{
+  return x / 10000;
+}
+
+/**
+ * @brief Récupère l'ordonnée estimée de la voiture.
+ *
+ * @return long l'ordonnée en cm depuis l'origine.
+ */
+long RaOccupancyGrid::getY()
+{
+  return y / 10000;
+}
+
+/**
+ * @brief Récupère le cap estimé de la voiture.
+ *
+ * @return unsigned int le cap, 65536 unités par tour (voir HEADING_DEGREES).
+ */
+unsigned int RaOccupancyGrid::getHeading()
+{
+  return heading >> 16;
+}
+
+/**
+ * @brief Fait glisser la fenêtre pour garder la voiture au centre : les colonnes et lignes qui
+ * sortent de la fenêtre sont effacées pour accueillir celles qui y entrent.
+ */
+void RaOccupancyGrid::scroll()
+{
+  long targetX = cellX() - GRID_SIZE / 2;
+  long targetY = cellY() - GRID_SIZE / 2;
+
+  if(abs(targetX - originX) >= GRID_SIZE || abs(targetY - originY) >= GRID_SIZE)
+  {
+    memset(cells, 0, sizeof(cells));
+    originX = targetX;
+    originY = targetY;
+    return;
+  }
+
+  while(originX < targetX)
+  {
+    clearColumn(originX);
+    originX++;
+  }
+  while(originX > targetX)
+  {
+    originX--;
+    clearColumn(originX);
+  }
+  while(originY < targetY)
+  {
+    clearRow(originY);
+    originY++;
+  }
+  while(originY > targetY)
+  {
+    originY--;
+    clearRow(originY);
+  }
+}
+
+void RaOccupancyGrid::clearColumn(long cx)
+{
+  for (uint8_t i = 0; i < GRID_SIZE; i++)
+  {
+    cells[i][cx & (GRID_SIZE - 1)] = 0;
+  }
+}
+
+void RaOccupancyGrid::clearRow(long cy)
+{
+  memset(cells[cy & (GRID_SIZE - 1)], 0, GRID_SIZE);
+}
+
+bool RaOccupancyGrid::inWindow(long cx, long cy)
+{
+  return cx >= originX && cx < originX + GRID_SIZE && cy >= originY && cy < originY + GRID_SIZE;
+}
+
+int8_t* RaOccupancyGrid::cell(long cx, long cy)
+{
+  return &cells[cy & (GRID_SIZE - 1)][cx & (GRID_SIZE - 1)];
+}
+
+/**
+ * @brief Calcule la cellule au bout d'un rayon partant de la voiture.
+ *
+ * @param bearing la direction par rapport à l'avant de la voiture, en degrés.
+ * @param length la longueur du rayon en cm (GRID_SIZE * GRID_CELL au plus).
+ * @param cx l'abscisse de la cellule.
+ * @param cy l'ordonnée de la cellule.
+ */
+void RaOccupancyGrid::rayEnd(int bearing, long length, long* cx, long* cy)
+{
+  uint8_t angle = (uint16_t)((heading >> 16) + HEADING_DEGREES(bearing)) >> 8;
+  long mm = length * 10;
+  long endX = x + (mm * sinQ14(angle + 64) >> 14) * 1000;
+  long endY = y + (mm * sinQ14(angle) >> 14) * 1000;
+
+  *cx = endX >= 0 ? endX / GRID_CELL_UM : -((-endX + GRID_CELL_UM - 1) / GRID_CELL_UM);
+  *cy = endY >= 0 ? endY / GRID_CELL_UM : -((-endY + GRID_CELL_UM - 1) / GRID_CELL_UM);
+}
+
+long RaOccupancyGrid::cellX()
+{
+  return x >= 0 ? x / GRID_CELL_UM : -((-x + GRID_CELL_UM - 1) / GRID_CELL_UM);
+}
+
+long RaOccupancyGrid::cellY()
+{
+  return y >= 0 ? y / GRID_CELL_UM : -((-y + GRID_CELL_UM - 1) / GRID_CELL_UM);
+}
+
+/**
+ * @brief Sinus d'un angle, par la table du quart de sinusoïde.
+ *
+ * @param angle l'angle, 256 pas par tour.
+ * @return int le sinus en virgule fixe 2.14.
+ */
+int RaOccupancyGrid::sinQ14(uint8_t angle)
+{
+  uint8_t index = angle & 0x3F;
+
+  switch (angle >> 6)
+  {
+  case 0:
+    return pgm_read_word(&sinTable[index]);
+  case 1:
+    return pgm_read_word(&sinTable[64 - index]);
+  case 2:
+    return -(int)pgm_read_word(&sinTable[index]);
+  default:
+    return -(int)pgm_read_word(&sinTable[64 - index]);
+  }
+}
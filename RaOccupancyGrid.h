@@ -0,0 +1,78 @@
+#ifndef RA_OCCUPANCY_GRID_H
+#define RA_OCCUPANCY_GRID_H
+
+#include <Arduino.h>
+
+// Grid window: GRID_SIZE x GRID_SIZE cells of GRID_CELL cm, centred on the car
+#define GRID_SIZE 16 // power of 2
+#define GRID_CELL 10 // cm
+
+// Log-odds per cell: 0 = unknown, > 0 = occupied, < 0 = free
+#define GRID_HIT 32
+#define GRID_MISS 8
+#define GRID_LIMIT 120
+#define GRID_OCCUPIED 40
+
+// Observed cells a ray must cross before the grid is trusted for planning
+#define GRID_PLAN_KNOWN 3
+
+// Odometry from the commanded PWM (to calibrate on the car): speed and spin rate at full PWM
+#define ODOMETRY_SPEED 500     // mm/s, both sides forward at 255
+#define ODOMETRY_TURN_RATE 360 // deg/s, sides opposite at 255
+#define ODOMETRY_MAX_STEP 1000 // ms, longest integration step
+
+// Heading: 65536 units per turn, counterclockwise
+#define HEADING_DEGREES(d) ((long)(d) * 2912L >> 4) // d * 65536 / 360
+
+/**
+ * Carte d'occupation de l'espace autour de la voiture, à résolution fixe : GRID_SIZE x GRID_SIZE
+ * cellules d'un octet (log-odds : positif = occupé, négatif = libre, 0 = inconnu).
+ *
+ * La position de la voiture est estimée à partir des vitesses commandées aux moteurs (odométrie,
+ * entiers seulement). Chaque mesure de distance est tracée dans la carte, de la voiture vers
+ * l'obstacle, par l'algorithme de Bresenham : les cellules traversées deviennent plus libres,
+ * celle de l'obstacle plus occupée. La carte suit la voiture : quand la voiture change de cellule,
+ * la fenêtre glisse et seules les lignes ou colonnes qui y entrent sont effacées (stockage circulaire).
+ */
+class RaOccupancyGrid
+{
+private:
+  int8_t cells[GRID_SIZE][GRID_SIZE]; // [y & mask][x & mask]
+  long originX; // world cell of the window's lower left corner
+  long originY;
+
+  // Pose: position in um, heading in 1/65536 turn (upper 16 bits)
+  long x;
+  long y;
+  unsigned long heading;
+
+  int leftSpeed;
+  int rightSpeed;
+  unsigned long lastMove;
+  bool started;
+
+  void scroll();
+  void clearColumn(long cx);
+  void clearRow(long cy);
+  bool inWindow(long cx, long cy);
+  int8_t* cell(long cx, long cy);
+  void rayEnd(int bearing, long length, long* cx, long* cy);
+  long cellX();
+  long cellY();
+  static int sinQ14(uint8_t angle);
+
+public:
+  RaOccupancyGrid();
+
+  void reset();
+  void move(unsigned long now, int newLeftSpeed, int newRightSpeed);
+  void addRange(int bearing, long distance);
+  long clearance(int bearing);
+
+  int8_t getCell(long cx, long cy);
+  long getX();
+  long getY();
+  unsigned int getHeading();
+};
+
+#endif
@@ -0,0 +1,301 @@
+#include <RaRangingArray.h>
+
+/**
+ * Constructeur de la classe RaRangingArray.
+ *
+ * @param hardware la couche matérielle.
+ * @param progmemPins les broches des capteurs, dans une table constante en mémoire flash (PROGMEM).
+ * @param sensorCount le nombre de capteurs (RANGING_MAX_SENSORS au plus).
+ */
+RaRangingArray::RaRangingArray(RaHardware& hardware, const RaRangingPins* progmemPins, uint8_t sensorCount)
+  : hw(hardware)
+{
+  pins = progmemPins;
+  count = sensorCount > RANGING_MAX_SENSORS ? RANGING_MAX_SENSORS : sensorCount;
+  for (uint8_t i = 0; i < RANGING_MAX_SENSORS; i++)
+  {
+    readings[i].echo = RANGING_NO_READING;
+    readings[i].time = 0;
+    nextPing[i] = 0;
+  }
+  period = RANGING_PERIOD;
+  pings = 0;
+  current = 0;
+  pending = false;
+  pingTime = 0;
+  guardEnd = 0;
+  echoRise = 0;
+  echoWidth = 0;
+  echoDone = false;
+  echoPin = NOT_A_PIN;
+}
+
+/**
+ * @brief Configure les broches des capteurs.
+ */
+void RaRangingArray::init()
+{
+  for (uint8_t i = 0; i < count; i++)
+  {
+    RaRangingPins sensor = getPins(i);
+    hw.pinMode(sensor.trigger, OUTPUT);
+    hw.pinMode(sensor.echo, INPUT);
+  }
+}
+
+/**
+ * @brief Relève l'écho du capteur qui a tiré, puis déclenche le capteur suivant dont la période
+ * est écoulée, une fois l'intervalle de garde passé. Ne bloque jamais.
+ *
+ * @param now le temps courant en millisecondes.
+ * @param trace la trace des entrées (la durée de chaque écho y passe).
+ * @param sensors les capteurs qui peuvent être déclenchés, un bit par capteur (tous par défaut),
+ * par exemple pour laisser le capteur avant aux mesures bloquantes.
+ * @return int le numéro du capteur qui a une nouvelle mesure, -1 sinon.
+ */
+int RaRangingArray::update(unsigned long now, RaSensorTrace& trace, uint8_t sensors)
+{
+  int measured = -1;
+
+  if(pending)
+  {
+    long duration = -1;
+
+    if(echoDone && !trace.isReplaying())
+    {
+      hw.disableInterrupts();
+      duration = echoWidth;
+      hw.enableInterrupts();
+    }
+
+    duration = trace.event(TRACE_CH_ECHO, duration);
+    if(duration >= 0 || now - pingTime > RANGING_ECHO_TIMEOUT)
+    {
+      readings[current].echo = duration >= 0 ? duration : RANGING_NO_READING;
+      readings[current].time = now;
+      measured = current;
+      pending = false;
+      guardEnd = now + RANGING_GUARD_INTERVAL;
+    }
+  }
+
+  if(!pending && (long)(now - guardEnd) >= 0)
+  {
+    // Round robin: the first sensor after the last one that is due
+    for (uint8_t i = 1; i <= count; i++)
+    {
+      uint8_t index = (current + i) % count;
+      if((sensors & (1 << index)) && (long)(now - nextPing[index]) >= 0)
+      {
+        nextPing[index] = now + period;
+        current = index;
+        pingTime = now;
+        fire(index);
+        break;
+      }
+    }
+  }
+
+  return measured;
+}
+
+/**
+ * @brief Mesure la durée de l'écho d'un capteur en attendant la réponse (bloquant).
+ *
+ * @param index le numéro du capteur.
+ * @param timeout l'attente maximale de l'écho, en microsecondes.
+ * @return long la durée de l'écho en microsecondes, 0 si aucun écho n'est revenu à temps.
+ */
+long RaRangingArray::measure(uint8_t index, unsigned long timeout)
+{
+  RaRangingPins sensor = getPins(index);
+
+  pending = false;
+  pings++;
+  // The sensor is triggered by a HIGH pulse of 10 or more microseconds.
+  // Give a short LOW pulse beforehand to ensure a clean HIGH pulse:
+  hw.digitalWrite(sensor.trigger, LOW);
+  hw.delayMicroseconds(2);
+  hw.digitalWrite(sensor.trigger, HIGH);
+  hw.delayMicroseconds(10);
+  hw.digitalWrite(sensor.trigger, LOW);
+  // Read the signal from the sensor: a HIGH pulse whose
+  // duration is the time (in microseconds) from the sending
+  // of the ping to the reception of its echo off of an object.
+  return hw.pulseIn(sensor.echo, HIGH, timeout);
+}
+
+/**
+ * @brief Convertit la durée d'un écho en distance, sans calcul flottant ni division :
+ * une multiplication par un coefficient en virgule fixe (RANGING_*_Q16) puis un décalage,
+ * arrondi à l'unité la plus proche.
+ *
+ * @param echo la durée de l'écho en microsecondes (38 ms au plus pour un HC-SR04).
+ * @param scaleQ16 le coefficient : RANGING_MM_Q16, RANGING_CM_Q16 ou RANGING_TENTH_INCH_Q16.
+ * @return long la distance dans l'unité du coefficient.
+ */
+long RaRangingArray::toDistance(long echo, unsigned int scaleQ16)
+{
+  return ((unsigned long)echo * scaleQ16 + 0x8000) >> 16;
+}
+
+/**
+ * @brief Calcule l'attente maximale d'un écho pour une portée donnée.
+ *
+ * @param maxRange la portée en millimètres.
+ * @return unsigned long la durée de l'écho correspondant, en microsecondes.
+ */
+unsigned long RaRangingArray::echoTimeout(unsigned int maxRange)
+{
+  return (((unsigned long)maxRange << 16) + RANGING_MM_Q16 - 1) / RANGING_MM_Q16;
+}
+
+/**
+ * @brief Définit l'intervalle minimal entre deux tirs d'un même capteur, par exemple pour espacer
+ * les mesures quand la voiture est à l'arrêt. Un intervalle plus court s'applique aussitôt,
+ * sans attendre les tirs déjà planifiés avec l'ancien.
+ *
+ * @param ms l'intervalle en millisecondes (RANGING_PERIOD par défaut).
+ * @param now le temps courant en millisecondes.
+ */
+void RaRangingArray::setPeriod(unsigned int ms, unsigned long now)
+{
+  period = ms;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if((long)(nextPing[i] - (now + ms)) > 0)
+    {
+      nextPing[i] = now + ms;
+    }
+  }
+}
+
+/**
+ * @brief Récupère le nombre de tirs depuis le démarrage (bloquants ou non), pour estimer
+ * la consommation des capteurs.
+ *
+ * @return unsigned long le nombre de tirs.
+ */
+unsigned long RaRangingArray::getPingCount()
+{
+  return pings;
+}
+
+/**
+ * @brief Récupère le nombre de capteurs.
+ *
+ * @return uint8_t le nombre de capteurs.
+ */
+uint8_t RaRangingArray::getCount()
+{
+  return count;
+}
+
+/**
+ * @brief Récupère la dernière mesure d'un capteur.
+ *
+ * @param index le numéro du capteur.
+ * @return const RaRangingReading& la mesure.
+ */
+const RaRangingReading& RaRangingArray::getReading(uint8_t index)
+{
+  return readings[index];
+}
+
+/**
+ * @brief Récupère l'âge de la dernière mesure d'un capteur.
+ *
+ * @param index le numéro du capteur.
+ * @param now le temps courant en millisecondes.
+ * @return unsigned long l'âge de la mesure en millisecondes.
+ */
+unsigned long RaRangingArray::getAge(uint8_t index, unsigned long now)
+{
+  return now - readings[index].time;
+}
+
+/**
+ * @brief Lit les broches d'un capteur dans la table en mémoire flash.
+ *
+ * @param index le numéro du capteur.
+ * @return RaRangingPins les broches.
+ */
+RaRangingPins RaRangingArray::getPins(uint8_t index)
+{
+  RaRangingPins sensor;
+
+  memcpy_P(&sensor, &pins[index], sizeof(RaRangingPins));
+  return sensor;
+}
+
+/**
+ * @brief Déclenche un capteur sans attendre l'écho : sa durée sera relevée par interruption.
+ *
+ * @param index le numéro du capteur.
+ */
+void RaRangingArray::fire(uint8_t index)
+{
+  RaRangingPins sensor = getPins(index);
+
+  armEcho(sensor.echo);
+  echoDone = false;
+  pings++;
+  hw.digitalWrite(sensor.trigger, LOW);
+  hw.delayMicroseconds(2);
+  hw.digitalWrite(sensor.trigger, HIGH);
+  hw.delayMicroseconds(10);
+  hw.digitalWrite(sensor.trigger, LOW);
+  pending = true;
+}
+
+/**
+ * @brief Branche le moteur de datation sur la broche ECHO d'un capteur, et seulement celle-ci.
+ *
+ * @param pin la broche ECHO.
+ */
+void RaRangingArray::armEcho(uint8_t pin)
+{
+  if(pin == echoPin)
+  {
+    return;
+  }
+
+  if(echoPin != NOT_A_PIN)
+  {
+    hw.detachChange(echoPin);
+  }
+
+  echoPin = pin;
+#if defined(__AVR__)
+  echoPort = portInputRegister(digitalPinToPort(pin));
+  echoMask = digitalPinToBitMask(pin);
+#endif
+
+  hw.attachChange(pin, onEchoEdge, this);
+}
+
+/**
+ * Interruption sur changement d'état de la broche ECHO du capteur qui vient de tirer :
+ * le front montant date l'émission, le front descendant donne la durée de l'écho.
+ *
+ * @param context le réseau de capteurs.
+ */
+void RaRangingArray::onEchoEdge(void* context)
+{
+  RaRangingArray* array = (RaRangingArray*)context;
+  unsigned long now = array->hw.micros();
+
+#if defined(__AVR__)
+  if(*array->echoPort & array->echoMask)
+#else
+  if(array->hw.digitalRead(array->echoPin))
+#endif
+  {
+    array->echoRise = now;
+  }
+  else
+  {
+    array->echoWidth = now - array->echoRise;
+    array->echoDone = true;
+  }
+}
@@ -0,0 +1,104 @@
+#ifndef RA_RANGING_ARRAY_H
+#define RA_RANGING_ARRAY_H
+
+#include <RaHardware.h>
+#include <RaSensorTrace.h>
+
+#define RANGING_MAX_SENSORS 4
+#define RANGING_ALL_SENSORS 0xFF // mask of the sensors update() may fire
+
+// Minimum time between two pings of the same sensor (ms)
+#define RANGING_PERIOD 25
+// Silence between two pings of the array, so that late echoes die out (ms)
+#define RANGING_GUARD_INTERVAL 10
+// Echo wait before a ping is given up (ms); an HC-SR04 without target answers after ~38 ms
+#define RANGING_ECHO_TIMEOUT 50
+
+#define RANGING_NO_READING -1
+
+// Default maximum range (mm): the HC-SR04 is specified up to 4 m
+#define RANGING_MAX_RANGE 4000
+
+// Echo duration (us) to distance, as 16.16 fixed-point multipliers: 29.1 us/cm, round trip
+#define RANGING_MM_Q16 11261         // 65536 / (2 * 2.91)
+#define RANGING_CM_Q16 1126          // 65536 / (2 * 29.1)
+#define RANGING_TENTH_INCH_Q16 4428  // 65536 / (2 * 7.4)
+
+/**
+ * Broches d'un capteur ultrason HC-SR04.
+ */
+struct RaRangingPins
+{
+  uint8_t trigger;
+  uint8_t echo;
+};
+
+/**
+ * Dernière mesure d'un capteur : durée de l'écho (µs, RANGING_NO_READING si aucune)
+ * et date de la mesure (ms).
+ */
+struct RaRangingReading
+{
+  long echo;
+  unsigned long time;
+};
+
+/**
+ * Réseau de capteurs ultrason HC-SR04 déclenchés à tour de rôle, jamais deux à la fois,
+ * avec un intervalle de garde entre deux tirs pour éviter qu'un capteur reçoive l'écho d'un autre.
+ *
+ * Un seul moteur de datation par interruption sert tous les capteurs du réseau : il n'écoute que la broche
+ * ECHO du capteur qui vient de tirer (interruption sur changement d'état, voir
+ * RaHardware::attachChange). La méthode update() ne bloque jamais ; les dernières mesures et leur date
+ * sont disponibles dans un tableau de taille fixe.
+ */
+class RaRangingArray
+{
+private:
+  RaHardware& hw;
+  const RaRangingPins* pins; // PROGMEM
+  uint8_t count;
+  RaRangingReading readings[RANGING_MAX_SENSORS];
+  unsigned long nextPing[RANGING_MAX_SENSORS];
+  unsigned int period;
+  unsigned long pings;
+
+  uint8_t current;
+  bool pending;
+  unsigned long pingTime;
+  unsigned long guardEnd;
+
+  // Echo timestamping, written by the interrupt handler
+  volatile unsigned long echoRise;
+  volatile unsigned long echoWidth;
+  volatile bool echoDone;
+  uint8_t echoPin;
+#if defined(__AVR__)
+  volatile uint8_t* echoPort;
+  uint8_t echoMask;
+#endif
+
+  RaRangingPins getPins(uint8_t index);
+  void fire(uint8_t index);
+  void armEcho(uint8_t pin);
+  static void onEchoEdge(void* context);
+
+public:
+  RaRangingArray(RaHardware& hardware, const RaRangingPins* progmemPins, uint8_t sensorCount);
+
+  void init();
+  int update(unsigned long now, RaSensorTrace& trace, uint8_t sensors = RANGING_ALL_SENSORS);
+  long measure(uint8_t index, unsigned long timeout);
+
+  static long toDistance(long echo, unsigned int scaleQ16);
+  static unsigned long echoTimeout(unsigned int maxRange);
+
+  void setPeriod(unsigned int ms, unsigned long now);
+  unsigned long getPingCount();
+
+  uint8_t getCount();
+  const RaRangingReading& getReading(uint8_t index);
+  unsigned long getAge(uint8_t index, unsigned long now);
+};
+
+#endif
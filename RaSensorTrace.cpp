@@ -0,0 +1,305 @@
+#include <RaSensorTrace.h>
+
+/**
+ * Constructeur de la classe RaSensorTrace. La trace est désactivée par défaut.
+ */
+RaSensorTrace::RaSensorTrace()
+{
+  mode = TRACE_OFF;
+  output = NULL;
+  input = NULL;
+  reset();
+}
+
+/**
+ * @brief Remet à zéro l'état des canaux.
+ */
+void RaSensorTrace::reset()
+{
+  for (uint8_t i = 0; i < TRACE_CHANNELS; i++)
+  {
+    skip[i] = 0;
+    last[i] = 0;
+  }
+  pending = false;
+}
+
+/**
+ * @brief Démarre l'enregistrement des entrées sur un flux (par exemple Serial).
+ * Le débit dépend de l'activité des capteurs : le canal horloge seul produit 2 octets par ms,
+ * prévoyez une liaison série d'au moins 57600 bauds et désactivez le debug.
+ *
+ * @param out le flux de sortie.
+ */
+void RaSensorTrace::startRecording(Print* out)
+{
+  reset();
+  output = out;
+  output->write(TRACE_MAGIC);
+  output->write(TRACE_VERSION);
+  mode = TRACE_RECORD;
+}
+
+/**
+ * @brief Démarre le rejeu d'une trace lue sur un flux.
+ *
+ * @param in le flux d'entrée.
+ * @return bool false si le flux ne commence pas par un en-tête de trace valide.
+ */
+bool RaSensorTrace::startReplay(Stream* in)
+{
+  uint8_t magic;
+  uint8_t version;
+
+  reset();
+  input = in;
+  if (!readByte(&magic) || !readByte(&version) || magic != TRACE_MAGIC || version != TRACE_VERSION)
+  {
+    mode = TRACE_OFF;
+    return false;
+  }
+
+  mode = TRACE_REPLAY;
+  pending = readRecord();
+  return true;
+}
+
+/**
+ * @brief Arrête l'enregistrement ou le rejeu : les entrées sont de nouveau lues sur le matériel.
+ */
+void RaSensorTrace::stop()
+{
+  mode = TRACE_OFF;
+}
+
+/**
+ * @brief Récupère le mode de la trace.
+ *
+ * @return uint8_t TRACE_OFF, TRACE_RECORD ou TRACE_REPLAY.
+ */
+uint8_t RaSensorTrace::getMode()
+{
+  return mode;
+}
+
+/**
+ * @brief Indique si les entrées proviennent d'une trace.
+ * Dans ce cas, le matériel ne doit pas être lu pour les canaux d'événements.
+ *
+ * @return bool true = rejeu en cours.
+ */
+bool RaSensorTrace::isReplaying()
+{
+  return mode == TRACE_REPLAY;
+}
+
+/**
+ * @brief Indique si le rejeu a consommé toute la trace.
+ *
+ * @return bool true = plus aucun enregistrement à rejouer.
+ */
+bool RaSensorTrace::isReplayDone()
+{
+  return mode == TRACE_REPLAY && !pending;
+}
+
+/**
+ * @brief Passe la lecture d'une entrée qui garde sa valeur (broche, horloge, distance).
+ *
+ * @param channel le canal (TRACE_CH_*).
+ * @param value la valeur lue sur le matériel (ignorée en rejeu).
+ * @return long la valeur à utiliser.
+ */
+long RaSensorTrace::level(uint8_t channel, long value)
+{
+  if (mode == TRACE_RECORD)
+  {
+    if (value != last[channel])
+    {
+      writeRecord(channel, value);
+    }
+    else
+    {
+      skip[channel]++;
+    }
+    return value;
+  }
+
+  if (mode == TRACE_REPLAY)
+  {
+    if (pending && pendingChannel == channel && pendingSkip == skip[channel])
+    {
+      last[channel] = pendingValue;
+      skip[channel] = 0;
+      pending = readRecord();
+    }
+    else
+    {
+      skip[channel]++;
+    }
+    return last[channel];
+  }
+
+  return value;
+}
+
+/**
+ * @brief Passe la lecture d'une entrée événementielle (écho, touche infrarouge, octet série).
+ *
+ * @param channel le canal (TRACE_CH_*).
+ * @param value la valeur reçue, -1 si rien n'a été reçu (ignorée en rejeu).
+ * @return long la valeur à utiliser, -1 si rien n'a été reçu.
+ */
+long RaSensorTrace::event(uint8_t channel, long value)
+{
+  if (mode == TRACE_RECORD)
+  {
+    if (value >= 0)
+    {
+      writeRecord(channel, value);
+    }
+    else
+    {
+      skip[channel]++;
+    }
+    return value;
+  }
+
+  if (mode == TRACE_REPLAY)
+  {
+    if (pending && pendingChannel == channel && pendingSkip == skip[channel])
+    {
+      value = pendingValue;
+      last[channel] = value;
+      skip[channel] = 0;
+      pending = readRecord();
+      return value;
+    }
+    skip[channel]++;
+    return -1;
+  }
+
+  return value;
+}
+
+/**
+ * @brief Écrit un enregistrement et remet à zéro le compteur de lectures du canal.
+ * Les canaux de suivi de ligne sont binaires : un changement suffit, sans valeur.
+ *
+ * @param channel le canal.
+ * @param value la nouvelle valeur.
+ */
+void RaSensorTrace::writeRecord(uint8_t channel, long value)
+{
+  unsigned long count = skip[channel];
+  long delta = value - last[channel];
+
+  if (count < 31)
+  {
+    output->write((uint8_t)((channel << 5) | count));
+  }
+  else
+  {
+    output->write((uint8_t)((channel << 5) | 31));
+    writeVarint(count);
+  }
+
+  if (channel > TRACE_CH_TRACK_RIGHT)
+  {
+    // Zigzag: small negative deltas stay small
+    writeVarint(((unsigned long)delta << 1) ^ (delta < 0 ? ~0UL : 0UL));
+  }
+
+  last[channel] = value;
+  skip[channel] = 0;
+}
+
+/**
+ * @brief Écrit un entier non signé sur 7 bits par octet, le bit de poids fort indiquant la suite.
+ *
+ * @param value l'entier.
+ */
+void RaSensorTrace::writeVarint(unsigned long value)
+{
+  while (value >= 0x80)
+  {
+    output->write((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  output->write((uint8_t)value);
+}
+
+/**
+ * @brief Lit l'enregistrement suivant de la trace dans pendingChannel, pendingSkip et pendingValue.
+ *
+ * @return bool false si la trace est terminée.
+ */
+bool RaSensorTrace::readRecord()
+{
+  uint8_t header;
+  unsigned long value;
+
+  if (!readByte(&header))
+  {
+    return false;
+  }
+
+  pendingChannel = header >> 5;
+  pendingSkip = header & 31;
+  if (pendingSkip == 31)
+  {
+    if (!readVarint(&value))
+    {
+      return false;
+    }
+    pendingSkip = value;
+  }
+
+  if (pendingChannel <= TRACE_CH_TRACK_RIGHT)
+  {
+    pendingValue = !last[pendingChannel];
+    return true;
+  }
+
+  if (!readVarint(&value))
+  {
+    return false;
+  }
+  pendingValue = last[pendingChannel] + (long)((value >> 1) ^ (0UL - (value & 1)));
+  return true;
+}
+
+/**
+ * @brief Lit un octet du flux, en attendant au plus le délai du flux (setTimeout).
+ *
+ * @param value l'octet lu.
+ * @return bool false si rien n'a été reçu à temps.
+ */
+bool RaSensorTrace::readByte(uint8_t* value)
+{
+  return input->readBytes((char*)value, 1) == 1;
+}
+
+/**
+ * @brief Lit un entier écrit par writeVarint.
+ *
+ * @param value l'entier lu.
+ * @return bool false si le flux est terminé.
+ */
+bool RaSensorTrace::readVarint(unsigned long* value)
+{
+  uint8_t b;
+  uint8_t shift = 0;
+
+  *value = 0;
+  do
+  {
+    if (!readByte(&b))
+    {
+      return false;
+    }
+    *value |= (unsigned long)(b & 0x7F) << shift;
+    shift += 7;
+  } while (b & 0x80);
+  return true;
+}
@@ -0,0 +1,73 @@
+#ifndef RA_SENSOR_TRACE_H
+#define RA_SENSOR_TRACE_H
+
+#include <Arduino.h>
+
+// Trace modes
+#define TRACE_OFF 0
+#define TRACE_RECORD 1
+#define TRACE_REPLAY 2
+
+// Trace channels: level channels hold a value until it changes,
+// event channels only carry a value when something was received.
+#define TRACE_CH_TRACK_LEFT 0   // level, 0/1
+#define TRACE_CH_TRACK_MIDDLE 1 // level, 0/1
+#define TRACE_CH_TRACK_RIGHT 2  // level, 0/1
+#define TRACE_CH_CLOCK 3        // level, ms
+#define TRACE_CH_DISTANCE 4     // level, cm
+#define TRACE_CH_ECHO 5         // event, us
+#define TRACE_CH_IR 6           // event, IR_KEY_*
+#define TRACE_CH_SERIAL 7       // event, byte
+#define TRACE_CHANNELS 8
+
+// Stream header
+#define TRACE_MAGIC 0xA5
+#define TRACE_VERSION 1
+
+/**
+ * Enregistrement et rejeu des entrées brutes de la Smart Car.
+ *
+ * Chaque lecture d'une entrée passe par level() ou event(). En enregistrement, seul un changement
+ * (ou un événement) produit un enregistrement : un octet d'en-tête (canal sur 3 bits, nombre de
+ * lectures sans changement sur 5 bits), suivi si besoin de ce nombre puis de l'écart avec la valeur
+ * précédente du canal, en entiers de longueur variable. Le canal horloge sert d'horodatage.
+ * En rejeu, les mêmes appels renvoient les valeurs enregistrées, lecture pour lecture :
+ * le code qui lit les entrées produit alors exactement les mêmes sorties.
+ */
+class RaSensorTrace
+{
+private:
+  uint8_t mode;
+  Print* output;
+  Stream* input;
+  unsigned long skip[TRACE_CHANNELS];
+  long last[TRACE_CHANNELS];
+
+  // Replay lookahead
+  bool pending;
+  uint8_t pendingChannel;
+  unsigned long pendingSkip;
+  long pendingValue;
+
+  void reset();
+  void writeRecord(uint8_t channel, long value);
+  void writeVarint(unsigned long value);
+  bool readRecord();
+  bool readByte(uint8_t* value);
+  bool readVarint(unsigned long* value);
+
+public:
+  RaSensorTrace();
+
+  void startRecording(Print* out);
+  bool startReplay(Stream* in);
+  void stop();
+  uint8_t getMode();
+  bool isReplaying();
+  bool isReplayDone();
+
+  long level(uint8_t channel, long value);
+  long event(uint8_t channel, long value);
+};
+
+#endif
@@ -1,19 +1,140 @@
 #include <RaSmartCar4WD.h>
 
+#if RA_USE_RANGING
+// HC-SR04 array
+static const RaRangingPins rangingPins[] PROGMEM = {RANGING_SENSOR_PINS};
+#endif
+
+// Control gains
+static const RaControlGains defaultGains PROGMEM = GAINS_DEFAULT;
+
+/**
+ * Niveaux de luminosité, du plus sobre au plus lumineux : luminosité de la matrice (0-7)
+ * et rapport cyclique maximal de la LED d'état (0-255).
+ */
+struct BrightnessLevel
+{
+  uint8_t matrix;
+  uint8_t led;
+};
+
+static const BrightnessLevel brightnessLevels[BRIGHTNESS_LEVELS] PROGMEM = {
+  {0, 8},
+  {1, 32},
+  {2, 96},
+  {4, 160},
+  {7, 255}
+};
+
+#if RA_USE_MATRIX
+// AiP1640 pulse width of each matrix brightness, in 1/16
+static const uint8_t matrixDuty[8] PROGMEM = {1, 2, 4, 10, 11, 12, 13, 14};
+#endif
+static_assert(sizeof(RaControlGains) == 14, "RaControlGains must have the same layout on the board and on the host");
+
 /**
  * Constructeur de la classe RaSmartCar4WD.
  * 
  * @see https://robotisames.com/robots/41-kit-robot-voiture-4wd-multi-bt-v2-pour-arduino.html
  */
 RaSmartCar4WD::RaSmartCar4WD()
+#if RA_USE_RANGING
+  : ranging(hw, rangingPins, sizeof(rangingPins) / sizeof(rangingPins[0]))
+#endif
 {
+#if RA_USE_DEBUG
   debug = false;
-  rcHandler = new RaKsRemoteControl(PIN_IR_RECEIVER);
-  ledMatrix = new LedMatrixAiP1640(PIN_MATRIX_CLOCK, PIN_MATRIX_DATA);
-  distSensor = new SR04(PIN_ECHO, PIN_TRIGGER);
+#endif
+#if RA_USE_IR
+  rcHandler = hw.createRemote(PIN_IR_RECEIVER);
+#endif
+#if RA_USE_MATRIX
+  ledMatrix = hw.createMatrix(PIN_MATRIX_CLOCK, PIN_MATRIX_DATA);
   showSymbols = true;
+  matrixLit = 0;
+#endif
+#if RA_USE_SERVO
+  servoAngle = 90;
+#endif
+#if RA_USE_RANGING
+  lastDistance = 0;
+  lastDistanceTime = 0;
+#endif
+  btMode = BT_MODE_NONE;
+  modeLastUpdate = 0;
+  world.leftTrack = 0;
+  world.middleTrack = 0;
+  world.rightTrack = 0;
+  world.trackTime = 0;
+  world.distance = -1;
+  world.distanceTime = 0 - FUSION_DEADLINE_RANGING; // never measured: stale
+  world.irKey = IR_KEY_NONE;
+  world.irTime = 0;
+  traceOnSerial = false;
+  profiling = false;
+  resetStats();
+  resetGains();
+  motorDirection = 0;
+  motorLeftSpeed = 0;
+  motorRightSpeed = 0;
+  linkTimeout = 0;
+  lastCommand[LINK_BT] = 0;
+  lastCommand[LINK_IR] = 0;
+  failsafeReason = FAILSAFE_NONE;
+  tripCount = 0;
+  failsafeRamping = false;
+  failsafeRampStart = 0;
+  failsafeLeftSpeed = 0;
+  failsafeRightSpeed = 0;
+  watchdogEnabled = false;
+  brightness = BRIGHTNESS_DEFAULT;
+  powerSave = false;
+  powerIdle = false;
+  lastMotion = 0;
+  energyTime = 0;
+  sleptMicros = 0;
+#if RA_USE_RANGING
+  energyPings = 0;
+#endif
 }
 
+/**
+ * Table des modes de la voiture, indexée par les constantes BT_MODE_*.
+ * Chaque mode définit une méthode d'entrée, de mise à jour et de sortie (NULL = rien à faire),
+ * la période minimale (en ms) entre deux mises à jour et les capteurs (SENSOR_*) dont il lit
+ * l'instantané fusionné. Un mode dont un sous-système est exclu (voir RaConfig.h) ne fait rien.
+ */
+const RaSmartCar4WD::ModeEntry RaSmartCar4WD::modeTable[BT_MODE_COUNT] PROGMEM = {
+  // BT_MODE_NONE
+  {NULL, NULL, NULL, 0, 0},
+  // BT_MODE_RUN
+  {NULL, NULL, &RaSmartCar4WD::exitMovingMode, 0, 0},
+  // BT_MODE_ANTI_DROP
+  {&RaSmartCar4WD::stop, NULL, NULL, 0, 0},
+  // BT_MODE_LINE_TRACKING
+  {NULL, &RaSmartCar4WD::enableLineTracking, &RaSmartCar4WD::exitMovingMode, MODE_PERIOD_LINE_TRACKING, 0},
+  // BT_MODE_AVOID
+#if RA_USE_SERVO && RA_USE_RANGING
+  {&RaSmartCar4WD::enterAvoidMode, &RaSmartCar4WD::enableAvoidObstacles, &RaSmartCar4WD::exitAvoidMode, MODE_PERIOD_RANGING, 0},
+#else
+  {NULL, NULL, NULL, 0, 0},
+#endif
+  // BT_MODE_FOLLOWING
+#if RA_USE_RANGING
+  {NULL, &RaSmartCar4WD::enableFollowMovingObjects, &RaSmartCar4WD::exitMovingMode, MODE_PERIOD_RANGING, 0},
+#else
+  {NULL, NULL, NULL, 0, 0},
+#endif
+  // BT_MODE_REMOTE
+#if RA_USE_IR
+  {NULL, &RaSmartCar4WD::updateRemoteMode, &RaSmartCar4WD::exitMovingMode, MODE_PERIOD_REMOTE, 0},
+#else
+  {NULL, NULL, NULL, 0, 0},
+#endif
+  // BT_MODE_LINE_GUARDED
+  {NULL, &RaSmartCar4WD::updateGuardedLineMode, &RaSmartCar4WD::exitMovingMode, MODE_PERIOD_LINE_TRACKING, SENSOR_TRACKING | SENSOR_RANGING | SENSOR_IR}
+};
+
 /**
  * @brief l'objet de gestion de la Smart Car.
  * A noter que par défaut :
@@ -25,50 +146,96 @@ RaSmartCar4WD::RaSmartCar4WD()
  */
 void RaSmartCar4WD::init()
 {
-  pinMode(PIN_LED, OUTPUT);
+  // A watchdog reset leaves the watchdog running: disable it before anything slow
+  if(hw.takeWatchdogReset())
+  {
+    recordTrip(FAILSAFE_WATCHDOG, 0);
+  }
+
+  hw.pinMode(PIN_LED, OUTPUT);
 
+#if RA_USE_SERVO
   // Servomotor
-  pinMode(PIN_SERVO, OUTPUT);
+  hw.pinMode(PIN_SERVO, OUTPUT);
+#endif
 
   // Tracking sensor
-  pinMode(PIN_TRACKING_LEFT, INPUT);
-  pinMode(PIN_TRACKING_MIDDLE, INPUT);
-  pinMode(PIN_TRACKING_RIGHT, INPUT);
+  hw.pinMode(PIN_TRACKING_LEFT, INPUT);
+  hw.pinMode(PIN_TRACKING_MIDDLE, INPUT);
+  hw.pinMode(PIN_TRACKING_RIGHT, INPUT);
 
-  // Ultrasonic sensor
-  pinMode(PIN_TRIGGER, OUTPUT);
-  pinMode(PIN_ECHO, INPUT);
+#if RA_USE_RANGING
+  // Ultrasonic sensors
+  ranging.init();
+#endif
 
   // Motors
-  pinMode(PIN_MOTOR_L_CTRL, OUTPUT);
-  pinMode(PIN_MOTOR_L_PWM, OUTPUT);
-  pinMode(PIN_MOTOR_R_CTRL, OUTPUT);
-  pinMode(PIN_MOTOR_R_PWM, OUTPUT);
+  hw.pinMode(PIN_MOTOR_L_CTRL, OUTPUT);
+  hw.pinMode(PIN_MOTOR_L_PWM, OUTPUT);
+  hw.pinMode(PIN_MOTOR_R_CTRL, OUTPUT);
+  hw.pinMode(PIN_MOTOR_R_PWM, OUTPUT);
 
+#if RA_USE_MATRIX
   // LED Matrix
-  pinMode(PIN_MATRIX_CLOCK, OUTPUT);
-  pinMode(PIN_MATRIX_DATA, OUTPUT);
+  hw.pinMode(PIN_MATRIX_CLOCK, OUTPUT);
+  hw.pinMode(PIN_MATRIX_DATA, OUTPUT);
+#endif
+
+  trackingNext = hw.millis();
+
+  // Status LED: on AVR, Timer 1 is taken by the Servo library and its pins lose analogWrite
+  statusLed.begin(hw, PIN_LED, hw.hasPwm(PIN_LED));
 
-  servoHead.attach(PIN_SERVO);
   setSpeed(0);
-  distanceUnit = DIST_UNIT_CM;
-  Serial.begin(9600);
+#if RA_USE_RANGING
+  setDistanceUnit(DIST_UNIT_CM);
+  setMaxDistance(RANGING_MAX_RANGE);
+#endif
+#if RA_USE_BLUETOOTH || RA_USE_DEBUG
+  hw.beginSerial(SERIAL_BAUD);
+#endif
+#if RA_USE_IR
   rcHandler->init();
+#endif
+#if RA_USE_MATRIX
   ledMatrix->init();
+#endif
+  applyBrightness(brightness);
+#if RA_USE_SERVO
+  servoHead.attach(PIN_SERVO);
   setServoAngle(90);
+#endif
 }
 
 /**
- * @brief Active/désactive le mode debug.
+ * @brief Récupère la couche matérielle de la voiture (broches, horloge, périphériques),
+ * par exemple pour piloter une voiture simulée (RA_HOST).
+ * 
+ * @return RaHardware& la couche matérielle.
+ */
+RaHardware& RaSmartCar4WD::getHardware()
+{
+  return hw;
+}
+
+/**
+ * @brief Active/désactive le mode debug (sans effet si RA_USE_DEBUG vaut 0).
  * 
  * @param dbg true = active.
  */
 void RaSmartCar4WD::setDebug(bool dbg)
 {
+#if RA_USE_DEBUG
   debug = dbg;
+#if RA_USE_IR
   rcHandler->setDebug(debug);
+#endif
+#else
+  (void)dbg;
+#endif
 }
 
+#if RA_USE_SERVO
 /**
  * @brief Définit l'angle (entre 0 et 180°) du servomoteur de la tête de la voiture. 
  * Cette méthode utilise de façon explicite la Modulation de Largeur d'Impulsions (MLI, PWM en Anglais).
@@ -79,11 +246,11 @@ void RaSmartCar4WD::setDebug(bool dbg)
 void RaSmartCar4WD::setServoAnglePWM(int iAngle)
 {
   int pulsewidth = iAngle * 11 + 500; // calculate the value of pulse width
-  digitalWrite(PIN_SERVO, HIGH);
-  delayMicroseconds(pulsewidth);
+  hw.digitalWrite(PIN_SERVO, HIGH);
+  hw.delayMicroseconds(pulsewidth);
   // The duration of high level is pulse width
-  digitalWrite(PIN_SERVO, LOW);
-  delay(20 - pulsewidth / 1000); // the cycle is 20ms, the low level last for the rest of time
+  hw.digitalWrite(PIN_SERVO, LOW);
+  hw.delay(20 - pulsewidth / 1000); // the cycle is 20ms, the low level last for the rest of time
 }
 
 /**
@@ -93,8 +260,41 @@ void RaSmartCar4WD::setServoAnglePWM(int iAngle)
  */
 void RaSmartCar4WD::setServoAngle(int iAngle)
 {
+  if(!servoHead.attached())
+  {
+    // Detached while the car was idle
+    servoHead.attach(PIN_SERVO);
+  }
   servoHead.write(iAngle);
+#if RA_USE_RANGING
+  if(iAngle != servoAngle)
+  {
+    // The distance kept while idle was measured in another direction
+    lastDistanceTime = clockMillis() - POWER_IDLE_RANGING_PERIOD;
+  }
+#endif
+  servoAngle = iAngle;
+}
+
+/**
+ * @brief Fixe l'angle du servomoteur à 90°, 
+ * de sorte à fixer la tête de la voiture correctement et définitivement.
+ */
+void RaSmartCar4WD::calibrateServo()
+{
+  setServoAnglePWM(90);
+}
+
+/**
+ * @brief Récupère le dernier angle demandé au servomoteur de la tête par setServoAngle.
+ * 
+ * @return int l'angle, entre 0 et 180°.
+ */
+int RaSmartCar4WD::getServoAngle()
+{
+  return servoAngle;
 }
+#endif
 
 /**
  * @brief Définit la vitesse (entre 0 et 255) des moteurs à courant continu de la voiture.
@@ -121,15 +321,14 @@ void RaSmartCar4WD::setSpeed(int iSpeed)
  */
 void RaSmartCar4WD::goForward()
 {
+#if RA_USE_MATRIX
   if(showSymbols)
   {
     displayForward();
   }
+#endif
 
-  digitalWrite(PIN_MOTOR_L_CTRL, HIGH);
-  analogWrite(PIN_MOTOR_L_PWM, speed);
-  digitalWrite(PIN_MOTOR_R_CTRL, HIGH);
-  analogWrite(PIN_MOTOR_R_PWM, speed);
+  drive(HIGH, speed, HIGH, speed);
 }
 
 /**
@@ -142,15 +341,14 @@ void RaSmartCar4WD::goForward()
  */
 void RaSmartCar4WD::goForward(int iSpeed)
 {
+#if RA_USE_MATRIX
   if(showSymbols)
   {
     displayForward();
   }
+#endif
 
-  digitalWrite(PIN_MOTOR_L_CTRL, HIGH);
-  analogWrite(PIN_MOTOR_L_PWM, iSpeed);
-  digitalWrite(PIN_MOTOR_R_CTRL, HIGH);
-  analogWrite(PIN_MOTOR_R_PWM, iSpeed);
+  drive(HIGH, iSpeed, HIGH, iSpeed);
 }
 
 /**
@@ -162,15 +360,14 @@ void RaSmartCar4WD::goForward(int iSpeed)
  */
 void RaSmartCar4WD::goBackward()
 {
+#if RA_USE_MATRIX
   if(showSymbols)
   {
     displayBackward();
   }
+#endif
 
-  digitalWrite(PIN_MOTOR_L_CTRL, LOW);
-  analogWrite(PIN_MOTOR_L_PWM, speed);
-  digitalWrite(PIN_MOTOR_R_CTRL, LOW);
-  analogWrite(PIN_MOTOR_R_PWM, speed);
+  drive(LOW, speed, LOW, speed);
 }
 
 /**
@@ -183,15 +380,14 @@ void RaSmartCar4WD::goBackward()
  */
 void RaSmartCar4WD::goBackward(int iSpeed)
 {
+#if RA_USE_MATRIX
   if(showSymbols)
   {
     displayBackward();
   }
+#endif
 
-  digitalWrite(PIN_MOTOR_L_CTRL, LOW);
-  analogWrite(PIN_MOTOR_L_PWM, iSpeed);
-  digitalWrite(PIN_MOTOR_R_CTRL, LOW);
-  analogWrite(PIN_MOTOR_R_PWM, iSpeed);
+  drive(LOW, iSpeed, LOW, iSpeed);
 }
 
 /**
@@ -203,15 +399,14 @@ void RaSmartCar4WD::goBackward(int iSpeed)
  */
 void RaSmartCar4WD::turnLeft()
 {
+#if RA_USE_MATRIX
   if(showSymbols)
   {
     displayLeft();
   }
+#endif
 
-  digitalWrite(PIN_MOTOR_L_CTRL, LOW);
-  analogWrite(PIN_MOTOR_L_PWM, speed);
-  digitalWrite(PIN_MOTOR_R_CTRL, HIGH);
-  analogWrite(PIN_MOTOR_R_PWM, speed);
+  drive(LOW, speed, HIGH, speed);
 }
 
 /**
@@ -224,15 +419,14 @@ void RaSmartCar4WD::turnLeft()
  */
 void RaSmartCar4WD::turnLeft(int iSpeed)
 {
+#if RA_USE_MATRIX
   if(showSymbols)
   {
     displayLeft();
   }
+#endif
 
-  digitalWrite(PIN_MOTOR_L_CTRL, LOW);
-  analogWrite(PIN_MOTOR_L_PWM, iSpeed);
-  digitalWrite(PIN_MOTOR_R_CTRL, HIGH);
-  analogWrite(PIN_MOTOR_R_PWM, iSpeed);
+  drive(LOW, iSpeed, HIGH, iSpeed);
 }
 
 /**
@@ -244,15 +438,14 @@ void RaSmartCar4WD::turnLeft(int iSpeed)
  */
 void RaSmartCar4WD::turnRight()
 {
+#if RA_USE_MATRIX
   if(showSymbols)
   {
     displayRight();
   }
+#endif
 
-  digitalWrite(PIN_MOTOR_L_CTRL, HIGH);
-  analogWrite(PIN_MOTOR_L_PWM, speed);
-  digitalWrite(PIN_MOTOR_R_CTRL, LOW);
-  analogWrite(PIN_MOTOR_R_PWM, speed);
+  drive(HIGH, speed, LOW, speed);
 }
 
 /**
@@ -265,15 +458,14 @@ void RaSmartCar4WD::turnRight()
  */
 void RaSmartCar4WD::turnRight(int iSpeed)
 {
+#if RA_USE_MATRIX
   if(showSymbols)
   {
     displayRight();
   }
+#endif
 
-  digitalWrite(PIN_MOTOR_L_CTRL, HIGH);
-  analogWrite(PIN_MOTOR_L_PWM, iSpeed);
-  digitalWrite(PIN_MOTOR_R_CTRL, LOW);
-  analogWrite(PIN_MOTOR_R_PWM, iSpeed);
+  drive(HIGH, iSpeed, LOW, iSpeed);
 }
 
 /**
@@ -284,24 +476,39 @@ void RaSmartCar4WD::turnRight(int iSpeed)
  */
 void RaSmartCar4WD::stop()
 {
+#if RA_USE_MATRIX
   if(showSymbols)
   {
     displayStop();
   }
+#endif
 
-  digitalWrite(PIN_MOTOR_L_CTRL, LOW);
-  analogWrite(PIN_MOTOR_L_PWM, 0);
-  digitalWrite(PIN_MOTOR_R_CTRL, LOW);
-  analogWrite(PIN_MOTOR_R_PWM, 0);
+  drive(LOW, 0, LOW, 0);
 }
 
 /**
- * @brief Fixe l'angle du servomoteur à 90°, 
- * de sorte à fixer la tête de la voiture correctement et définitivement.
+ * @brief Commande les deux moteurs et mémorise la commande (sens et vitesse de chaque côté).
+ * 
+ * @param leftDirection le sens du moteur gauche (HIGH = en avant).
+ * @param leftSpeed la vitesse du moteur gauche (0 à 255).
+ * @param rightDirection le sens du moteur droit (HIGH = en avant).
+ * @param rightSpeed la vitesse du moteur droit (0 à 255).
  */
-void RaSmartCar4WD::calibrateServo()
+void RaSmartCar4WD::drive(uint8_t leftDirection, int leftSpeed, uint8_t rightDirection, int rightSpeed)
 {
-  setServoAnglePWM(90);
+#if RA_USE_GRID
+  // Close the odometry segment driven at the previous command
+  grid.move(clockMillis(), leftDirection ? leftSpeed : -leftSpeed, rightDirection ? rightSpeed : -rightSpeed);
+#endif
+
+  hw.digitalWrite(PIN_MOTOR_L_CTRL, leftDirection);
+  hw.analogWrite(PIN_MOTOR_L_PWM, leftSpeed);
+  hw.digitalWrite(PIN_MOTOR_R_CTRL, rightDirection);
+  hw.analogWrite(PIN_MOTOR_R_PWM, rightSpeed);
+
+  motorDirection = (leftDirection ? MOTOR_LEFT_FORWARD : 0) | (rightDirection ? MOTOR_RIGHT_FORWARD : 0);
+  motorLeftSpeed = leftSpeed;
+  motorRightSpeed = rightSpeed;
 }
 
 /**
@@ -312,11 +519,13 @@ void RaSmartCar4WD::calibrateServo()
  */
 void RaSmartCar4WD::switchLed(bool status)
 {
-  digitalWrite(PIN_LED, status);
+  hw.digitalWrite(PIN_LED, status);
 }
 
 /**
  * @brief Fait clignoter la LED de test.
+ * Cette méthode bloque pendant deux périodes : pour un voyant qui ne ralentit pas la voiture,
+ * utilisez plutôt la méthode setLedStatus.
  * 
  * @param iDelay temps en millisecondes de la période de clignotement.
  */
@@ -325,20 +534,22 @@ void RaSmartCar4WD::blinkLed(int iDelay)
   switchLed(true);
   if (debug)
   {
-    Serial.println("LED switched ON");
+    hw.serial().println("LED switched ON");
   }
-  delay(iDelay);
+  hw.delay(iDelay);
 
   switchLed(false);
   if (debug)
   {
-    Serial.println("LED switched OFF");
+    hw.serial().println("LED switched OFF");
   }
-  delay(iDelay);
+  hw.delay(iDelay);
 }
 
 /**
  * @brief Fait clignoter la LED de test en faisant varier son éclairage progressivement.
+ * Cette méthode bloque pendant environ 2,5 s : pour un voyant qui ne ralentit pas la voiture,
+ * utilisez plutôt la méthode setLedStatus avec LED_STATUS_READY.
  */
 void RaSmartCar4WD::breathLed()
 {
@@ -346,16 +557,43 @@ void RaSmartCar4WD::breathLed()
 
   for (i = 0; i < 255; i++)
   {
-    analogWrite(PIN_LED, i);
-    delay(5);
+    hw.analogWrite(PIN_LED, i);
+    hw.delay(5);
   }
   for (i = 255; i > 0; i--)
   {
-    analogWrite(PIN_LED, i);
-    delay(5);
+    hw.analogWrite(PIN_LED, i);
+    hw.delay(5);
   }
 }
 
+/**
+ * @brief Affiche un état sur la LED de test, sans bloquer : chaque état a son motif
+ * (LED_STATUS_READY = respiration, LED_STATUS_LOW_BATTERY = 3 impulsions, LED_STATUS_LINK_LOST
+ * = clignotement...). Le motif avance à chaque appel de la méthode update ; à chaque changement
+ * de mode, la LED émet deux impulsions puis revient à l'état choisi.
+ * 
+ * @see La méthode update.
+ * 
+ * @param status l'état (constantes LED_STATUS_*). LED_STATUS_OFF rend la main aux méthodes
+ * switchLed, blinkLed et breathLed.
+ */
+void RaSmartCar4WD::setLedStatus(uint8_t status)
+{
+  statusLed.setStatus(status);
+}
+
+/**
+ * @brief Récupère l'état affiché par la LED de test, événement en cours compris
+ * (LED_STATUS_LINK_LOST après une perte de liaison...).
+ * 
+ * @return uint8_t l'état (constantes LED_STATUS_*).
+ */
+uint8_t RaSmartCar4WD::getLedStatus()
+{
+  return statusLed.getStatus();
+}
+
 /**
  * @brief Récupère la valeur du capteur de gauche de suivi de ligne.
  * 
@@ -363,7 +601,7 @@ void RaSmartCar4WD::breathLed()
  */
 int RaSmartCar4WD::getLeftTrack()
 {
-  return digitalRead(PIN_TRACKING_LEFT);
+  return trace.level(TRACE_CH_TRACK_LEFT, hw.digitalRead(PIN_TRACKING_LEFT));
 }
 
 /**
@@ -373,7 +611,7 @@ int RaSmartCar4WD::getLeftTrack()
  */
 int RaSmartCar4WD::getMiddleTrack()
 {
-  return digitalRead(PIN_TRACKING_MIDDLE);
+  return trace.level(TRACE_CH_TRACK_MIDDLE, hw.digitalRead(PIN_TRACKING_MIDDLE));
 }
 
 /**
@@ -383,9 +621,10 @@ int RaSmartCar4WD::getMiddleTrack()
  */
 int RaSmartCar4WD::getRightTrack()
 {
-  return digitalRead(PIN_TRACKING_RIGHT);
+  return trace.level(TRACE_CH_TRACK_RIGHT, hw.digitalRead(PIN_TRACKING_RIGHT));
 }
 
+#if RA_USE_DEBUG
 /**
  * @brief Affiche l'état des 3 capteurs de suivi de ligne dans la console (moniteur).
  */
@@ -395,23 +634,25 @@ void RaSmartCar4WD::checkTrack()
   int midTrack = getMiddleTrack();
   int rightTrack = getRightTrack();
 
-  Serial.print("left:");
-  Serial.print(leftTrack);
+  hw.serial().print("left:");
+  hw.serial().print(leftTrack);
 
-  Serial.print(" middle:");
-  Serial.print(midTrack);
+  hw.serial().print(" middle:");
+  hw.serial().print(midTrack);
 
-  Serial.print(" right:");
-  Serial.println(rightTrack);
+  hw.serial().print(" right:");
+  hw.serial().println(rightTrack);
 
-  delay(500); // delay in between reads for stability
+  hw.delay(500); // delay in between reads for stability
 }
+#endif
 
+#if RA_USE_RANGING
 /**
  * @brief Définit l'unité de mesure utilisée pour la distance détectée par le capteur ultrason.
- * Cette distance est donnée par la méthode getDistance.
+ * Cette distance est donnée par les méthodes getDistance et getDistanceTenths.
  * 
- * @see La méthode getDistance.
+ * @see Les méthodes getDistance et getDistanceTenths.
  * 
  * @param unit l'unité de mesure de la distance. Utilisez les constantes suivantes :
  *  - DIST_UNIT_CM : le centimètre,
@@ -420,44 +661,69 @@ void RaSmartCar4WD::checkTrack()
 void RaSmartCar4WD::setDistanceUnit(int unit)
 {
   distanceUnit = unit;
+  distanceScale = unit == DIST_UNIT_INCH ? RANGING_TENTH_INCH_Q16 : RANGING_MM_Q16;
 }
 
 /**
- * @brief Récupère la distance détectée par le capteur ultrason. 
- * L'unité de la valeur de retour peut être définie par la méthode setDistanceUnit.
+ * @brief Définit la portée maximale du capteur ultrason : au-delà, aucun écho n'est attendu.
+ * L'attente d'une mesure est ainsi bornée (environ 5,8 µs par mm, 23 ms pour 4 m).
+ * 
+ * @param mm la portée en millimètres (RANGING_MAX_RANGE par défaut).
+ */
+void RaSmartCar4WD::setMaxDistance(unsigned int mm)
+{
+  maxDistance = mm;
+  distanceTimeout = RaRangingArray::echoTimeout(mm);
+}
+
+/**
+ * @brief Récupère la distance détectée par le capteur ultrason, en dixièmes de l'unité choisie
+ * par la méthode setDistanceUnit : des millimètres (DIST_UNIT_CM) ou des dixièmes de pouce
+ * (DIST_UNIT_INCH). Le calcul est entier (pas de flottant) et l'attente de l'écho est bornée
+ * par la portée maximale.
  * 
- * @see La méthode setDistanceUnit.
+ * @see Les méthodes setDistanceUnit et setMaxDistance.
  * 
- * @return float La distance. L'unité par défaut est le centimètre. 
+ * @return long la distance, RANGING_NO_READING (-1) si aucun objet n'est à portée.
  */
-float RaSmartCar4WD::getDistance()
+long RaSmartCar4WD::getDistanceTenths()
 {
-  // The sensor is triggered by a HIGH pulse of 10 or more microseconds.
-  // Give a short LOW pulse beforehand to ensure a clean HIGH pulse:
-  digitalWrite(PIN_TRIGGER, LOW);
-  delayMicroseconds(2);
-  digitalWrite(PIN_TRIGGER, HIGH);
-  delayMicroseconds(10);
-  digitalWrite(PIN_TRIGGER, LOW);
-  // Read the signal from the sensor: a HIGH pulse whose
-  // duration is the time (in microseconds) from the sending
-  // of the ping to the reception of its echo off of an object.
-  long duration = pulseIn(PIN_ECHO, HIGH);
+  long duration = 0;
 
-  // Convert the time into a distance
-  if (distanceUnit == DIST_UNIT_CM)
+  if(!trace.isReplaying())
   {
-    return (duration / 2) / 29.1; // Divide by 29.1 or multiply by 0.0343
+    duration = ranging.measure(RANGING_FRONT, distanceTimeout);
   }
+  duration = trace.event(TRACE_CH_ECHO, duration);
 
-  if (distanceUnit == DIST_UNIT_INCH)
+  if(duration == 0)
   {
-    return (duration / 2) / 74; // Divide by 74 or multiply by 0.0135
+    return RANGING_NO_READING;
   }
+  return RaRangingArray::toDistance(duration, distanceScale);
+}
 
-  return 0;
+/**
+ * @brief Récupère la distance détectée par le capteur ultrason. 
+ * L'unité de la valeur de retour peut être définie par la méthode setDistanceUnit.
+ * 
+ * @see Les méthodes setDistanceUnit et getDistanceTenths (sans calcul flottant).
+ * 
+ * @return float La distance, 0 si aucun objet n'est à portée. L'unité par défaut est le centimètre. 
+ */
+float RaSmartCar4WD::getDistance()
+{
+  long distance = getDistanceTenths();
+
+  if(distance == RANGING_NO_READING)
+  {
+    return 0;
+  }
+  return distance * 0.1f;
 }
+#endif
 
+#if RA_USE_IR && RA_USE_DEBUG
 /**
  * @brief Permet de vérifier le bon fonctionnement de la télécommande infrarouge.
  * La touche pressée est indiquée dans la caonsole (moniteur).
@@ -468,79 +734,81 @@ void RaSmartCar4WD::checkRemoteControl()
   {
     if (rcHandler->isArrowUp())
     {
-      Serial.println("Arrow up pressed.");
+      hw.serial().println("Arrow up pressed.");
     }
     else if (rcHandler->isArrowDown())
     {
-      Serial.println("Arrow down pressed.");
+      hw.serial().println("Arrow down pressed.");
     }
     else if (rcHandler->isArrowLeft())
     {
-      Serial.println("Arrow left pressed.");
+      hw.serial().println("Arrow left pressed.");
     }
     else if (rcHandler->isArrowRight())
     {
-      Serial.println("Arrow right pressed.");
+      hw.serial().println("Arrow right pressed.");
     }
     else if (rcHandler->isKeyOk())
     {
-      Serial.println("OK pressed.");
+      hw.serial().println("OK pressed.");
     }
     else if (rcHandler->isKey0())
     {
-      Serial.println("0 pressed.");
+      hw.serial().println("0 pressed.");
     }
     else if (rcHandler->isKey1())
     {
-      Serial.println("1 pressed.");
+      hw.serial().println("1 pressed.");
     }
     else if (rcHandler->isKey2())
     {
-      Serial.println("2 pressed.");
+      hw.serial().println("2 pressed.");
     }
     else if (rcHandler->isKey3())
     {
-      Serial.println("3 pressed.");
+      hw.serial().println("3 pressed.");
     }
     else if (rcHandler->isKey4())
     {
-      Serial.println("4 pressed.");
+      hw.serial().println("4 pressed.");
     }
     else if (rcHandler->isKeyNumber(5))
     {
-      Serial.println("5 pressed.");
+      hw.serial().println("5 pressed.");
     }
     else if (rcHandler->isKeyNumber(6))
     {
-      Serial.println("6 pressed.");
+      hw.serial().println("6 pressed.");
     }
     else if (rcHandler->isKeyNumber(7))
     {
-      Serial.println("7 pressed.");
+      hw.serial().println("7 pressed.");
     }
     else if (rcHandler->isKeyNumber(8))
     {
-      Serial.println("8 pressed.");
+      hw.serial().println("8 pressed.");
     }
     else if (rcHandler->isKeyNumber(9))
     {
-      Serial.println("9 pressed.");
+      hw.serial().println("9 pressed.");
     }
     else if (rcHandler->isKeyStar())
     {
-      Serial.println("Star key pressed.");
+      hw.serial().println("Star key pressed.");
     }
     else if (rcHandler->isKeySharp())
     {
-      Serial.println("Sharp key pressed.");
+      hw.serial().println("Sharp key pressed.");
     }
 
     // Serial.println(irCode.value, HEX);
     rcHandler->resume();
   }
-  delay(100);
+  hw.delay(100);
 }
+#endif
 
+#if RA_USE_BLUETOOTH && RA_USE_DEBUG
 /**
  * @brief Permet d'afficher les informations envoyées via l'interface série
  * lors de l'utilisation d'une application connectée en bluetooth.
@@ -550,54 +818,70 @@ void RaSmartCar4WD::debugBluetooth()
 {
   char btVal;
 
-  if (Serial.available())
+  if (hw.serial().available())
   {
-    btVal = Serial.read();
-    Serial.print("btVal: ");
-    Serial.println(btVal);
+    btVal = hw.serial().read();
+    hw.serial().print("btVal: ");
+    hw.serial().println(btVal);
   }
 }
+#endif
 
+#if RA_USE_BLUETOOTH
 /**
  * @brief Définit le fonctionnement de la voiture pour l'application "keyes 4WD" de Keyestudio.
  * Il est possible de régler la vitesse d'accélération/décélération avec la constante SPEED_STEP.
+ * Un octet inconnu est ignoré : il ne change ni le mode ni le mouvement en cours.
+ * Cette méthode doit être appelée à chaque tour de la fonction loop().
  * 
  * @see https://play.google.com/store/apps/details?id=com.keyestudio.keyes4wd&hl=en&gl=US
+ * @see Les méthodes setMode et updateMode.
  * 
  * @todo Gérer le mode "anti-drop" pour empêcher la smart car de tomber quand elle arrive au bord d'une table.
  */
 void RaSmartCar4WD::enableBluetoothControl()
 {
-  char btVal;
-  int newSpeed;
+  int btVal = readSerialCommand();
 
-  if(Serial.available())
+  if(btVal >= 0)
   {
-    btVal = Serial.read();
-  }
+    if(debug)
+    {
+      hw.serial().print("btVal: ");
+      hw.serial().println((char)btVal);
+    }
 
-  if(debug)
-  {
-    Serial.print("btVal: ");
-    Serial.println(btVal);
+    handleBluetoothCommand(btVal);
   }
 
+  update();
+}
+
+/**
+ * @brief Interprète un octet envoyé par l'application bluetooth.
+ * 
+ * @param btVal l'octet reçu.
+ */
+void RaSmartCar4WD::handleBluetoothCommand(char btVal)
+{
+  int newSpeed;
+
   switch (btVal)
   {
   case 'F':
-    btMode = BT_MODE_RUN;
+    setMode(BT_MODE_RUN);
     goForward();
     break;
   case 'B':
-    btMode = BT_MODE_RUN;
+    setMode(BT_MODE_RUN);
     goBackward();
     break;
   case 'L':
-    btMode = BT_MODE_RUN;
+    setMode(BT_MODE_RUN);
     turnLeft();
     break;
   case 'R':
-    btMode = BT_MODE_RUN;
+    setMode(BT_MODE_RUN);
     turnRight();
     break;
   case 'a':
@@ -615,305 +899,1543 @@ void RaSmartCar4WD::enableBluetoothControl()
     setSpeed(newSpeed);
     break;
   case 'S':
-    // btMode = BT_MODE_RUN;
-    Serial.println("Stop");
+    if(debug)
+    {
+      hw.serial().println("Stop");
+    }
+    setMode(BT_MODE_RUN);
     stop();
     break;
 
   case 'G': // anti-drop
-    btMode = BT_MODE_ANTI_DROP;
+    setMode(BT_MODE_ANTI_DROP);
     break;
 
   case 'X': // line tracking
-    btMode = BT_MODE_LINE_TRACKING;
+    setMode(BT_MODE_LINE_TRACKING);
     break;
 
   case 'Y': // Avoid
-    btMode = BT_MODE_AVOID;
+    setMode(BT_MODE_AVOID);
     break;
 
   case 'U': // Following
-    btMode = BT_MODE_FOLLOWING;
+    setMode(BT_MODE_FOLLOWING);
     break;
-  
+
   default:
-    // btMode = BT_MODE_RUN;
-    Serial.println("Default -> stop");
-    stop();
-    break;
+    // Unknown byte (e.g. line ending): keep the current mode running
+    return;
   }
 
-  switch (btMode)
-  {
-  case BT_MODE_ANTI_DROP:
-    Serial.println("A faire !!!");
-    stop();
-    break;
-  case BT_MODE_LINE_TRACKING:
-    enableLineTracking();
-    break;
-  case BT_MODE_AVOID:
-    enableAvoidObstacles();
-    break;
-  case BT_MODE_FOLLOWING:
-    enableFollowMovingObjects();
-    break;
-  }
+  noteCommand(LINK_BT);
 }
+#endif
 
 /**
- * @brief Permet d'activer ou désactiver les symboles qui s'affichent sur la matrice de LEDs.
+ * @brief Change le mode de fonctionnement de la voiture.
+ * La méthode de sortie de l'ancien mode est appelée (arrêt des moteurs, tête remise droite...),
+ * puis la méthode d'entrée du nouveau mode. Le premier pas du nouveau mode est fait par le prochain
+ * appel de update() (ou de updateMode()). Rien ne se passe si le mode est déjà actif.
  * 
- * @param iShow true = affiche les symboles sur la matrice de LEDs.
+ * @see La méthode updateMode.
+ * 
+ * @param mode le nouveau mode. Utilisez les constantes BT_MODE_* (BT_MODE_RUN, BT_MODE_LINE_TRACKING...).
  */
-void RaSmartCar4WD::setShowSymbols(bool iShow)
+void RaSmartCar4WD::setMode(int mode)
 {
-  showSymbols = iShow;
+  ModeEntry entry;
+
+  if(mode < 0 || mode >= BT_MODE_COUNT || mode == btMode)
+  {
+    return;
+  }
+
+  memcpy_P(&entry, &modeTable[btMode], sizeof(ModeEntry));
+  if(entry.exit)
+  {
+    (this->*entry.exit)();
+  }
+
+  btMode = mode;
+  failsafeRamping = false;
+  statusLed.signal(LED_STATUS_MODE_CHANGED);
+
+  memcpy_P(&entry, &modeTable[btMode], sizeof(ModeEntry));
+  if(entry.enter)
+  {
+    (this->*entry.enter)();
+  }
+  // First step at the next update(), after its sensor sampling
+  modeLastUpdate = clockMillis() - entry.period;
 }
 
 /**
- * @brief Affiche quelque chose sur la matrice de LEDs 16x8.
- * 
- * @see http://dotmatrixtool.com/
+ * @brief Récupère le mode de fonctionnement actif.
  * 
- * @param entries un tableau de 16 x 8 bits.
+ * @return int le mode actif (constantes BT_MODE_*).
  */
-void RaSmartCar4WD::display(unsigned char entries[])
+int RaSmartCar4WD::getMode()
 {
-  ledMatrix->display(entries);
+  return btMode;
 }
 
 /**
- * @brief Affiche un emoji qui sourit sur la matrice de LEDs.
- * @see http://dotmatrixtool.com/
+ * @brief Fait avancer le mode actif d'un pas, si sa période de mise à jour est écoulée.
+ * Cette méthode ne bloque pas (hors attentes propres au mode) : appelez-la à chaque tour de loop().
+ * 
+ * @see La méthode setMode.
  */
-void RaSmartCar4WD::displaySmile()
+void RaSmartCar4WD::updateMode()
 {
-  unsigned char smile[] = {0x00,0x00,0x1c,0x02,0x02,0x02,0x5c,0x40,0x40,0x5c,0x02,0x02,0x02,0x1c,0x00,0x00};
-  ledMatrix->display(smile);
-}
+  ModeEntry entry;
+  unsigned long now = clockMillis();
 
-/**
- * @brief Affiche une flèche vers la gauche sur la matrice de LEDs.
- * @see http://dotmatrixtool.com/
- */
-void RaSmartCar4WD::displayLeft()
-{
-  unsigned char left[] = {0x00,0x00,0x00,0x00,0x00,0x00,0x44,0x28,0x10,0x44,0x28,0x10,0x44,0x28,0x10,0x00};
-  ledMatrix->display(left);
-}
+  memcpy_P(&entry, &modeTable[btMode], sizeof(ModeEntry));
+  if(entry.update == NULL || now - modeLastUpdate < entry.period)
+  {
+    return;
+  }
 
-/**
- * @brief Affiche une flèche vers la droite sur la matrice de LEDs.
- * @see http://dotmatrixtool.com/
- */
-void RaSmartCar4WD::displayRight()
-{
-  unsigned char right[] = {0x00,0x10,0x28,0x44,0x10,0x28,0x44,0x10,0x28,0x44,0x00,0x00,0x00,0x00,0x00,0x00};
-  ledMatrix->display(right);
+  modeLastUpdate = now;
+  if(!profiling)
+  {
+    (this->*entry.update)();
+    return;
+  }
+
+  unsigned long start = hw.micros();
+  (this->*entry.update)();
+  unsigned long elapsed = hw.micros() - start;
+
+  RaModeStats& stats = modeStats[btMode];
+  stats.calls++;
+  stats.totalMicros += elapsed;
+  if(elapsed > stats.maxMicros)
+  {
+    stats.maxMicros = elapsed;
+  }
 }
 
 /**
- * @brief Affiche un emoji sur la matrice de LEDs.
- * @see http://dotmatrixtool.com/
+ * @brief Boucle principale de la voiture : échantillonne les capteurs utiles au mode actif,
+ * chacun à son propre rythme, fait avancer le mode actif, l'animation de la matrice de LEDs
+ * et le voyant d'état.
+ * Appelez cette méthode à chaque tour de loop() (enableBluetoothControl le fait déjà).
+ * 
+ * @see Les méthodes getWorld et updateMode.
  */
-void RaSmartCar4WD::displayStart()
+void RaSmartCar4WD::update()
 {
-  unsigned char start[] = {0x01,0x02,0x04,0x08,0x10,0x20,0x40,0x80,0x80,0x40,0x20,0x10,0x08,0x04,0x02,0x01};
-  ledMatrix->display(start);
+  ModeEntry entry;
+
+  memcpy_P(&entry, &modeTable[btMode], sizeof(ModeEntry));
+  if(entry.sensors)
+  {
+    updateWorld(entry.sensors);
+  }
+  updateMode();
+
+  unsigned long now = clockMillis();
+#if RA_USE_RANGING
+  // The rear/side sensors are only read through the array: keep them firing in the modes that
+  // do not use it, and leave the front one to the blocking measures of these modes
+  if(!(entry.sensors & SENSOR_RANGING) && ranging.getCount() > 1)
+  {
+    ranging.update(now, trace, RANGING_ALL_SENSORS & ~(1 << RANGING_FRONT));
+  }
+#endif
+#if RA_USE_GRID
+  grid.move(now, motorDirection & MOTOR_LEFT_FORWARD ? motorLeftSpeed : -motorLeftSpeed,
+            motorDirection & MOTOR_RIGHT_FORWARD ? motorRightSpeed : -motorRightSpeed);
+#endif
+#if RA_USE_MATRIX
+  if(animation.tick(now))
+  {
+    flushFrame();
+  }
+#endif
+  statusLed.tick(now);
+  updateFailsafe(now);
+  updatePower(now);
 }
 
+#if RA_USE_GRID
 /**
- * @brief Affiche une flèche vers le haut sur la matrice de LEDs.
- * @see http://dotmatrixtool.com/
+ * @brief Donne accès à la carte d'occupation autour de la voiture, construite à partir des mesures
+ * du capteur ultrason avant (orienté par le servomoteur) et des vitesses commandées aux moteurs.
+ * 
+ * @return RaOccupancyGrid& la carte.
  */
-void RaSmartCar4WD::displayForward()
+RaOccupancyGrid& RaSmartCar4WD::getGrid()
 {
-  unsigned char front[] = {0x00,0x00,0x00,0x00,0x00,0x24,0x12,0x09,0x12,0x24,0x00,0x00,0x00,0x00,0x00,0x00};
-  ledMatrix->display(front);
+  return grid;
 }
 
 /**
- * @brief Affiche une flèche vers le bas sur la matrice de LEDs.
- * @see http://dotmatrixtool.com/
+ * @brief Récupère la direction du capteur ultrason avant, porté par la tête.
+ * 
+ * @return int la direction par rapport à l'avant de la voiture, en degrés (90 = à gauche),
+ * 0 sans servomoteur (RA_USE_SERVO).
  */
-void RaSmartCar4WD::displayBackward()
+int RaSmartCar4WD::headBearing()
 {
-  unsigned char back[] = {0x00,0x00,0x00,0x00,0x00,0x24,0x48,0x90,0x48,0x24,0x00,0x00,0x00,0x00,0x00,0x00};
-  ledMatrix->display(back);
+#if RA_USE_SERVO
+  return servoAngle - 90;
+#else
+  return 0;
+#endif
 }
+#endif
 
+#if RA_USE_RANGING
 /**
- * @brief Affiche le mot "STOP" sur la matrice de LEDs.
- * @see http://dotmatrixtool.com/
+ * @brief Donne accès au réseau de capteurs ultrason (RANGING_SENSOR_PINS) :
+ * dernière mesure de chaque capteur et son âge. Les capteurs sont déclenchés à tour de rôle
+ * par la méthode update : tous dans les modes qui utilisent l'instantané des capteurs, et,
+ * dans les autres modes, tous sauf le capteur avant dès que le réseau en compte plusieurs.
+ * 
+ * @return RaRangingArray& le réseau de capteurs.
  */
-void RaSmartCar4WD::displayStop()
+RaRangingArray& RaSmartCar4WD::getRangingArray()
 {
-  unsigned char stop[] = {0x2E,0x2A,0x3A,0x00,0x02,0x3E,0x02,0x00,0x3E,0x22,0x3E,0x00,0x3E,0x0A,0x0E,0x00};
-  ledMatrix->display(stop);
+  return ranging;
 }
+#endif
 
 /**
- * @brief Efface la matrice de LEDs.
+ * @brief Récupère l'instantané des capteurs construit par la méthode update.
+ * 
+ * @return const RaWorldState& l'état courant du monde.
  */
-void RaSmartCar4WD::clearDisplay()
+const RaWorldState& RaSmartCar4WD::getWorld()
 {
-  unsigned char clear[] = {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
-  ledMatrix->display(clear);
+  return world;
 }
 
 /**
- * @brief Active le mode de suivi de ligne au sol de la voiture.
+ * @brief Échantillonne les sources de capteurs demandées dont la période est écoulée :
+ *  - les capteurs de suivi de ligne toutes les FUSION_PERIOD_TRACKING ms (~1 kHz),
+ *  - les capteurs ultrason à tour de rôle, chacun toutes les RANGING_PERIOD ms (~40 Hz)
+ *    au plus, sans attendre l'écho,
+ *  - la télécommande infrarouge à chaque appel, dès qu'une touche est reçue.
+ * Les sources exclues de la compilation (voir RaConfig.h) sont ignorées.
+ * 
+ * @param sensors les sources à échantillonner (SENSOR_*).
  */
-void RaSmartCar4WD::enableLineTracking()
+void RaSmartCar4WD::updateWorld(uint8_t sensors)
 {
-  int left = getLeftTrack();
-  int middle = getMiddleTrack();
-  int right = getRightTrack();
+  unsigned long now = clockMillis();
 
-  if(middle == 1)
+  if((sensors & SENSOR_TRACKING) && (long)(now - trackingNext) >= 0)
   {
-    goForward(100);
+    trackingNext = now + FUSION_PERIOD_TRACKING;
+    world.leftTrack = getLeftTrack();
+    world.middleTrack = getMiddleTrack();
+    world.rightTrack = getRightTrack();
+    world.trackTime = now;
   }
-  else
+
+#if RA_USE_RANGING
+  if((sensors & SENSOR_RANGING) && ranging.update(now, trace) == RANGING_FRONT)
   {
-    if(left == 1 && right == 0)
-    {
-      turnLeft(200);
-    }
-    else if(left == 0 && right == 1)
-    {
-      turnRight(200);
-    }
-    else
+    long echo = ranging.getReading(RANGING_FRONT).echo;
+
+    world.distance = echo == RANGING_NO_READING ? -1 : RaRangingArray::toDistance(echo, RANGING_CM_Q16);
+    world.distanceTime = now;
+#if RA_USE_GRID
+    grid.addRange(headBearing(), world.distance);
+#endif
+  }
+#endif
+
+#if RA_USE_IR
+  if(sensors & SENSOR_IR)
+  {
+    int key = pollRemoteKey();
+
+    if(key >= 0)
     {
-      goForward(70);
-      delay(9);
-      stop();
+      world.irKey = key;
+      world.irTime = now;
     }
   }
+#endif
 }
 
+#if RA_USE_IR
 /**
- * @brief Active le mode de suivi d'un objet en mouvement (grâce au capteur ultrason).
+ * @brief Décode la touche reçue par la télécommande infrarouge.
+ * 
+ * @return int la touche (constantes IR_KEY_*), IR_KEY_NONE si elle est inconnue.
  */
-void RaSmartCar4WD::enableFollowMovingObjects()
+int RaSmartCar4WD::readRemoteKey()
 {
-  long distance = distSensor->Distance();
-
-  if(debug)
+  if (rcHandler->isArrowUp())
   {
-    Serial.println("Distance: " + String(distance));
+    return IR_KEY_UP;
   }
-
-  if(distance < 8)
+  if (rcHandler->isArrowDown())
   {
-    goBackward();
+    return IR_KEY_DOWN;
   }
-  else if(distance >= 8 && distance < 13)
+  if (rcHandler->isArrowLeft())
   {
-    stop();
+    return IR_KEY_LEFT;
   }
-  else if(distance >= 13 && distance < 35)
+  if (rcHandler->isArrowRight())
   {
-    goForward();
+    return IR_KEY_RIGHT;
   }
-  else
+  if (rcHandler->isKeyOk())
   {
-    stop();
+    return IR_KEY_OK;
+  }
+  if (rcHandler->isKeyStar())
+  {
+    return IR_KEY_STAR;
   }
+  if (rcHandler->isKeySharp())
+  {
+    return IR_KEY_SHARP;
+  }
+  for (int i = 0; i <= 9; i++)
+  {
+    if (rcHandler->isKeyNumber(i))
+    {
+      return IR_KEY_0 + i;
+    }
+  }
+  return IR_KEY_NONE;
 }
 
 /**
- * @brief Active le mode d'évitement d'obstacles. 
- * Lorsqu'un objet est détecté à moins de 20 cm devant le robot, il s'arrête, il "regarde" à gauche, 
- * puis à droite puis tourne du côté où il y a le plus d'espace (d'après le capteur ultrason).
+ * @brief Récupère la touche reçue par la télécommande infrarouge, s'il y en a une.
+ * 
+ * @return int la touche (constantes IR_KEY_*), -1 si aucun signal n'a été reçu.
  */
-void RaSmartCar4WD::enableAvoidObstacles()
+int RaSmartCar4WD::pollRemoteKey()
 {
-  long distance = distSensor->Distance();
+  long key = -1;
 
-  if(debug)
+  if(!trace.isReplaying() && rcHandler->hasSignal())
   {
-    Serial.println("Distance: " + String(distance));
+    key = readRemoteKey();
+    rcHandler->resume();
   }
+  return trace.event(TRACE_CH_IR, key);
+}
+#endif
 
-  if(distance < 20 && distance > 0)
-  {
-    stop();
-    delay(100);
-    setServoAngle(180);
-    delay(500);
+/**
+ * @brief Lit l'horloge (millis) utilisée pour cadencer les modes et les capteurs.
+ * 
+ * @return unsigned long le temps écoulé en millisecondes.
+ */
+unsigned long RaSmartCar4WD::clockMillis()
+{
+  return trace.level(TRACE_CH_CLOCK, hw.millis());
+}
 
-    long distLeft = distSensor->Distance();
-    if(debug)
-    {
-      Serial.println("Distance left: " + String(distLeft));
-    }
-    delay(100);
-    setServoAngle(0);
-    delay(500);
+#if RA_USE_BLUETOOTH
+/**
+ * @brief Lit un octet de commande reçu sur l'interface série (bluetooth).
+ * 
+ * @return int l'octet reçu, -1 si rien n'a été reçu.
+ */
+int RaSmartCar4WD::readSerialCommand()
+{
+  long btVal = -1;
 
-    long distRight = distSensor->Distance();
-    if(debug)
-    {
-      Serial.println("Distance right: " + String(distRight));
-    }
-    delay(100);
+  if(!trace.isReplaying() && hw.serial().available())
+  {
+    btVal = hw.serial().read();
+  }
+  return trace.event(TRACE_CH_SERIAL, btVal);
+}
+#endif
+
+#if RA_USE_RANGING
+/**
+ * @brief Mesure la distance (en cm) avec le capteur ultrason avant, en attendant l'écho.
+ * En veille (voir setPowerSave), la mesure n'est refaite que toutes les POWER_IDLE_RANGING_PERIOD ms :
+ * entre-temps, la dernière distance est rendue, tant que la tête n'a pas tourné.
+ * 
+ * @return long la distance en cm, la portée maximale si aucun objet n'est à portée.
+ */
+long RaSmartCar4WD::readDistanceSensor()
+{
+  unsigned long now = clockMillis();
+  long distance = 0;
+
+  if(powerIdle && now - lastDistanceTime < POWER_IDLE_RANGING_PERIOD)
+  {
+    return lastDistance;
+  }
+
+  if(!trace.isReplaying())
+  {
+    long duration = ranging.measure(RANGING_FRONT, distanceTimeout);
+    distance = duration ? RaRangingArray::toDistance(duration, RANGING_CM_Q16) : maxDistance / 10;
+  }
+  distance = trace.level(TRACE_CH_DISTANCE, distance);
+#if RA_USE_GRID
+  grid.addRange(headBearing(), distance);
+#endif
+  lastDistance = distance;
+  lastDistanceTime = now;
+  return distance;
+}
+#endif
+
+/**
+ * @brief Démarre l'enregistrement de toutes les entrées brutes de la voiture
+ * (capteurs de suivi de ligne, horloge, distances et échos, touches infrarouges, octets série)
+ * sur un flux, sous forme compacte. Désactivez le debug pendant l'enregistrement sur Serial.
+ * Sur le port série de la voiture, l'enregistrement passe à TRACE_SERIAL_BAUD bauds (l'horloge
+ * seule produit environ 2 ko/s, trop pour 9600 bauds) jusqu'à l'appel de stopTrace : le module
+ * bluetooth, à 9600 bauds, ne peut plus commander la voiture pendant ce temps.
+ * 
+ * @see La classe RaSensorTrace et la méthode startTraceReplay.
+ * 
+ * @param out le flux de sortie, par exemple Serial.
+ */
+void RaSmartCar4WD::startTraceRecording(Print& out)
+{
+  traceOnSerial = &out == static_cast<Print*>(&hw.serial());
+  if(traceOnSerial)
+  {
+    hw.beginSerial(TRACE_SERIAL_BAUD);
+  }
+  trace.startRecording(&out);
+}
+
+/**
+ * @brief Rejoue une trace enregistrée par startTraceRecording : les méthodes de la voiture
+ * lisent alors les entrées de la trace au lieu des capteurs, et commandent les moteurs
+ * exactement comme lors de l'enregistrement.
+ * 
+ * @param in le flux qui contient la trace.
+ * @return bool false si la trace n'est pas valide.
+ */
+bool RaSmartCar4WD::startTraceReplay(Stream& in)
+{
+  return trace.startReplay(&in);
+}
+
+/**
+ * @brief Arrête l'enregistrement ou le rejeu d'une trace ; le port série revient à SERIAL_BAUD bauds.
+ */
+void RaSmartCar4WD::stopTrace()
+{
+  trace.stop();
+  if(traceOnSerial)
+  {
+    traceOnSerial = false;
+    hw.beginSerial(SERIAL_BAUD);
+  }
+}
+
+#if RA_USE_SERVO && RA_USE_RANGING
+/**
+ * @brief Prépare le mode d'évitement d'obstacles : la tête regarde droit devant.
+ */
+void RaSmartCar4WD::enterAvoidMode()
+{
+  setServoAngle(90);
+}
+#endif
+
+/**
+ * @brief Quitte un mode qui fait rouler la voiture : les moteurs sont arrêtés.
+ */
+void RaSmartCar4WD::exitMovingMode()
+{
+  stop();
+}
+
+#if RA_USE_SERVO && RA_USE_RANGING
+/**
+ * @brief Quitte le mode d'évitement d'obstacles : les moteurs sont arrêtés et la tête remise droite.
+ */
+void RaSmartCar4WD::exitAvoidMode()
+{
+  stop();
+  setServoAngle(90);
+}
+#endif
+
+#if RA_USE_IR
+/**
+ * @brief Mise à jour du mode télécommande : applique la dernière touche reçue, sans attente
+ * (y compris la touche qui a fait passer le mode suivi de ligne avec garde en mode télécommande).
+ */
+void RaSmartCar4WD::updateRemoteMode()
+{
+  int key = pollRemoteKey();
+
+  if(key < 0 && world.irKey != IR_KEY_NONE)
+  {
+    // Key received by the mode that handed over to this one
+    key = world.irKey;
+  }
+  world.irKey = IR_KEY_NONE;
+
+  if(key > IR_KEY_NONE)
+  {
+    noteCommand(LINK_IR);
+  }
+
+  switch (key)
+  {
+  case IR_KEY_UP:
+    goForward();
+    break;
+  case IR_KEY_DOWN:
+    goBackward();
+    break;
+  case IR_KEY_LEFT:
+    turnLeft();
+    break;
+  case IR_KEY_RIGHT:
+    turnRight();
+    break;
+  case IR_KEY_OK:
+    stop();
+    break;
+  }
+}
+#endif
+
+/**
+ * @brief Mise à jour du mode suivi de ligne avec garde : la voiture suit la ligne d'après
+ * l'instantané des capteurs, s'arrête devant un obstacle proche (RaControlGains::guardDistance)
+ * ou si la distance n'a pas été mesurée depuis FUSION_DEADLINE_RANGING ms, et passe en mode télécommande dès qu'une touche de la télécommande infrarouge est pressée.
+ */
+void RaSmartCar4WD::updateGuardedLineMode()
+{
+  unsigned long now = clockMillis();
+
+  if(world.irKey != IR_KEY_NONE)
+  {
+    if(now - world.irTime < FUSION_DEADLINE_IR)
+    {
+      // The remote mode applies the key on its first step, at the next update()
+      setMode(BT_MODE_REMOTE);
+      return;
+    }
+    world.irKey = IR_KEY_NONE;
+  }
+
+  if(now - world.trackTime > FUSION_DEADLINE_TRACKING)
+  {
+    return;
+  }
+
+#if RA_USE_RANGING
+  // No recent distance: the way is not known to be clear
+  if(now - world.distanceTime >= FUSION_DEADLINE_RANGING
+      || (world.distance > 0 && world.distance < gains.guardDistance))
+  {
+    stop();
+    return;
+  }
+#endif
+
+  trackLine(world.leftTrack, world.middleTrack, world.rightTrack);
+}
+
+#if RA_USE_MATRIX
+/**
+ * @brief Permet d'activer ou désactiver les symboles qui s'affichent sur la matrice de LEDs.
+ * 
+ * @param iShow true = affiche les symboles sur la matrice de LEDs.
+ */
+void RaSmartCar4WD::setShowSymbols(bool iShow)
+{
+  showSymbols = iShow;
+}
+
+/**
+ * @brief Affiche quelque chose sur la matrice de LEDs 16x8.
+ * 
+ * @see http://dotmatrixtool.com/
+ * 
+ * @param entries un tableau de 16 x 8 bits.
+ */
+void RaSmartCar4WD::display(unsigned char entries[])
+{
+  pushFrame(entries);
+}
+
+/**
+ * @brief Affiche un emoji qui sourit sur la matrice de LEDs.
+ * @see http://dotmatrixtool.com/
+ */
+void RaSmartCar4WD::displaySmile()
+{
+  unsigned char smile[] = {0x00,0x00,0x1c,0x02,0x02,0x02,0x5c,0x40,0x40,0x5c,0x02,0x02,0x02,0x1c,0x00,0x00};
+  pushFrame(smile);
+}
+
+/**
+ * @brief Affiche une flèche vers la gauche sur la matrice de LEDs.
+ * @see http://dotmatrixtool.com/
+ */
+void RaSmartCar4WD::displayLeft()
+{
+  unsigned char left[] = {0x00,0x00,0x00,0x00,0x00,0x00,0x44,0x28,0x10,0x44,0x28,0x10,0x44,0x28,0x10,0x00};
+  pushFrame(left);
+}
+
+/**
+ * @brief Affiche une flèche vers la droite sur la matrice de LEDs.
+ * @see http://dotmatrixtool.com/
+ */
+void RaSmartCar4WD::displayRight()
+{
+  unsigned char right[] = {0x00,0x10,0x28,0x44,0x10,0x28,0x44,0x10,0x28,0x44,0x00,0x00,0x00,0x00,0x00,0x00};
+  pushFrame(right);
+}
+
+/**
+ * @brief Affiche un emoji sur la matrice de LEDs.
+ * @see http://dotmatrixtool.com/
+ */
+void RaSmartCar4WD::displayStart()
+{
+  unsigned char start[] = {0x01,0x02,0x04,0x08,0x10,0x20,0x40,0x80,0x80,0x40,0x20,0x10,0x08,0x04,0x02,0x01};
+  pushFrame(start);
+}
+
+/**
+ * @brief Affiche une flèche vers le haut sur la matrice de LEDs.
+ * @see http://dotmatrixtool.com/
+ */
+void RaSmartCar4WD::displayForward()
+{
+  unsigned char front[] = {0x00,0x00,0x00,0x00,0x00,0x24,0x12,0x09,0x12,0x24,0x00,0x00,0x00,0x00,0x00,0x00};
+  pushFrame(front);
+}
+
+/**
+ * @brief Affiche une flèche vers le bas sur la matrice de LEDs.
+ * @see http://dotmatrixtool.com/
+ */
+void RaSmartCar4WD::displayBackward()
+{
+  unsigned char back[] = {0x00,0x00,0x00,0x00,0x00,0x24,0x48,0x90,0x48,0x24,0x00,0x00,0x00,0x00,0x00,0x00};
+  pushFrame(back);
+}
+
+/**
+ * @brief Affiche le mot "STOP" sur la matrice de LEDs.
+ * @see http://dotmatrixtool.com/
+ */
+void RaSmartCar4WD::displayStop()
+{
+  unsigned char stop[] = {0x2E,0x2A,0x3A,0x00,0x02,0x3E,0x02,0x00,0x3E,0x22,0x3E,0x00,0x3E,0x0A,0x0E,0x00};
+  pushFrame(stop);
+}
+
+/**
+ * @brief Affiche une image de 16 x 8 bits sur la matrice de LEDs, si aucune animation n'est en cours.
+ * L'image n'est envoyée que si elle diffère de celle déjà affichée.
+ * 
+ * @param entries un tableau de 16 x 8 bits.
+ */
+void RaSmartCar4WD::pushFrame(unsigned char entries[])
+{
+  if(animation.isRunning())
+  {
+    return;
+  }
+
+  animation.load(entries);
+  if(animation.isDirty())
+  {
+    flushFrame();
+  }
+}
+
+/**
+ * @brief Envoie l'image de travail de l'animation à la matrice de LEDs.
+ */
+void RaSmartCar4WD::flushFrame()
+{
+  uint8_t* frame = animation.getBuffer();
+
+  matrixLit = 0;
+  for (uint8_t i = 0; i < MATRIX_COLUMNS; i++)
+  {
+    for (uint8_t bits = frame[i]; bits; bits &= bits - 1)
+    {
+      matrixLit++;
+    }
+  }
+  matrixFrames++;
+  ledMatrix->display(animation.getBuffer());
+  animation.clean();
+}
+
+/**
+ * @brief Active ou désactive l'envoi des images à la matrice de LEDs en tâche de fond (par
+ * interruption, sur AVR) : les méthodes d'affichage et update ne bloquent plus pendant l'envoi.
+ * Seules les colonnes modifiées sont envoyées, dans tous les cas.
+ * 
+ * @param async true = envoi en tâche de fond.
+ */
+void RaSmartCar4WD::setMatrixAsync(bool async)
+{
+  ledMatrix->setAsync(async);
+}
+
+/**
+ * @brief Fait défiler un texte sur la matrice de LEDs (par exemple le nom d'un mode ou une distance),
+ * sans bloquer : le texte avance à chaque appel de la méthode update.
+ * Tant que le texte défile, les symboles de déplacement ne sont pas affichés.
+ * 
+ * @see La méthode update.
+ * 
+ * @param text le texte (ANIM_TEXT_MAX caractères au plus, copié).
+ */
+void RaSmartCar4WD::scrollText(const char* text)
+{
+  animation.scrollText(text);
+  flushFrame();
+}
+
+/**
+ * @brief Joue une séquence d'images sur la matrice de LEDs, sans bloquer :
+ * l'image change à chaque appel de la méthode update dont la période est écoulée.
+ * Tant que l'animation est en cours, les symboles de déplacement ne sont pas affichés.
+ * 
+ * @see La méthode update.
+ * 
+ * @param progmemFrames les images (16 octets chacune) en mémoire flash (PROGMEM).
+ * @param count le nombre d'images.
+ * @param framePeriod la durée d'une image en millisecondes.
+ * @param loop true = rejoue la séquence sans fin.
+ */
+void RaSmartCar4WD::playAnimation(const uint8_t* progmemFrames, uint8_t count, unsigned int framePeriod, bool loop)
+{
+  animation.playFrames(progmemFrames, count, framePeriod, loop);
+  if(animation.isDirty())
+  {
+    flushFrame();
+  }
+}
+
+/**
+ * @brief Arrête le texte ou l'animation en cours sur la matrice de LEDs.
+ */
+void RaSmartCar4WD::stopAnimation()
+{
+  animation.stop();
+}
+
+/**
+ * @brief Donne accès à l'image de travail de la matrice de LEDs, pour dessiner pixel par pixel.
+ * L'image est envoyée à la matrice au prochain appel de la méthode update, si elle a changé.
+ * 
+ * @return RaMatrixAnimation& le moteur d'animation.
+ */
+RaMatrixAnimation& RaSmartCar4WD::getAnimation()
+{
+  return animation;
+}
+
+/**
+ * @brief Efface la matrice de LEDs.
+ */
+void RaSmartCar4WD::clearDisplay()
+{
+  unsigned char clear[] = {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+  pushFrame(clear);
+}
+#endif
+
+/**
+ * @brief Active le mode de suivi de ligne au sol de la voiture.
+ */
+void RaSmartCar4WD::enableLineTracking()
+{
+  trackLine(getLeftTrack(), getMiddleTrack(), getRightTrack());
+}
+
+/**
+ * @brief Un pas de suivi de ligne à partir de l'état des 3 capteurs.
+ * 
+ * @param left le capteur de gauche.
+ * @param middle le capteur du milieu.
+ * @param right le capteur de droite.
+ */
+void RaSmartCar4WD::trackLine(int left, int middle, int right)
+{
+  if(middle == 1)
+  {
+    goForward(gains.lineSpeed);
+  }
+  else
+  {
+    if(left == 1 && right == 0)
+    {
+      turnLeft(gains.lineTurnSpeed);
+    }
+    else if(left == 0 && right == 1)
+    {
+      turnRight(gains.lineTurnSpeed);
+    }
+    else
+    {
+      goForward(gains.lineSearchSpeed);
+      waitMillis(gains.lineSearchPulse);
+      stop();
+    }
+  }
+}
+
+#if RA_USE_RANGING
+/**
+ * @brief Active le mode de suivi d'un objet en mouvement (grâce au capteur ultrason).
+ */
+void RaSmartCar4WD::enableFollowMovingObjects()
+{
+  long distance = readDistanceSensor();
+
+  if(debug)
+  {
+    hw.serial().println("Distance: " + String(distance));
+  }
+
+  if(distance < gains.followBackDistance)
+  {
+    goBackward();
+  }
+  else if(distance < gains.followStopDistance)
+  {
+    stop();
+  }
+  else if(distance < gains.followMaxDistance)
+  {
+    goForward();
+  }
+  else
+  {
+    stop();
+  }
+}
+#endif
+
+#if RA_USE_SERVO && RA_USE_RANGING
+/**
+ * @brief Active le mode d'évitement d'obstacles. 
+ * Lorsqu'un objet est détecté devant le robot (à moins de 20 cm par défaut, voir setGains), il s'arrête, il "regarde" à gauche, 
+ * puis à droite puis tourne du côté où il y a le plus d'espace (d'après le capteur ultrason).
+ * Si la carte d'occupation (voir getGrid) connaît déjà les deux côtés, il tourne sans regarder.
+ */
+void RaSmartCar4WD::enableAvoidObstacles()
+{
+  long distance = readDistanceSensor();
+
+  if(debug)
+  {
+    hw.serial().println("Distance: " + String(distance));
+  }
+
+  if(distance < gains.avoidDistance && distance > 0)
+  {
+    stop();
+
+#if RA_USE_GRID
+    // Both sides already in the map: turn towards the free side without looking again
+    long clearLeft = grid.clearance(90);
+    long clearRight = grid.clearance(-90);
+    if(clearLeft >= 0 && clearRight >= 0 && clearLeft != clearRight)
+    {
+      if(debug)
+      {
+        hw.serial().println("Map left: " + String(clearLeft) + " right: " + String(clearRight));
+      }
+      if(clearLeft > clearRight)
+      {
+        turnLeft();
+      }
+      else
+      {
+        turnRight();
+      }
+      waitMillis(gains.avoidTurnTime);
+      return;
+    }
+#endif
+
+    waitMillis(gains.avoidSettleTime);
+    setServoAngle(180);
+    waitMillis(gains.avoidLookTime);
+
+    long distLeft = readDistanceSensor();
+    if(debug)
+    {
+      hw.serial().println("Distance left: " + String(distLeft));
+    }
+    waitMillis(gains.avoidSettleTime);
+    setServoAngle(0);
+    waitMillis(gains.avoidLookTime);
+
+    long distRight = readDistanceSensor();
+    if(debug)
+    {
+      hw.serial().println("Distance right: " + String(distRight));
+    }
+    waitMillis(gains.avoidSettleTime);
+
+    if(distLeft > distRight)
+    {
+      turnLeft();
+    }
+    else
+    {
+      turnRight();
+    }
+    setServoAngle(90);
+    waitMillis(gains.avoidTurnTime);
+  }
+  else
+  {
+    goForward();
+  }
+}
+#endif
+
+#if RA_USE_IR
+/**
+ * @brief Active le contrôle par la télécommande infrarouge.
+ * Flèche haut = avancer,
+ * Flèche bas = reculer,
+ * Flèche gauche = tourner à gauche,
+ * Flèche droite = you got it ;-),
+ * Bouton "OK" = stop.
+ * 
+ * @todo Gérer la vitesse.
+ */
+void RaSmartCar4WD::handleRemoteControl()
+{
+  updateRemoteMode();
+  hw.delay(100);
+}
+#endif
+
+/**
+ * @brief Définit les seuils et vitesses des modes automatiques.
+ * 
+ * @param newGains les seuils et vitesses, par exemple issus d'un réglage par simulation.
+ */
+void RaSmartCar4WD::setGains(const RaControlGains& newGains)
+{
+  gains = newGains;
+}
+
+/**
+ * @brief Récupère les seuils et vitesses des modes automatiques.
+ * 
+ * @return const RaControlGains& les seuils et vitesses.
+ */
+const RaControlGains& RaSmartCar4WD::getGains()
+{
+  return gains;
+}
+
+/**
+ * @brief Revient aux seuils et vitesses par défaut (GAINS_DEFAULT).
+ */
+void RaSmartCar4WD::resetGains()
+{
+  memcpy_P(&gains, &defaultGains, sizeof(RaControlGains));
+}
+
+/**
+ * @brief Charge les seuils et vitesses enregistrés en EEPROM par la méthode saveGains.
+ * 
+ * @param address l'adresse en EEPROM.
+ * @return bool true si un réglage valide a été chargé, false sinon (les réglages ne changent pas).
+ */
+bool RaSmartCar4WD::loadGains(int address)
+{
+  RaControlGains loaded;
+  uint8_t* bytes = (uint8_t*)&loaded;
+  uint8_t sum = 0;
+
+  if(hw.eepromRead(address) != GAINS_MAGIC || hw.eepromRead(address + 1) != GAINS_VERSION)
+  {
+    return false;
+  }
+  for (uint8_t i = 0; i < sizeof(RaControlGains); i++)
+  {
+    bytes[i] = hw.eepromRead(address + 2 + i);
+    sum += bytes[i];
+  }
+  if(hw.eepromRead(address + 2 + sizeof(RaControlGains)) != sum)
+  {
+    return false;
+  }
+  gains = loaded;
+  return true;
+}
 
-    if(distLeft > distRight)
-    {
-      turnLeft();
-    }
-    else
-    {
-      turnRight();
-    }
-    setServoAngle(90);
-    delay(300);
+/**
+ * @brief Enregistre les seuils et vitesses en EEPROM, pour les recharger au démarrage (loadGains).
+ * Occupe sizeof(RaControlGains) + 3 octets.
+ * 
+ * @param address l'adresse en EEPROM.
+ */
+void RaSmartCar4WD::saveGains(int address)
+{
+  const uint8_t* bytes = (const uint8_t*)&gains;
+  uint8_t sum = 0;
+
+  hw.eepromWrite(address, GAINS_MAGIC);
+  hw.eepromWrite(address + 1, GAINS_VERSION);
+  for (uint8_t i = 0; i < sizeof(RaControlGains); i++)
+  {
+    hw.eepromWrite(address + 2 + i, bytes[i]);
+    sum += bytes[i];
   }
-  else
+  hw.eepromWrite(address + 2 + sizeof(RaControlGains), sum);
+}
+
+/**
+ * @brief Écrit les seuils et vitesses sous la forme d'un initialiseur C, à copier dans un programme
+ * (par exemple "RaControlGains gains = {...};" puis setGains(gains)).
+ * 
+ * @param out le flux de sortie, par exemple Serial.
+ */
+void RaSmartCar4WD::printGains(Print& out)
+{
+  out.print('{');
+  out.print(gains.lineSpeed);
+  out.print(", ");
+  out.print(gains.lineTurnSpeed);
+  out.print(", ");
+  out.print(gains.lineSearchSpeed);
+  out.print(", ");
+  out.print(gains.lineSearchPulse);
+  out.print(", ");
+  out.print(gains.followBackDistance);
+  out.print(", ");
+  out.print(gains.followStopDistance);
+  out.print(", ");
+  out.print(gains.followMaxDistance);
+  out.print(", ");
+  out.print(gains.guardDistance);
+  out.print(", ");
+  out.print(gains.avoidDistance);
+  out.print(", ");
+  out.print(gains.avoidSettleTime);
+  out.print(", ");
+  out.print(gains.avoidLookTime);
+  out.print(", ");
+  out.print(gains.avoidTurnTime);
+  out.println('}');
+}
+
+/**
+ * @brief Active ou désactive le profilage des modes : durée de chaque mise à jour,
+ * temps passé en attente (delay) dans les modes et nombre d'images envoyées à la matrice de LEDs.
+ * 
+ * @see Les méthodes resetStats et printStats.
+ * 
+ * @param enable true = active le profilage.
+ */
+void RaSmartCar4WD::setProfiling(bool enable)
+{
+  profiling = enable;
+}
+
+/**
+ * @brief Remet à zéro les mesures du profilage.
+ */
+void RaSmartCar4WD::resetStats()
+{
+  for (int i = 0; i < BT_MODE_COUNT; i++)
   {
-    goForward();
+    modeStats[i].calls = 0;
+    modeStats[i].totalMicros = 0;
+    modeStats[i].maxMicros = 0;
+  }
+  blockedMillis = 0;
+  matrixFrames = 0;
+  for (int i = 0; i < POWER_SUBSYSTEMS; i++)
+  {
+    energy[i] = 0;
+    energyRemainder[i] = 0;
   }
 }
 
 /**
- * @brief Active le contrôle par la télécommande infrarouge.
- * Flèche haut = avancer,
- * Flèche bas = reculer,
- * Flèche gauche = tourner à gauche,
- * Flèche droite = you got it ;-),
- * Bouton "OK" = stop.
+ * @brief Écrit les mesures du profilage au format CSV, pour être comparées d'une version à l'autre.
+ * Une ligne par mode mis à jour au moins une fois ("mode,calls,total_us,max_us"),
+ * puis une ligne "blocked_ms,matrix_frames". Les lignes commençant par # sont des en-têtes.
  * 
- * @todo Gérer la vitesse.
+ * @param out le flux de sortie, par exemple Serial.
  */
-void RaSmartCar4WD::handleRemoteControl()
+void RaSmartCar4WD::printStats(Print& out)
 {
-  if (rcHandler->hasSignal())
+  out.println("# mode,calls,total_us,max_us");
+  for (int i = 0; i < BT_MODE_COUNT; i++)
   {
-    if (rcHandler->isArrowUp())
+    if (modeStats[i].calls == 0)
     {
-      goForward();
+      continue;
     }
-    else if (rcHandler->isArrowDown())
+    out.print(i);
+    out.print(',');
+    out.print(modeStats[i].calls);
+    out.print(',');
+    out.print(modeStats[i].totalMicros);
+    out.print(',');
+    out.println(modeStats[i].maxMicros);
+  }
+  out.println("# blocked_ms,matrix_frames");
+  out.print(blockedMillis);
+  out.print(',');
+  out.println(matrixFrames);
+}
+
+/**
+ * @brief Récupère les mesures du profilage d'un mode.
+ * 
+ * @param mode le mode (constantes BT_MODE_*), BT_MODE_NONE si hors limites.
+ * @return const RaModeStats& ses mesures depuis resetStats.
+ */
+const RaModeStats& RaSmartCar4WD::getModeStats(int mode)
+{
+  return modeStats[mode >= 0 && mode < BT_MODE_COUNT ? mode : BT_MODE_NONE];
+}
+
+/**
+ * @brief Récupère le temps passé en attente (delay) dans les modes depuis resetStats,
+ * quand le profilage est actif.
+ * 
+ * @return unsigned long la durée en millisecondes.
+ */
+unsigned long RaSmartCar4WD::getBlockedMillis()
+{
+  return blockedMillis;
+}
+
+/**
+ * @brief Attend (delay) dans un mode, en comptant le temps bloqué si le profilage est actif.
+ * 
+ * @param ms la durée en millisecondes.
+ */
+void RaSmartCar4WD::waitMillis(unsigned long ms)
+{
+  if(profiling)
+  {
+    blockedMillis += ms;
+  }
+
+  // Long waits are part of the modes: keep feeding the watchdog
+  while(ms > WATCHDOG_FEED_PERIOD)
+  {
+    feedWatchdog();
+    hw.delay(WATCHDOG_FEED_PERIOD);
+    ms -= WATCHDOG_FEED_PERIOD;
+  }
+  feedWatchdog();
+  hw.delay(ms);
+}
+
+/**
+ * @brief Définit le délai de maintien de la liaison (bluetooth en mode BT_MODE_RUN, télécommande
+ * infrarouge en mode BT_MODE_REMOTE) : si la voiture roule et qu'aucune commande valide n'est reçue
+ * pendant ce délai, les moteurs ralentissent jusqu'à l'arrêt en FAILSAFE_RAMP_TIME ms.
+ * Le pire délai entre la perte de la liaison et l'arrêt des roues est donc
+ * timeout + FAILSAFE_RAMP_TIME + la durée d'un tour de loop().
+ * 
+ * Attention : l'application doit alors répéter ses commandes tant qu'un bouton est appuyé.
+ * 
+ * @see Les méthodes getFailsafeReason, getTrip et enableWatchdog.
+ * 
+ * @param timeout le délai en millisecondes, 0 = pas de surveillance (par défaut).
+ */
+void RaSmartCar4WD::setLinkTimeout(unsigned long timeout)
+{
+  linkTimeout = timeout;
+}
+
+/**
+ * @brief Active le chien de garde matériel (AVR) : si la boucle principale reste bloquée plus de
+ * 500 ms sans appeler la méthode update, le microcontrôleur redémarre et la voiture est arrêtée.
+ * Les attentes des modes (évitement d'obstacles...) nourrissent le chien de garde ;
+ * les méthodes bloquantes comme breathLed ou checkTrack ne doivent plus être utilisées.
+ * 
+ * @param enable true = active le chien de garde.
+ */
+void RaSmartCar4WD::enableWatchdog(bool enable)
+{
+  watchdogEnabled = enable;
+  hw.enableWatchdog(enable);
+}
+
+/**
+ * @brief Récupère la cause du dernier arrêt de sécurité.
+ * 
+ * @return uint8_t FAILSAFE_NONE, FAILSAFE_LINK_BT, FAILSAFE_LINK_IR ou FAILSAFE_WATCHDOG
+ * (redémarrage par le chien de garde, détecté par la méthode init).
+ */
+uint8_t RaSmartCar4WD::getFailsafeReason()
+{
+  return failsafeReason;
+}
+
+/**
+ * @brief Récupère le nombre d'arrêts de sécurité depuis le démarrage.
+ * 
+ * @see La méthode getTrip.
+ * 
+ * @return unsigned int le nombre d'arrêts.
+ */
+unsigned int RaSmartCar4WD::getTripCount()
+{
+  return tripCount;
+}
+
+/**
+ * @brief Récupère un arrêt de sécurité du journal, qui garde les FAILSAFE_LOG_SIZE derniers.
+ * 
+ * @param index 0 = le plus récent.
+ * @return RaFailsafeTrip la cause et la date de l'arrêt, FAILSAFE_NONE au-delà du journal.
+ */
+RaFailsafeTrip RaSmartCar4WD::getTrip(uint8_t index)
+{
+  RaFailsafeTrip trip = {FAILSAFE_NONE, 0};
+
+  if(index < FAILSAFE_LOG_SIZE && index < tripCount)
+  {
+    trip = trips[(tripCount - 1 - index) % FAILSAFE_LOG_SIZE];
+  }
+  return trip;
+}
+
+/**
+ * @brief Mémorise la réception d'une commande valide sur une liaison : la rampe d'arrêt
+ * est abandonnée et la LED quitte le signal de perte de liaison.
+ * 
+ * @param link la liaison (LINK_BT ou LINK_IR).
+ */
+void RaSmartCar4WD::noteCommand(uint8_t link)
+{
+  lastCommand[link] = clockMillis();
+  failsafeRamping = false;
+  statusLed.cancel(LED_STATUS_LINK_LOST);
+}
+
+/**
+ * @brief Inscrit un arrêt de sécurité dans le journal.
+ * 
+ * @param reason la cause (FAILSAFE_*).
+ * @param now le temps courant en millisecondes.
+ */
+void RaSmartCar4WD::recordTrip(uint8_t reason, unsigned long now)
+{
+  failsafeReason = reason;
+  trips[tripCount % FAILSAFE_LOG_SIZE].reason = reason;
+  trips[tripCount % FAILSAFE_LOG_SIZE].time = now;
+  tripCount++;
+}
+
+/**
+ * @brief Nourrit le chien de garde matériel, s'il est actif.
+ */
+void RaSmartCar4WD::feedWatchdog()
+{
+  if(watchdogEnabled)
+  {
+    hw.feedWatchdog();
+  }
+}
+
+/**
+ * @brief Surveille la liaison du mode actif et ralentit les moteurs jusqu'à l'arrêt
+ * si aucune commande n'a été reçue à temps.
+ * 
+ * @param now le temps courant en millisecondes.
+ */
+void RaSmartCar4WD::updateFailsafe(unsigned long now)
+{
+  feedWatchdog();
+
+  if(failsafeRamping)
+  {
+    unsigned long elapsed = now - failsafeRampStart;
+
+    if(elapsed >= FAILSAFE_RAMP_TIME)
     {
-      goBackward();
+      failsafeRamping = false;
+      stop();
+      return;
     }
-    else if (rcHandler->isArrowLeft())
+
+    unsigned int remaining = FAILSAFE_RAMP_TIME - elapsed;
+    drive(motorDirection & MOTOR_LEFT_FORWARD ? HIGH : LOW, (failsafeLeftSpeed * remaining) >> FAILSAFE_RAMP_SHIFT,
+          motorDirection & MOTOR_RIGHT_FORWARD ? HIGH : LOW, (failsafeRightSpeed * remaining) >> FAILSAFE_RAMP_SHIFT);
+    return;
+  }
+
+  if(linkTimeout == 0 || (motorLeftSpeed == 0 && motorRightSpeed == 0))
+  {
+    return;
+  }
+
+  uint8_t link;
+  if(btMode == BT_MODE_RUN)
+  {
+    link = LINK_BT;
+  }
+  else if(btMode == BT_MODE_REMOTE)
+  {
+    link = LINK_IR;
+  }
+  else
+  {
+    return;
+  }
+
+  if(now - lastCommand[link] > linkTimeout)
+  {
+    recordTrip(link == LINK_BT ? FAILSAFE_LINK_BT : FAILSAFE_LINK_IR, now);
+    failsafeRamping = true;
+    failsafeRampStart = now;
+    failsafeLeftSpeed = motorLeftSpeed;
+    failsafeRightSpeed = motorRightSpeed;
+    statusLed.signal(LED_STATUS_LINK_LOST);
+    if(debug)
     {
-      turnLeft();
+      hw.serial().println("Link lost -> stop");
     }
-    else if (rcHandler->isArrowRight())
+  }
+}
+
+/**
+ * @brief Règle la luminosité de la matrice de LEDs et de la LED d'état.
+ * 
+ * @param level le niveau, de 0 (le plus sobre) à BRIGHTNESS_LEVELS - 1 (BRIGHTNESS_DEFAULT par défaut).
+ */
+void RaSmartCar4WD::setBrightness(uint8_t level)
+{
+  brightness = level < BRIGHTNESS_LEVELS ? level : BRIGHTNESS_LEVELS - 1;
+  if(!powerIdle)
+  {
+    applyBrightness(brightness);
+  }
+}
+
+/**
+ * @brief Active ou désactive l'économie d'énergie, pour une voiture qui reste allumée des heures.
+ * Après POWER_IDLE_DELAY ms à l'arrêt, la voiture se met en veille : luminosité au plus bas,
+ * servomoteur relâché, capteurs ultrason espacés (POWER_IDLE_RANGING_PERIOD, sauf dans les modes qui
+ * utilisent l'instantané des capteurs, comme le suivi de ligne avec garde) et microcontrôleur
+ * endormi entre deux tours de boucle (réveil par le timer, le port série, la télécommande ou les échos).
+ * Elle se réveille dès qu'un moteur tourne.
+ * 
+ * @param enable true = active l'économie d'énergie.
+ */
+void RaSmartCar4WD::setPowerSave(bool enable)
+{
+  unsigned long now = clockMillis();
+
+  powerSave = enable;
+  lastMotion = now;
+  if(!enable && powerIdle)
+  {
+    powerIdle = false;
+    applyBrightness(brightness);
+#if RA_USE_RANGING
+    updateRangingPeriod(now);
+#endif
+  }
+}
+
+/**
+ * @brief Indique si la voiture est en veille (voir setPowerSave).
+ * 
+ * @return bool true = en veille.
+ */
+bool RaSmartCar4WD::isPowerIdle()
+{
+  return powerIdle;
+}
+
+/**
+ * @brief Récupère l'estimation de la charge consommée par un sous-système depuis resetStats,
+ * calculée à partir des rapports cycliques (modèle POWER_CURRENT_*) quand le profilage est actif.
+ * 
+ * @param subsystem le sous-système (POWER_MCU, POWER_MOTORS, POWER_MATRIX, POWER_LED ou POWER_RANGING).
+ * @return unsigned long la charge en mA.s (3600 mA.s = 1 mAh).
+ */
+unsigned long RaSmartCar4WD::getEnergy(uint8_t subsystem)
+{
+  return subsystem < POWER_SUBSYSTEMS ? energy[subsystem] : 0;
+}
+
+/**
+ * @brief Écrit l'estimation de la consommation de chaque sous-système au format CSV :
+ * une ligne d'en-tête commençant par #, puis les charges en mA.s.
+ * 
+ * @param out le flux de sortie, par exemple Serial.
+ */
+void RaSmartCar4WD::printEnergy(Print& out)
+{
+  out.println("# mcu_mAs,motors_mAs,matrix_mAs,led_mAs,ranging_mAs");
+  for (int i = 0; i < POWER_SUBSYSTEMS; i++)
+  {
+    if(i)
     {
-      turnRight();
+      out.print(',');
     }
-    else if (rcHandler->isKeyOk())
+    out.print(energy[i]);
+  }
+  out.println();
+}
+
+/**
+ * @brief Applique un niveau de la table de luminosité à la matrice et à la LED d'état.
+ * 
+ * @param level le niveau.
+ */
+void RaSmartCar4WD::applyBrightness(uint8_t level)
+{
+  BrightnessLevel entry;
+
+  memcpy_P(&entry, &brightnessLevels[level], sizeof(BrightnessLevel));
+#if RA_USE_MATRIX
+  ledMatrix->setBrightness(entry.matrix);
+#endif
+  statusLed.setMaxLevel(entry.led);
+}
+
+/**
+ * @brief Gère la veille (voir setPowerSave) et la comptabilité de l'énergie.
+ * 
+ * @param now le temps courant en millisecondes.
+ */
+void RaSmartCar4WD::updatePower(unsigned long now)
+{
+  accountEnergy(now);
+
+  if(motorLeftSpeed || motorRightSpeed || !powerSave)
+  {
+    lastMotion = now;
+    if(powerIdle)
     {
-      stop();
+      powerIdle = false;
+      applyBrightness(brightness);
     }
-  
-    rcHandler->resume();
+#if RA_USE_RANGING
+    updateRangingPeriod(now);
+#endif
+    return;
+  }
+
+  if(!powerIdle && now - lastMotion >= POWER_IDLE_DELAY)
+  {
+    powerIdle = true;
+    applyBrightness(0);
+#if RA_USE_SERVO
+    // A servo holding its position draws current for nothing
+    servoHead.detach();
+#endif
+  }
+#if RA_USE_RANGING
+  updateRangingPeriod(now);
+#endif
+
+  if(powerIdle)
+  {
+    unsigned long before = hw.micros();
+    hw.idle();
+    sleptMicros += hw.micros() - before;
   }
-  delay(100);
-}
\ No newline at end of file
+}
+
+#if RA_USE_RANGING
+/**
+ * @brief Espace les tirs des capteurs ultrason en veille, sauf si le mode actif utilise l'instantané
+ * des capteurs : une distance périmée lui ferait ignorer les obstacles.
+ * 
+ * @param now le temps courant en millisecondes.
+ */
+void RaSmartCar4WD::updateRangingPeriod(unsigned long now)
+{
+  bool snapshot = pgm_read_byte(&modeTable[btMode].sensors) & SENSOR_RANGING;
+
+  ranging.setPeriod(powerIdle && !snapshot ? POWER_IDLE_RANGING_PERIOD : RANGING_PERIOD, now);
+}
+#endif
+
+/**
+ * @brief Ajoute à chaque sous-système la charge consommée depuis l'appel précédent, d'après
+ * les rapports cycliques courants (moteurs, matrice, LED), le nombre de tirs des capteurs ultrason
+ * et le temps passé en sommeil par le microcontrôleur. Seulement si le profilage est actif.
+ * 
+ * @param now le temps courant en millisecondes.
+ */
+void RaSmartCar4WD::accountEnergy(unsigned long now)
+{
+  unsigned long dt = now - energyTime;
+  unsigned long slept = sleptMicros / 1000;
+
+  energyTime = now;
+  sleptMicros -= slept * 1000;
+
+#if RA_USE_RANGING
+  unsigned long pings = ranging.getPingCount();
+  if(profiling)
+  {
+    // uAs per ping, over one second
+    addCharge(POWER_RANGING, (pings - energyPings) * POWER_CHARGE_PING, 1000);
+  }
+  energyPings = pings;
+#endif
+
+  if(!profiling || dt == 0)
+  {
+    return;
+  }
+  if(slept > dt)
+  {
+    slept = dt;
+  }
+
+  addCharge(POWER_MCU, POWER_CURRENT_MCU_ACTIVE, dt - slept);
+  addCharge(POWER_MCU, POWER_CURRENT_MCU_IDLE, slept);
+  addCharge(POWER_MOTORS, POWER_CURRENT_MOTOR / 255 * (unsigned long)(motorLeftSpeed + motorRightSpeed), dt);
+#if RA_USE_MATRIX
+  uint8_t matrixLevel = powerIdle ? 0 : pgm_read_byte(&brightnessLevels[brightness].matrix);
+  addCharge(POWER_MATRIX, POWER_CURRENT_MATRIX / (MATRIX_COLUMNS * MATRIX_ROWS * 16) * matrixLit
+            * pgm_read_byte(&matrixDuty[matrixLevel]), dt);
+#endif
+  addCharge(POWER_LED, POWER_CURRENT_LED / 255 * statusLed.getDuty(), dt);
+}
+
+/**
+ * @brief Ajoute au compteur d'un sous-système la charge d'un courant pendant une durée.
+ * 
+ * @param subsystem le sous-système.
+ * @param microamps le courant en uA.
+ * @param ms la durée en millisecondes.
+ */
+void RaSmartCar4WD::addCharge(uint8_t subsystem, unsigned long microamps, unsigned long ms)
+{
+  // uA * ms = nAs, by steps short enough not to overflow
+  while(ms)
+  {
+    unsigned long step = ms > 1000 ? 1000 : ms;
+    energyRemainder[subsystem] += microamps * step;
+    energy[subsystem] += energyRemainder[subsystem] / 1000000;
+    energyRemainder[subsystem] %= 1000000;
+    ms -= step;
+  }
+}
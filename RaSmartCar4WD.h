@@ -1,8 +1,14 @@
-#include <Arduino.h>
-#include <Servo.h>
-#include <RaKsRemoteControl.h>
-#include <LedMatrixAiP1640.h>
-#include <SR04.h>
+#ifndef RA_SMART_CAR_4WD_H
+#define RA_SMART_CAR_4WD_H
+
+#include <RaConfig.h>
+#include <RaHardware.h>
+#include <RaLedMatrix.h>
+#include <RaSensorTrace.h>
+#include <RaRangingArray.h>
+#include <RaMatrixAnimation.h>
+#include <RaStatusLed.h>
+#include <RaOccupancyGrid.h>
 
 // LED
 #define PIN_LED 9
@@ -19,9 +25,19 @@
 #define PIN_TRIGGER 12  
 #define PIN_ECHO 13
 
+// HC-SR04 array: {trigger, echo} pairs, front sensor first.
+// Add the rear/side sensors here, on free pins, e.g. {PIN_TRIGGER, PIN_ECHO}, {10, A0}
+// (D0/D1 are the serial port). update() fires them in every mode once there are several.
+#define RANGING_SENSOR_PINS {PIN_TRIGGER, PIN_ECHO}
+#define RANGING_FRONT 0
+
 // Remote Controle
 #define PIN_IR_RECEIVER 3
 
+// Serial port, shared with the Bluetooth module
+#define SERIAL_BAUD 9600
+#define TRACE_SERIAL_BAUD 115200 // while a trace is recorded on the serial port
+
 // Motors
 #define PIN_MOTOR_L_CTRL 4     // define the direction control pin of B motor
 #define PIN_MOTOR_L_PWM 5   //define the PWM control pin of B motor
@@ -38,66 +54,397 @@
 #define SPEED_MAX 255
 #define SPEED_STEP 10
 
+// Motor command
+#define MOTOR_LEFT_FORWARD 0x01
+#define MOTOR_RIGHT_FORWARD 0x02
+
+// Link supervision
+#define LINK_BT 0
+#define LINK_IR 1
+#define FAILSAFE_NONE 0
+#define FAILSAFE_LINK_BT 1
+#define FAILSAFE_LINK_IR 2
+#define FAILSAFE_WATCHDOG 3
+#define FAILSAFE_RAMP_SHIFT 7
+#define FAILSAFE_RAMP_TIME (1 << FAILSAFE_RAMP_SHIFT) // ms
+#define WATCHDOG_FEED_PERIOD 100 // ms, well below the 500 ms watchdog
+#define FAILSAFE_LOG_SIZE 4 // last trips kept
+
+// Brightness levels of the matrix and status LED (see the brightness table)
+#define BRIGHTNESS_LEVELS 5
+#define BRIGHTNESS_DEFAULT 2
+
+// Power save: stopped this long (ms), the car goes idle
+#define POWER_IDLE_DELAY 2000
+#define POWER_IDLE_RANGING_PERIOD 500 // ms between pings while idle, except in the modes using the snapshot
+
+// Energy accounting subsystems
+#define POWER_MCU 0
+#define POWER_MOTORS 1
+#define POWER_MATRIX 2
+#define POWER_LED 3
+#define POWER_RANGING 4
+#define POWER_SUBSYSTEMS 5
+
+// Current model (to calibrate on the car)
+#define POWER_CURRENT_MCU_ACTIVE 15000 // uA
+#define POWER_CURRENT_MCU_IDLE 6000    // uA
+#define POWER_CURRENT_MOTOR 300000     // uA per side at full PWM
+#define POWER_CURRENT_MATRIX 120000    // uA, all pixels lit at full pulse width
+#define POWER_CURRENT_LED 15000        // uA at full duty
+#define POWER_CHARGE_PING 150          // uAs per ping (~15 mA for 10 ms)
+
+#define BT_MODE_NONE 0
 #define BT_MODE_RUN 1
 #define BT_MODE_ANTI_DROP 2
 #define BT_MODE_LINE_TRACKING 3
 #define BT_MODE_AVOID 4
 #define BT_MODE_FOLLOWING 5
+#define BT_MODE_REMOTE 6
+#define BT_MODE_LINE_GUARDED 7
+#define BT_MODE_COUNT 8
+
+// Mode update periods (ms)
+#define MODE_PERIOD_LINE_TRACKING 0
+#define MODE_PERIOD_RANGING 60
+#define MODE_PERIOD_REMOTE 0
+
+// Sensor fusion sources
+#define SENSOR_TRACKING 0x01
+#define SENSOR_RANGING 0x02
+#define SENSOR_IR 0x04
+
+// Sensor fusion sampling period (ms), see RANGING_PERIOD for the ultrasonic sensors
+#define FUSION_PERIOD_TRACKING 1
+
+// Sensor fusion deadlines: a reading older than this (ms) is stale
+#define FUSION_DEADLINE_TRACKING 5
+#define FUSION_DEADLINE_RANGING 100
+#define FUSION_DEADLINE_IR 200
+
+// Line tracking with obstacle guard: stop distance (cm)
+#define LINE_GUARD_DISTANCE 15
+
+// Default control gains, in the RaControlGains field order
+#define GAINS_DEFAULT {100, 200, 70, 9, 8, 13, 35, LINE_GUARD_DISTANCE, 20, 100, 500, 300}
+
+// Control gains in EEPROM: magic, version, RaControlGains bytes, checksum
+#define GAINS_EEPROM_ADDRESS 0
+#define GAINS_MAGIC 0x47
+#define GAINS_VERSION 1
+
+// IR remote keys
+#define IR_KEY_NONE 0
+#define IR_KEY_UP 1
+#define IR_KEY_DOWN 2
+#define IR_KEY_LEFT 3
+#define IR_KEY_RIGHT 4
+#define IR_KEY_OK 5
+#define IR_KEY_STAR 6
+#define IR_KEY_SHARP 7
+#define IR_KEY_0 10 // IR_KEY_0 + n for the key n
+
+/**
+ * Instantané de l'état du monde vu par les capteurs, mis à jour par RaSmartCar4WD::update().
+ * Les dates sont en millisecondes (millis()).
+ */
+struct RaWorldState
+{
+  uint8_t leftTrack;
+  uint8_t middleTrack;
+  uint8_t rightTrack;
+  unsigned long trackTime;
+
+  long distance; // cm, -1 = unknown
+  unsigned long distanceTime;
+
+  uint8_t irKey; // IR_KEY_*, IR_KEY_NONE once consumed
+  unsigned long irTime;
+};
+
+/**
+ * Seuils et vitesses des modes automatiques (suivi de ligne, suivi d'objet, évitement d'obstacles).
+ * Les champs sont de largeur fixe, les octets seuls d'abord : la structure a la même représentation
+ * sur la carte et sur un ordinateur, elle peut être calculée par simulation puis chargée en EEPROM.
+ */
+struct RaControlGains
+{
+  uint8_t lineSpeed;          // line under the middle sensor
+  uint8_t lineTurnSpeed;      // line under a side sensor
+  uint8_t lineSearchSpeed;    // line lost: short forward nudge...
+  uint8_t lineSearchPulse;    // ...of this duration (ms)
+  uint8_t followBackDistance; // cm, closer: go backward
+  uint8_t followStopDistance; // cm, closer: stop
+  uint8_t followMaxDistance;  // cm, closer: go forward, farther: stop
+  uint8_t guardDistance;      // cm, guarded line tracking stop distance
+  uint8_t avoidDistance;      // cm, closer: look left and right
+  uint8_t avoidSettleTime;    // ms, pause before and after each look
+  uint16_t avoidLookTime;     // ms, servo travel before a look
+  uint16_t avoidTurnTime;     // ms, turn towards the free side
+};
+
+/**
+ * Arrêt de sécurité, mémorisé dans le journal de RaSmartCar4WD (getTrip).
+ */
+struct RaFailsafeTrip
+{
+  uint8_t reason;     // FAILSAFE_*
+  unsigned long time; // ms (millis()), 0 for a watchdog reset found at startup
+};
+
+/**
+ * Mesures du coût d'un mode, relevées par RaSmartCar4WD::updateMode() quand le profilage est actif.
+ */
+struct RaModeStats
+{
+  unsigned long calls;
+  unsigned long totalMicros;
+  unsigned long maxMicros;
+};
 
 class RaSmartCar4WD
 {
 private:
+  RaHardware hw;
+#if RA_USE_DEBUG
   bool debug;
+#else
+  static const bool debug = false; // debug messages compiled out
+#endif
+#if RA_USE_RANGING
   int distanceUnit;
+  unsigned int distanceScale;
+  unsigned int maxDistance;
+  unsigned long distanceTimeout;
+  RaRangingArray ranging;
+  long lastDistance;
+  unsigned long lastDistanceTime;
+#endif
   int speed;
-  Servo servoHead;
-  RaKsRemoteControl* rcHandler;
-  LedMatrixAiP1640* ledMatrix;
-  SR04* distSensor;
+#if RA_USE_SERVO
+  RaHardware::ServoType servoHead;
+  int servoAngle;
+#endif
+#if RA_USE_IR
+  RaHardware::RemoteType* rcHandler;
+#endif
+#if RA_USE_MATRIX
+  RaHardware::MatrixType* ledMatrix;
   bool showSymbols;
+#endif
   int btMode;
+  unsigned long modeLastUpdate;
+
+  // Modes
+  typedef void (RaSmartCar4WD::*ModeHook)();
+  struct ModeEntry
+  {
+    ModeHook enter;
+    ModeHook update;
+    ModeHook exit;
+    unsigned int period;
+    uint8_t sensors;
+  };
+  static const ModeEntry modeTable[BT_MODE_COUNT];
+
+  void exitMovingMode();
+  void updateGuardedLineMode();
+#if RA_USE_SERVO && RA_USE_RANGING
+  void enterAvoidMode();
+  void exitAvoidMode();
+#endif
+#if RA_USE_IR
+  void updateRemoteMode();
+#endif
+#if RA_USE_BLUETOOTH
+  void handleBluetoothCommand(char btVal);
+#endif
+
+  // Control gains
+  RaControlGains gains;
+
+#if RA_USE_GRID
+  // Occupancy grid
+  RaOccupancyGrid grid;
+  int headBearing();
+#endif
+
+  // Sensor fusion
+  RaWorldState world;
+  unsigned long trackingNext;
+  void updateWorld(uint8_t sensors);
+#if RA_USE_IR
+  int readRemoteKey();
+  int pollRemoteKey();
+#endif
+  void trackLine(int left, int middle, int right);
+
+  // Sensor trace
+  RaSensorTrace trace;
+  bool traceOnSerial;
+  unsigned long clockMillis();
+#if RA_USE_BLUETOOTH
+  int readSerialCommand();
+#endif
+#if RA_USE_RANGING
+  long readDistanceSensor();
+#endif
+
+  // Profiling
+  bool profiling;
+  RaModeStats modeStats[BT_MODE_COUNT];
+  unsigned long blockedMillis;
+  unsigned long matrixFrames;
+  void waitMillis(unsigned long ms);
+
+  // Wheels control
+  uint8_t motorDirection;
+  uint8_t motorLeftSpeed;
+  uint8_t motorRightSpeed;
+  void drive(uint8_t leftDirection, int leftSpeed, uint8_t rightDirection, int rightSpeed);
+
+  // Link supervision
+  unsigned long linkTimeout;
+  unsigned long lastCommand[2];
+  uint8_t failsafeReason;
+  RaFailsafeTrip trips[FAILSAFE_LOG_SIZE];
+  unsigned int tripCount;
+  bool failsafeRamping;
+  unsigned long failsafeRampStart;
+  unsigned int failsafeLeftSpeed;
+  unsigned int failsafeRightSpeed;
+  bool watchdogEnabled;
+  void noteCommand(uint8_t link);
+  void recordTrip(uint8_t reason, unsigned long now);
+  void feedWatchdog();
+  void updateFailsafe(unsigned long now);
+
+  // Power management
+  uint8_t brightness;
+  bool powerSave;
+  bool powerIdle;
+  unsigned long lastMotion;
+  unsigned long energy[POWER_SUBSYSTEMS];          // mAs
+  unsigned long energyRemainder[POWER_SUBSYSTEMS]; // nAs
+  unsigned long energyTime;
+  unsigned long sleptMicros;
+#if RA_USE_RANGING
+  unsigned long energyPings;
+#endif
+#if RA_USE_MATRIX
+  uint8_t matrixLit;
+#endif
+  void applyBrightness(uint8_t level);
+  void updatePower(unsigned long now);
+#if RA_USE_RANGING
+  void updateRangingPeriod(unsigned long now);
+#endif
+  void accountEnergy(unsigned long now);
+  void addCharge(uint8_t subsystem, unsigned long microamps, unsigned long ms);
+
+  // LED
+  RaStatusLed statusLed;
 
+#if RA_USE_MATRIX
+  // LED Matrix
+  RaMatrixAnimation animation;
+  void pushFrame(unsigned char entries[]);
+  void flushFrame();
+#endif
 
 public:
   RaSmartCar4WD();
 
   // Init
   void init();
+  RaHardware& getHardware();
 
   // Debug
   void setDebug(bool dbg);
 
+#if RA_USE_SERVO
   // Servo
   void setServoAnglePWM(int iAngle);
   void setServoAngle(int iAngle);
-  
+  void calibrateServo();
+  int getServoAngle();
+#endif
+
   // LED
   void switchLed(bool status);
   void blinkLed(int iDelay);
   void breathLed();
+  void setLedStatus(uint8_t status);
+  uint8_t getLedStatus();
 
   // Tracking sensor
   int getLeftTrack();
   int getMiddleTrack();
   int getRightTrack();
+#if RA_USE_DEBUG
   void checkTrack();
+#endif
 
-  // Servo
-  void calibrateServo();
-
+#if RA_USE_RANGING
   // Ultrasonic sensor
   void setDistanceUnit(int unit);
   float getDistance();
+  long getDistanceTenths();
+  void setMaxDistance(unsigned int mm);
   void enableFollowMovingObjects();
+#if RA_USE_SERVO
   void enableAvoidObstacles();
+#endif
+#endif
 
+#if RA_USE_IR
   // IR Remote Control
+#if RA_USE_DEBUG
   void checkRemoteControl();
+#endif
   void handleRemoteControl();
+#endif
 
+#if RA_USE_BLUETOOTH
   // Bluetooth
+#if RA_USE_DEBUG
   void debugBluetooth();
+#endif
   void enableBluetoothControl();
+#endif
+
+  // Modes
+  void setMode(int mode);
+  int getMode();
+  void updateMode();
+  void update();
+  const RaWorldState& getWorld();
+#if RA_USE_RANGING
+  RaRangingArray& getRangingArray();
+#endif
+#if RA_USE_GRID
+  RaOccupancyGrid& getGrid();
+#endif
+
+  // Sensor trace
+  void startTraceRecording(Print& out);
+  bool startTraceReplay(Stream& in);
+  void stopTrace();
+
+  // Control gains
+  void setGains(const RaControlGains& newGains);
+  const RaControlGains& getGains();
+  void resetGains();
+  bool loadGains(int address = GAINS_EEPROM_ADDRESS);
+  void saveGains(int address = GAINS_EEPROM_ADDRESS);
+  void printGains(Print& out);
+
+  // Profiling
+  void setProfiling(bool enable);
+  void resetStats();
+  void printStats(Print& out);
+  const RaModeStats& getModeStats(int mode);
+  unsigned long getBlockedMillis();
 
   // Wheels control
   void setSpeed(int iSpeed);
@@ -111,6 +458,21 @@ public:
   void turnRight(int iSpeed);
   void stop();
 
+  // Power management
+  void setBrightness(uint8_t level);
+  void setPowerSave(bool enable);
+  bool isPowerIdle();
+  unsigned long getEnergy(uint8_t subsystem);
+  void printEnergy(Print& out);
+
+  // Link supervision
+  void setLinkTimeout(unsigned long timeout);
+  void enableWatchdog(bool enable);
+  uint8_t getFailsafeReason();
+  unsigned int getTripCount();
+  RaFailsafeTrip getTrip(uint8_t index);
+
+#if RA_USE_MATRIX
   // LED Matrix
   void setShowSymbols(bool iShow);
   void display(unsigned char entries[]);
@@ -122,7 +484,15 @@ public:
   void displayBackward();
   void displayStop();
   void clearDisplay();
+  void setMatrixAsync(bool async);
+  void scrollText(const char* text);
+  void playAnimation(const uint8_t* progmemFrames, uint8_t count, unsigned int framePeriod, bool loop);
+  void stopAnimation();
+  RaMatrixAnimation& getAnimation();
+#endif
 
   // Line tracking
   void enableLineTracking();
 };
+
+#endif
@@ -0,0 +1,342 @@
+#include <RaStatusLed.h>
+
+#if LED_STATUS_ISR
+static RaStatusLed* modulatedLed;
+
+// Timer 0 runs millis(): its compare A match happens every cycle whatever OCR0A holds.
+// A few cycles per call, nothing waits: the other interrupts (IR, echoes) are not delayed.
+ISR(TIMER0_COMPA_vect)
+{
+  if(modulatedLed)
+  {
+    modulatedLed->modulate();
+  }
+}
+#endif
+
+/**
+ * Table de correction gamma (2,2) : LED_GAMMA_STEPS niveaux perçus vers un rapport cyclique 0-255.
+ */
+static const uint8_t gammaTable[LED_GAMMA_STEPS] PROGMEM = {
+  0, 0, 0, 0, 1, 1, 1, 2, 3, 4, 4, 5, 7, 8, 9, 11,
+  13, 14, 16, 18, 20, 23, 25, 28, 31, 33, 36, 40, 43, 46, 50, 54,
+  57, 61, 66, 70, 74, 79, 84, 89, 94, 99, 105, 110, 116, 122, 128, 134,
+  140, 147, 153, 160, 167, 174, 182, 189, 197, 205, 213, 221, 229, 238, 246, 255
+};
+
+struct LedPattern
+{
+  uint8_t pattern;
+  unsigned int period; // ms
+  uint8_t pulses;
+  bool oneShot;
+};
+
+/**
+ * Motif de chaque état, indexé par les constantes LED_STATUS_*.
+ */
+static const LedPattern statusPatterns[LED_STATUS_COUNT] PROGMEM = {
+  {LED_PATTERN_OFF, 0, 0, false},       // LED_STATUS_OFF
+  {LED_PATTERN_BREATHE, 3000, 0, false}, // LED_STATUS_READY
+  {LED_PATTERN_ON, 0, 0, false},        // LED_STATUS_RUNNING
+  {LED_PATTERN_PULSES, 600, 2, true},   // LED_STATUS_MODE_CHANGED
+  {LED_PATTERN_PULSES, 2000, 3, false}, // LED_STATUS_LOW_BATTERY
+  {LED_PATTERN_BLINK, 400, 0, false},   // LED_STATUS_LINK_LOST
+  {LED_PATTERN_BLINK, 150, 0, false}    // LED_STATUS_ERROR
+};
+
+/**
+ * Constructeur de la classe RaStatusLed. Le voyant est inactif (LED_STATUS_OFF).
+ */
+RaStatusLed::RaStatusLed()
+{
+  hw = NULL;
+  pin = 0;
+  pwm = false;
+  status = LED_STATUS_OFF;
+  baseStatus = LED_STATUS_OFF;
+  start = 0;
+  started = false;
+  level = -1;
+  error = 0;
+  maxLevel = 255;
+  duty = 0;
+}
+
+/**
+ * @brief Associe le voyant à une broche.
+ *
+ * @param hardware la couche matérielle.
+ * @param ledPin la broche de la LED (déjà configurée en sortie).
+ * @param usePwm true si la broche peut utiliser analogWrite, false pour la modulation sigma-delta.
+ */
+void RaStatusLed::begin(RaHardware& hardware, uint8_t ledPin, bool usePwm)
+{
+  hw = &hardware;
+  pin = ledPin;
+  pwm = usePwm;
+#if LED_STATUS_ISR
+  pinToggle = portInputRegister(digitalPinToPort(pin));
+  pinMask = digitalPinToBitMask(pin);
+  pinOn = false;
+  enableModulation(!pwm && status != LED_STATUS_OFF);
+#endif
+}
+
+/**
+ * @brief Définit l'état affiché en permanence par le voyant.
+ * LED_STATUS_OFF rend la main : la LED n'est plus pilotée par le voyant.
+ *
+ * @param newStatus l'état (constantes LED_STATUS_*).
+ */
+void RaStatusLed::setStatus(uint8_t newStatus)
+{
+  if (newStatus >= LED_STATUS_COUNT)
+  {
+    return;
+  }
+  baseStatus = newStatus;
+  status = newStatus;
+  started = false;
+  if (status == LED_STATUS_OFF && hw)
+  {
+    write(0);
+  }
+#if LED_STATUS_ISR
+  if (hw && !pwm)
+  {
+    enableModulation(status != LED_STATUS_OFF);
+  }
+#endif
+}
+
+/**
+ * @brief Joue une fois le motif d'un événement (par exemple LED_STATUS_MODE_CHANGED),
+ * puis revient à l'état permanent. Sans effet si le voyant est inactif.
+ *
+ * @param event l'événement (constantes LED_STATUS_*).
+ */
+void RaStatusLed::signal(uint8_t event)
+{
+  if (baseStatus == LED_STATUS_OFF || event >= LED_STATUS_COUNT)
+  {
+    return;
+  }
+  status = event;
+  started = false;
+}
+
+/**
+ * @brief Interrompt le motif d'un événement s'il est en cours (par exemple LED_STATUS_LINK_LOST,
+ * qui clignote jusqu'au retour de la liaison) et revient à l'état permanent.
+ *
+ * @param event l'événement (constantes LED_STATUS_*).
+ */
+void RaStatusLed::cancel(uint8_t event)
+{
+  if (status == event && status != baseStatus)
+  {
+    status = baseStatus;
+    started = false;
+  }
+}
+
+/**
+ * @brief Récupère l'état affiché.
+ *
+ * @return uint8_t l'état (constantes LED_STATUS_*).
+ */
+uint8_t RaStatusLed::getStatus()
+{
+  return status;
+}
+
+/**
+ * @brief Indique si le voyant pilote la LED.
+ *
+ * @return bool true = un état autre que LED_STATUS_OFF est affiché.
+ */
+bool RaStatusLed::isActive()
+{
+  return baseStatus != LED_STATUS_OFF;
+}
+
+/**
+ * @brief Limite la luminosité de la LED : tous les motifs sont mis à l'échelle.
+ *
+ * @param max le rapport cyclique maximal (255 = pleine luminosité).
+ */
+void RaStatusLed::setMaxLevel(uint8_t max)
+{
+  maxLevel = max;
+}
+
+/**
+ * @brief Récupère le rapport cyclique appliqué à la LED, pour estimer sa consommation.
+ *
+ * @return uint8_t le rapport cyclique (0-255).
+ */
+uint8_t RaStatusLed::getDuty()
+{
+  return duty;
+}
+
+/**
+ * @brief Met à jour la luminosité de la LED. Ne bloque jamais : à appeler à chaque tour de boucle.
+ *
+ * @param now le temps courant en millisecondes.
+ */
+void RaStatusLed::tick(unsigned long now)
+{
+  LedPattern entry;
+
+  if (status == LED_STATUS_OFF || !hw)
+  {
+    return;
+  }
+
+  if (!started)
+  {
+    start = now;
+    started = true;
+  }
+
+  memcpy_P(&entry, &statusPatterns[status], sizeof(LedPattern));
+  unsigned long elapsed = now - start;
+
+  if (entry.oneShot && elapsed >= entry.period)
+  {
+    status = baseStatus;
+    started = false;
+    return;
+  }
+
+  write(computeLevel(elapsed, entry.pattern, entry.period, entry.pulses));
+}
+
+/**
+ * @brief Calcule la luminosité d'un motif à un instant donné.
+ *
+ * @param elapsed le temps écoulé depuis le début du motif, en millisecondes.
+ * @param pattern le motif (constantes LED_PATTERN_*).
+ * @param period la période du motif en millisecondes.
+ * @param pulses le nombre d'impulsions (LED_PATTERN_PULSES).
+ * @return uint8_t le rapport cyclique (0-255).
+ */
+uint8_t RaStatusLed::computeLevel(unsigned long elapsed, uint8_t pattern, unsigned int period, uint8_t pulses)
+{
+  unsigned int phase;
+  unsigned int half;
+
+  switch (pattern)
+  {
+  case LED_PATTERN_ON:
+    return 255;
+
+  case LED_PATTERN_BLINK:
+    return elapsed % period < period / 2 ? 255 : 0;
+
+  case LED_PATTERN_BREATHE:
+    phase = elapsed % period;
+    half = period / 2;
+    if (phase >= half)
+    {
+      phase = period - phase;
+    }
+    return pgm_read_byte(&gammaTable[(unsigned long)phase * (LED_GAMMA_STEPS - 1) / half]);
+
+  case LED_PATTERN_PULSES:
+  {
+    // 2 slots per pulse (on, off) followed by a 2-slot pause
+    unsigned int slot = period / (2 * pulses + 2);
+    unsigned int index = (elapsed % period) / slot;
+    return index < 2 * pulses && !(index & 1) ? 255 : 0;
+  }
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Applique un rapport cyclique à la LED (limité par setMaxLevel), par PWM ou par modulation sigma-delta.
+ * La broche n'est écrite que si sa valeur change.
+ *
+ * @param value le rapport cyclique (0-255).
+ */
+void RaStatusLed::write(uint8_t value)
+{
+  value = ((unsigned int)value * maxLevel + 255) >> 8;
+  duty = value;
+
+  if (pwm)
+  {
+    if (value != level)
+    {
+      hw->analogWrite(pin, value);
+      level = value;
+    }
+    return;
+  }
+
+#if !LED_STATUS_ISR
+  uint8_t out = LOW;
+  error += value;
+  if (error >= 255)
+  {
+    error -= 255;
+    out = HIGH;
+  }
+  if (out != level)
+  {
+    hw->digitalWrite(pin, out);
+    level = out;
+  }
+#endif
+}
+
+#if LED_STATUS_ISR
+/**
+ * @brief Branche ou débranche l'interruption de modulation ; débranchée, la LED est éteinte
+ * et rendue aux autres méthodes.
+ *
+ * @param enable true = la LED est modulée par l'interruption.
+ */
+void RaStatusLed::enableModulation(bool enable)
+{
+  if (enable)
+  {
+    modulatedLed = this;
+    TIFR0 = _BV(OCF0A);
+    TIMSK0 |= _BV(OCIE0A);
+    return;
+  }
+  if (modulatedLed == this)
+  {
+    TIMSK0 &= ~_BV(OCIE0A);
+    modulatedLed = NULL;
+    pinOn = false;
+    hw->digitalWrite(pin, LOW);
+  }
+}
+
+/**
+ * @brief Module la LED d'après le rapport cyclique courant, appelée par l'interruption
+ * à chaque cycle du timer 0 (1024 µs). Chaque front est une seule écriture dans le registre PINx.
+ */
+void RaStatusLed::modulate()
+{
+  bool out;
+
+  error += duty;
+  out = error >= 255;
+  if (out)
+  {
+    error -= 255;
+  }
+  if (out != pinOn)
+  {
+    *pinToggle = pinMask;
+    pinOn = out;
+  }
+}
+#endif
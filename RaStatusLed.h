@@ -0,0 +1,85 @@
+#ifndef RA_STATUS_LED_H
+#define RA_STATUS_LED_H
+
+#include <RaHardware.h>
+
+// Patterns
+#define LED_PATTERN_OFF 0
+#define LED_PATTERN_ON 1
+#define LED_PATTERN_BLINK 2
+#define LED_PATTERN_BREATHE 3
+#define LED_PATTERN_PULSES 4
+
+// Statuses
+#define LED_STATUS_OFF 0
+#define LED_STATUS_READY 1
+#define LED_STATUS_RUNNING 2
+#define LED_STATUS_MODE_CHANGED 3
+#define LED_STATUS_LOW_BATTERY 4
+#define LED_STATUS_LINK_LOST 5
+#define LED_STATUS_ERROR 6
+#define LED_STATUS_COUNT 7
+
+#define LED_GAMMA_STEPS 64
+
+// Modulation from the Timer 0 compare A interrupt (AVR), when the pin has no PWM
+#if defined(__AVR__) && defined(OCIE0A)
+#define LED_STATUS_ISR 1
+#else
+#define LED_STATUS_ISR 0
+#endif
+
+/**
+ * Voyant d'état sur une LED : chaque état (LED_STATUS_*) correspond à un motif (clignotement,
+ * respiration, série d'impulsions) décrit dans une table en mémoire flash. La luminosité passe
+ * par une table de correction gamma, elle aussi en flash.
+ *
+ * La méthode tick() calcule la luminosité à partir du temps, sans jamais attendre. Si la broche
+ * ne dispose pas de PWM (par exemple la broche 9 d'un Uno dont le timer 1 sert au servomoteur),
+ * la luminosité est rendue par modulation sigma-delta : sur AVR, par l'interruption de comparaison A
+ * du timer 0 (environ 1 kHz, sans changer OCR0A ni la PWM de la broche 6), qui continue pendant les
+ * attentes de la boucle principale ; ailleurs, à chaque appel de tick(). L'interruption n'attend
+ * jamais : au plus une écriture de la broche par cycle.
+ */
+class RaStatusLed
+{
+private:
+  RaHardware* hw;
+  uint8_t pin;
+  bool pwm;
+  uint8_t status;
+  uint8_t baseStatus;
+  unsigned long start;
+  bool started;
+  int level;
+  unsigned int error;
+  uint8_t maxLevel;
+  volatile uint8_t duty;
+#if LED_STATUS_ISR
+  volatile uint8_t* pinToggle; // PINx
+  uint8_t pinMask;
+  bool pinOn;
+  void enableModulation(bool enable);
+#endif
+
+  uint8_t computeLevel(unsigned long elapsed, uint8_t pattern, unsigned int period, uint8_t pulses);
+  void write(uint8_t value);
+
+public:
+  RaStatusLed();
+
+  void begin(RaHardware& hardware, uint8_t ledPin, bool usePwm);
+  void setStatus(uint8_t newStatus);
+  void signal(uint8_t event);
+  void cancel(uint8_t event);
+  uint8_t getStatus();
+  bool isActive();
+  void setMaxLevel(uint8_t max);
+  uint8_t getDuty();
+  void tick(unsigned long now);
+#if LED_STATUS_ISR
+  void modulate();
+#endif
+};
+
+#endif
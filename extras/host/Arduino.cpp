@@ -0,0 +1,224 @@
+#include <Arduino.h>
+#include <stdio.h>
+
+static std::string toText(unsigned long value, unsigned char base, bool negative)
+{
+  char digits[sizeof(unsigned long) * 8 + 2];
+  char* end = digits + sizeof(digits) - 1;
+  char* p = end;
+
+  if(base < 2)
+  {
+    base = DEC;
+  }
+  *p = '\0';
+  do
+  {
+    unsigned long digit = value % base;
+    *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    value /= base;
+  } while(value);
+  if(negative)
+  {
+    *--p = '-';
+  }
+  return std::string(p, end);
+}
+
+String::String(const char* value) : text(value ? value : "")
+{
+}
+
+String::String(char value) : text(1, value)
+{
+}
+
+String::String(int value, unsigned char base) : String((long)value, base)
+{
+}
+
+String::String(unsigned int value, unsigned char base) : String((unsigned long)value, base)
+{
+}
+
+String::String(long value, unsigned char base)
+{
+  bool negative = value < 0 && base == DEC;
+  text = toText(negative ? 0UL - (unsigned long)value : (unsigned long)value, base, negative);
+}
+
+String::String(unsigned long value, unsigned char base) : text(toText(value, base, false))
+{
+}
+
+String& String::operator+=(const String& other)
+{
+  text += other.text;
+  return *this;
+}
+
+String operator+(const String& left, const String& right)
+{
+  String result(left);
+  result += right;
+  return result;
+}
+
+bool String::operator==(const String& other) const
+{
+  return text == other.text;
+}
+
+const char* String::c_str() const
+{
+  return text.c_str();
+}
+
+unsigned int String::length() const
+{
+  return text.length();
+}
+
+size_t Print::write(const char* text)
+{
+  return text ? write((const uint8_t*)text, strlen(text)) : 0;
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size)
+{
+  size_t n = 0;
+  while(size--)
+  {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::printNumber(unsigned long value, uint8_t base)
+{
+  return write(toText(value, base, false).c_str());
+}
+
+size_t Print::print(const char* text)
+{
+  return write(text);
+}
+
+size_t Print::print(const String& text)
+{
+  return write(text.c_str());
+}
+
+size_t Print::print(char value)
+{
+  return write((uint8_t)value);
+}
+
+size_t Print::print(unsigned char value, int base)
+{
+  return printNumber(value, base);
+}
+
+size_t Print::print(int value, int base)
+{
+  return print((long)value, base);
+}
+
+size_t Print::print(unsigned int value, int base)
+{
+  return printNumber(value, base);
+}
+
+size_t Print::print(long value, int base)
+{
+  if(base == DEC && value < 0)
+  {
+    return write('-') + printNumber(0UL - (unsigned long)value, DEC);
+  }
+  return printNumber(value, base);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+  return printNumber(value, base);
+}
+
+size_t Print::print(double value, int digits)
+{
+  char text[48];
+  snprintf(text, sizeof(text), "%.*f", digits, value);
+  return write(text);
+}
+
+size_t Print::println()
+{
+  return write("\r\n");
+}
+
+size_t Print::println(const char* text)
+{
+  return print(text) + println();
+}
+
+size_t Print::println(const String& text)
+{
+  return print(text) + println();
+}
+
+size_t Print::println(char value)
+{
+  return print(value) + println();
+}
+
+size_t Print::println(unsigned char value, int base)
+{
+  return print(value, base) + println();
+}
+
+size_t Print::println(int value, int base)
+{
+  return print(value, base) + println();
+}
+
+size_t Print::println(unsigned int value, int base)
+{
+  return print(value, base) + println();
+}
+
+size_t Print::println(long value, int base)
+{
+  return print(value, base) + println();
+}
+
+size_t Print::println(unsigned long value, int base)
+{
+  return print(value, base) + println();
+}
+
+size_t Print::println(double value, int digits)
+{
+  return print(value, digits) + println();
+}
+
+/**
+ * @brief Lit les octets disponibles, sans attente : sur l'ordinateur, le flux est déjà rempli.
+ */
+size_t Stream::readBytes(char* buffer, size_t length)
+{
+  size_t n = 0;
+  while(n < length)
+  {
+    int value = read();
+    if(value < 0)
+    {
+      break;
+    }
+    buffer[n++] = (char)value;
+  }
+  return n;
+}
+
+size_t Stream::readBytes(uint8_t* buffer, size_t length)
+{
+  return readBytes((char*)buffer, length);
+}
@@ -0,0 +1,149 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+/*
+ * Minimal Arduino core for the host build (RA_HOST): the types, constants and classes the
+ * library uses besides the hardware layer. Pins, time and devices are simulated by RaHostHardware,
+ * not here: this file has no global state.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <type_traits>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define NOT_A_PIN 0
+
+// Uno analog pins
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// Flash memory is ordinary memory on the host
+#define PROGMEM
+#define F(text) (text)
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+#define pgm_read_dword(address) (*(const uint32_t*)(address))
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+// Functions rather than the core's macros, so that standard headers still compile
+template <typename A, typename B>
+inline auto min(A a, B b) -> typename std::common_type<A, B>::type
+{
+  return a < b ? a : b;
+}
+
+template <typename A, typename B>
+inline auto max(A a, B b) -> typename std::common_type<A, B>::type
+{
+  return a > b ? a : b;
+}
+
+template <typename T, typename L, typename H>
+inline T constrain(T value, L low, H high)
+{
+  return value < low ? low : (value > high ? high : value);
+}
+
+/**
+ * Chaîne de caractères, réduite à ce que la bibliothèque utilise (construction et concaténation).
+ */
+class String
+{
+private:
+  std::string text;
+
+public:
+  String(const char* value = "");
+  String(char value);
+  String(int value, unsigned char base = DEC);
+  String(unsigned int value, unsigned char base = DEC);
+  String(long value, unsigned char base = DEC);
+  String(unsigned long value, unsigned char base = DEC);
+
+  String& operator+=(const String& other);
+  friend String operator+(const String& left, const String& right);
+  bool operator==(const String& other) const;
+
+  const char* c_str() const;
+  unsigned int length() const;
+};
+
+/**
+ * Sortie de texte : toutes les méthodes print passent par write(uint8_t).
+ */
+class Print
+{
+private:
+  size_t printNumber(unsigned long value, uint8_t base);
+
+public:
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t value) = 0;
+  size_t write(const char* text);
+  virtual size_t write(const uint8_t* buffer, size_t size);
+
+  size_t print(const char* text);
+  size_t print(const String& text);
+  size_t print(char value);
+  size_t print(unsigned char value, int base = DEC);
+  size_t print(int value, int base = DEC);
+  size_t print(unsigned int value, int base = DEC);
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned long value, int base = DEC);
+  size_t print(double value, int digits = 2);
+
+  size_t println();
+  size_t println(const char* text);
+  size_t println(const String& text);
+  size_t println(char value);
+  size_t println(unsigned char value, int base = DEC);
+  size_t println(int value, int base = DEC);
+  size_t println(unsigned int value, int base = DEC);
+  size_t println(long value, int base = DEC);
+  size_t println(unsigned long value, int base = DEC);
+  size_t println(double value, int digits = 2);
+};
+
+/**
+ * Flux d'entrée et de sortie (port série, fichier de trace...).
+ */
+class Stream : public Print
+{
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  size_t readBytes(char* buffer, size_t length);
+  size_t readBytes(uint8_t* buffer, size_t length);
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include <chrono>
+#include <RaSimFleet.h>
+
+/**
+ * Constructeur de la classe RaSimFleet : une flotte vide.
+ *
+ * @param threads la réserve de threads qui fait les courses.
+ */
+RaSimFleet::RaSimFleet(RaSimPool& threads) : pool(threads)
+{
+  wallSeconds = 0;
+}
+
+void RaSimFleet::clear()
+{
+  cars.clear();
+  wallSeconds = 0;
+}
+
+/**
+ * @brief Ajoute une voiture.
+ *
+ * @param scenario son parcours (copié : sa durée peut être changée).
+ * @param gains ses réglages.
+ * @param seed sa graine.
+ */
+void RaSimFleet::add(const RaSimScenario& scenario, const RaControlGains& gains, unsigned long seed)
+{
+  RaSimCar car;
+
+  memset(&car, 0, sizeof(car));
+  car.scenario = scenario;
+  car.gains = gains;
+  car.seed = seed;
+  cars.push_back(car);
+}
+
+void RaSimFleet::runCar(void* context, int index)
+{
+  RaSimCar& car = ((RaSimFleet*)context)->cars[index];
+
+  car.result = RaSimulator::run(car.scenario, car.gains, car.seed);
+}
+
+/**
+ * @brief Fait la course de toutes les voitures, en parallèle sur les threads de la réserve.
+ */
+void RaSimFleet::run()
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  pool.run(cars.size(), runCar, this);
+  wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int RaSimFleet::getCarCount()
+{
+  return cars.size();
+}
+
+const RaSimCar& RaSimFleet::getCar(int index)
+{
+  return cars[index];
+}
+
+/**
+ * @brief Agrège les mesures des voitures après run() : collisions, tours, latence de la boucle,
+ * et débit de la simulation (carSeconds / wallSeconds).
+ *
+ * @return RaSimFleetStats les mesures agrégées.
+ */
+RaSimFleetStats RaSimFleet::getStats()
+{
+  RaSimFleetStats stats;
+  unsigned long long lapSum = 0;
+  unsigned long long latencySum = 0;
+  unsigned long long loops = 0;
+
+  memset(&stats, 0, sizeof(stats));
+  stats.cars = cars.size();
+  stats.wallSeconds = wallSeconds;
+  for (size_t i = 0; i < cars.size(); i++)
+  {
+    const RaSimResult& result = cars[i].result;
+
+    stats.carSeconds += cars[i].scenario.duration / 1000.0;
+    stats.collisions += result.collisions;
+    stats.carsWithCollision += result.collisions > 0;
+    stats.blockedMillis += result.blockedMillis;
+    if (result.laps)
+    {
+      stats.bestLapMillis = stats.laps ? min(stats.bestLapMillis, result.bestLapMillis) : result.bestLapMillis;
+      stats.worstLapMillis = max(stats.worstLapMillis, result.meanLapMillis);
+      stats.laps += result.laps;
+      lapSum += (unsigned long long)result.meanLapMillis * result.laps;
+    }
+    latencySum += (unsigned long long)result.loopMeanMicros * result.loops;
+    loops += result.loops;
+    stats.loopMaxMicros = max(stats.loopMaxMicros, result.loopMaxMicros);
+  }
+  stats.meanLapMillis = stats.laps ? lapSum / stats.laps : 0;
+  stats.loopMeanMicros = loops ? latencySum / loops : 0;
+  return stats;
+}
+
+/**
+ * @brief Compare les mesures de deux flottes, voiture par voiture (hors durées réelles).
+ *
+ * @param other l'autre flotte, avec les mêmes voitures.
+ * @return bool true si toutes les mesures sont identiques.
+ */
+bool RaSimFleet::matches(RaSimFleet& other)
+{
+  if (cars.size() != other.cars.size())
+  {
+    return false;
+  }
+  for (size_t i = 0; i < cars.size(); i++)
+  {
+    const RaSimResult& a = cars[i].result;
+    const RaSimResult& b = other.cars[i].result;
+    bool same = a.loops == b.loops && a.laps == b.laps && a.bestLapMillis == b.bestLapMillis
+                && a.meanLapMillis == b.meanLapMillis && a.crossTrackRms == b.crossTrackRms
+                && a.crossTrackMax == b.crossTrackMax && a.collisions == b.collisions
+                && a.contactMillis == b.contactMillis && a.travelled == b.travelled
+                && a.followError == b.followError && a.blockedMillis == b.blockedMillis
+                && a.loopMeanMicros == b.loopMeanMicros && a.loopMaxMicros == b.loopMaxMicros
+                && a.modeStats.calls == b.modeStats.calls && a.modeStats.totalMicros == b.modeStats.totalMicros
+                && memcmp(&a.counters, &b.counters, sizeof(RaHostCounters)) == 0;
+    if (!same)
+    {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,65 @@
+#ifndef RA_SIM_FLEET_H
+#define RA_SIM_FLEET_H
+
+#include <RaSimulator.h>
+#include <RaSimPool.h>
+
+/**
+ * Voiture d'une flotte : son parcours, ses réglages, sa graine et, après la course, ses mesures.
+ */
+struct RaSimCar
+{
+  RaSimScenario scenario;
+  RaControlGains gains;
+  unsigned long seed;
+  RaSimResult result;
+};
+
+/**
+ * Mesures agrégées d'une flotte.
+ */
+struct RaSimFleetStats
+{
+  int cars;
+  double carSeconds;            // simulated
+  double wallSeconds;
+  unsigned long collisions;
+  int carsWithCollision;
+  unsigned long laps;
+  unsigned long bestLapMillis;  // 0 without a lap
+  unsigned long meanLapMillis;
+  unsigned long worstLapMillis; // worst mean lap of a car
+  unsigned long loopMeanMicros; // over all the loops of all the cars
+  unsigned long loopMaxMicros;
+  unsigned long blockedMillis;
+};
+
+/**
+ * Flotte de voitures simulées : chaque voiture (RaSmartCar4WD, sa couche matérielle, son monde)
+ * est indépendante des autres, sur sa propre copie du parcours, et fait sa course sur un thread
+ * de la réserve. Les mesures de chaque voiture ne dépendent que de son parcours, de ses réglages
+ * et de sa graine : elles sont les mêmes quel que soit le nombre de threads.
+ */
+class RaSimFleet
+{
+private:
+  RaSimPool& pool;
+  std::vector<RaSimCar> cars;
+  double wallSeconds;
+
+  static void runCar(void* context, int index);
+
+public:
+  RaSimFleet(RaSimPool& threads);
+
+  void clear();
+  void add(const RaSimScenario& scenario, const RaControlGains& gains, unsigned long seed);
+  void run();
+
+  int getCarCount();
+  const RaSimCar& getCar(int index);
+  RaSimFleetStats getStats();
+  bool matches(RaSimFleet& other);
+};
+
+#endif
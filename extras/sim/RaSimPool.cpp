@@ -0,0 +1,124 @@
+#include <RaSimPool.h>
+
+/**
+ * Constructeur de la classe RaSimPool.
+ *
+ * @param threads le nombre de threads, 0 = un par cœur (voir getCoreCount).
+ */
+RaSimPool::RaSimPool(int threads)
+{
+  current = NULL;
+  active = 0;
+  batch = 0;
+  stopping = false;
+
+  if (threads <= 0)
+  {
+    threads = getCoreCount();
+  }
+  for (int i = 0; threads > 1 && i < threads; i++)
+  {
+    workers.push_back(std::thread(&RaSimPool::work, this));
+  }
+}
+
+RaSimPool::~RaSimPool()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (size_t i = 0; i < workers.size(); i++)
+  {
+    workers[i].join();
+  }
+}
+
+int RaSimPool::getThreadCount()
+{
+  return workers.empty() ? 1 : workers.size();
+}
+
+/**
+ * @brief Exécute un lot de tâches et attend qu'elles soient toutes finies.
+ *
+ * @param jobs le nombre de tâches, numérotées de 0 à jobs - 1.
+ * @param task la tâche, appelée une fois par numéro, sur n'importe quel thread.
+ * @param taskContext le paramètre qui lui est passé.
+ */
+void RaSimPool::run(int jobs, RaSimJob task, void* taskContext)
+{
+  if (workers.empty())
+  {
+    for (int i = 0; i < jobs; i++)
+    {
+      task(taskContext, i);
+    }
+    return;
+  }
+
+  Batch work;
+  work.job = task;
+  work.context = taskContext;
+  work.count = jobs;
+  work.next = 0;
+  work.done = 0;
+
+  std::unique_lock<std::mutex> guard(lock);
+  current = &work;
+  batch++;
+  wake.notify_all();
+  // A thread that wakes up after this batch finds no batch, instead of the indices of the next one
+  finished.wait(guard, [this, &work] { return work.done == work.count && active == 0; });
+  current = NULL;
+}
+
+void RaSimPool::work()
+{
+  unsigned long seen = 0;
+
+  for (;;)
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    wake.wait(guard, [this, seen] { return stopping || batch != seen; });
+    if (stopping)
+    {
+      return;
+    }
+    seen = batch;
+    Batch* work = current;
+    if (!work)
+    {
+      continue;
+    }
+    active++;
+    guard.unlock();
+
+    int finishedJobs = 0;
+    for (int index = work->next++; index < work->count; index = work->next++)
+    {
+      work->job(work->context, index);
+      finishedJobs++;
+    }
+
+    guard.lock();
+    work->done += finishedJobs;
+    active--;
+    if (work->done == work->count && active == 0)
+    {
+      finished.notify_one();
+    }
+  }
+}
+
+/**
+ * @brief Nombre de cœurs de la machine.
+ *
+ * @return int le nombre de cœurs, 1 s'il est inconnu.
+ */
+int RaSimPool::getCoreCount()
+{
+  unsigned int cores = std::thread::hardware_concurrency();
+  return cores ? cores : 1;
+}
@@ -0,0 +1,54 @@
+#ifndef RA_SIM_POOL_H
+#define RA_SIM_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Tâche numérotée d'un lot (voir RaSimPool::run).
+ */
+typedef void (*RaSimJob)(void* context, int index);
+
+/**
+ * Réserve de threads qui exécute des lots de tâches indépendantes, par exemple une course
+ * par voiture : chaque thread prend la tâche suivante dès qu'il a fini la sienne.
+ * Avec un seul thread, les tâches sont exécutées dans l'ordre par le thread appelant.
+ */
+class RaSimPool
+{
+private:
+  // A batch lives on the stack of run(), which only returns once no thread can reach it
+  struct Batch
+  {
+    RaSimJob job;
+    void* context;
+    int count;
+    std::atomic<int> next;
+    int done;
+  };
+
+  std::vector<std::thread> workers;
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable finished;
+  Batch* current; // NULL between two batches
+  int active;     // threads working on the current batch
+  unsigned long batch;
+  bool stopping;
+
+  void work();
+
+public:
+  RaSimPool(int threads);
+  ~RaSimPool();
+
+  int getThreadCount();
+  void run(int jobs, RaSimJob task, void* taskContext);
+
+  static int getCoreCount();
+};
+
+#endif
@@ -0,0 +1,453 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <algorithm>
+#include <RaSimTuner.h>
+
+#define TUNE_LINE_MODES ((1 << BT_MODE_LINE_TRACKING) | (1 << BT_MODE_LINE_GUARDED))
+#define TUNE_HEX_RECORD 16 // data bytes per Intel HEX record
+
+// In the RaControlGains field order; the defaults (GAINS_DEFAULT) are on the grid of each step
+static const RaTuneParam tuneParams[] = {
+  {"lineSpeed", offsetof(RaControlGains, lineSpeed), 1, 40, 255, 5, TUNE_LINE_MODES},
+  {"lineTurnSpeed", offsetof(RaControlGains, lineTurnSpeed), 1, 60, 255, 5, TUNE_LINE_MODES},
+  {"lineSearchSpeed", offsetof(RaControlGains, lineSearchSpeed), 1, 30, 200, 5, TUNE_LINE_MODES},
+  {"lineSearchPulse", offsetof(RaControlGains, lineSearchPulse), 1, 1, 40, 1, TUNE_LINE_MODES},
+  {"followBackDistance", offsetof(RaControlGains, followBackDistance), 1, 2, 30, 1, 1 << BT_MODE_FOLLOWING},
+  {"followStopDistance", offsetof(RaControlGains, followStopDistance), 1, 4, 40, 1, 1 << BT_MODE_FOLLOWING},
+  {"followMaxDistance", offsetof(RaControlGains, followMaxDistance), 1, 15, 100, 1, 1 << BT_MODE_FOLLOWING},
+  {"guardDistance", offsetof(RaControlGains, guardDistance), 1, 5, 60, 1, 1 << BT_MODE_LINE_GUARDED},
+  {"avoidDistance", offsetof(RaControlGains, avoidDistance), 1, 8, 80, 1, 1 << BT_MODE_AVOID},
+  {"avoidSettleTime", offsetof(RaControlGains, avoidSettleTime), 1, 0, 250, 10, 1 << BT_MODE_AVOID},
+  {"avoidLookTime", offsetof(RaControlGains, avoidLookTime), 2, 100, 1500, 50, 1 << BT_MODE_AVOID},
+  {"avoidTurnTime", offsetof(RaControlGains, avoidTurnTime), 2, 100, 1500, 50, 1 << BT_MODE_AVOID},
+};
+
+// Keeps the follow bands in order: backward < stop < forward
+static void repair(RaControlGains& gains)
+{
+  if (gains.followStopDistance <= gains.followBackDistance)
+  {
+    gains.followStopDistance = gains.followBackDistance + 1;
+  }
+  if (gains.followMaxDistance <= gains.followStopDistance)
+  {
+    gains.followMaxDistance = gains.followStopDistance + 1;
+  }
+}
+
+/**
+ * Constructeur de la classe RaSimTuner : aucun parcours, une graine par parcours,
+ * les poids par défaut (TUNE_ERROR_WEIGHT, TUNE_COLLISION_WEIGHT).
+ *
+ * @param threads la réserve de threads qui fait les courses.
+ * @param seed la graine du tirage aléatoire des réglages.
+ */
+RaSimTuner::RaSimTuner(RaSimPool& threads, unsigned long seed) : pool(threads), random(seed)
+{
+  seeds = 1;
+  errorWeight = TUNE_ERROR_WEIGHT;
+  collisionWeight = TUNE_COLLISION_WEIGHT;
+  best = -1;
+  round = 0;
+}
+
+/**
+ * @brief Ajoute un parcours aux courses de chaque candidat. Les réglages des modes des parcours
+ * ajoutés sont recherchés, les autres gardent leur valeur par défaut.
+ *
+ * @param scenario le parcours (copié : sa durée peut être changée).
+ */
+void RaSimTuner::addScenario(const RaSimScenario& scenario)
+{
+  unsigned int modes = 0;
+
+  scenarios.push_back(scenario);
+  for (size_t i = 0; i < scenarios.size(); i++)
+  {
+    modes |= 1 << scenarios[i].mode;
+  }
+  params.clear();
+  for (int i = 0; i < getParamCount(); i++)
+  {
+    if (tuneParams[i].modes & modes)
+    {
+      params.push_back(i);
+    }
+  }
+}
+
+/**
+ * @brief Choisit le nombre de courses par parcours : graines 1 à count, les mêmes pour tous
+ * les candidats, pour les comparer sur les mêmes bruits.
+ */
+void RaSimTuner::setSeeds(int count)
+{
+  seeds = count > 0 ? count : 1;
+}
+
+/**
+ * @brief Choisit le poids de l'erreur et des collisions face à la vitesse dans le score.
+ */
+void RaSimTuner::setWeights(float error, float collision)
+{
+  errorWeight = error;
+  collisionWeight = collision;
+}
+
+int RaSimTuner::find(const RaControlGains& gains)
+{
+  for (size_t i = 0; i < history.size(); i++)
+  {
+    if (memcmp(&history[i].gains, &gains, sizeof(RaControlGains)) == 0)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+RaTuneScore RaSimTuner::score(const RaSimCar* runs, int count)
+{
+  RaTuneScore score;
+  int errorRuns = 0;
+
+  memset(&score, 0, sizeof(score));
+  for (int i = 0; i < count; i++)
+  {
+    const RaSimResult& result = runs[i].result;
+    int mode = runs[i].scenario.mode;
+
+    score.speed += result.travelled / (runs[i].scenario.duration / 1000.0f);
+    score.collisions += result.collisions;
+    score.contact += result.contactMillis / 1000.0f;
+    if (mode == BT_MODE_LINE_TRACKING || mode == BT_MODE_LINE_GUARDED)
+    {
+      score.error += result.crossTrackRms * 1000;
+      errorRuns++;
+    }
+    else if (mode == BT_MODE_FOLLOWING)
+    {
+      score.error += result.followError * 1000;
+      errorRuns++;
+    }
+  }
+  score.speed /= count;
+  score.collisions /= count;
+  score.contact /= count;
+  score.error = errorRuns ? score.error / errorRuns : 0;
+  score.score = score.speed / TUNE_SPEED_UNIT - errorWeight * score.error / TUNE_ERROR_UNIT
+                - collisionWeight * (score.collisions + score.contact);
+  return score;
+}
+
+// Gives the history index of each gains of the batch, running the ones never tried
+// (one car per scenario and seed) together on the pool
+void RaSimTuner::evaluate(const std::vector<RaControlGains>& batch, std::vector<int>& indices)
+{
+  RaSimFleet fleet(pool);
+  std::vector<int> pending;
+  int runs = scenarios.size() * seeds;
+
+  indices.clear();
+  for (size_t i = 0; i < batch.size(); i++)
+  {
+    int index = find(batch[i]);
+    if (index < 0)
+    {
+      RaTuneCandidate candidate;
+      memset(&candidate, 0, sizeof(candidate));
+      candidate.gains = batch[i];
+      candidate.round = round;
+      index = history.size();
+      history.push_back(candidate);
+      pending.push_back(index);
+      for (size_t s = 0; s < scenarios.size(); s++)
+      {
+        for (int seed = 1; seed <= seeds; seed++)
+        {
+          fleet.add(scenarios[s], batch[i], seed);
+        }
+      }
+    }
+    indices.push_back(index);
+  }
+  fleet.run();
+  for (size_t i = 0; i < pending.size(); i++)
+  {
+    history[pending[i]].score = score(&fleet.getCar(i * runs), runs);
+  }
+}
+
+/**
+ * @brief Essaie les réglages par défaut et count jeux tirés au hasard (sur le pas de chaque réglage).
+ *
+ * @param count le nombre de tirages.
+ */
+void RaSimTuner::sample(int count)
+{
+  std::vector<RaControlGains> batch;
+  std::vector<int> indices;
+  RaControlGains defaults = GAINS_DEFAULT;
+
+  batch.push_back(defaults);
+  for (int i = 0; i < count; i++)
+  {
+    RaControlGains gains = defaults;
+    for (size_t p = 0; p < params.size(); p++)
+    {
+      const RaTuneParam& param = tuneParams[params[p]];
+      int values = (param.high - param.low) / param.step + 1;
+      setValue(gains, params[p], param.low + (random.next() % values) * param.step);
+    }
+    repair(gains);
+    batch.push_back(gains);
+  }
+  evaluate(batch, indices);
+  for (size_t i = 0; i < indices.size(); i++)
+  {
+    if (best < 0 || history[indices[i]].score.score > history[best].score.score)
+    {
+      best = indices[i];
+    }
+  }
+}
+
+/**
+ * @brief Étape d'affinage à partir du meilleur jeu : chaque réglage essayé plus haut et plus bas
+ * de son pas courant. Le meilleur voisin est gardé s'il fait mieux, sinon les pas sont divisés par
+ * deux. Sans tirage préalable, part des réglages par défaut.
+ *
+ * @return bool false quand aucun voisin ne fait mieux avec les plus petits pas : la recherche est finie.
+ */
+bool RaSimTuner::refine()
+{
+  std::vector<RaControlGains> batch;
+  std::vector<int> indices;
+
+  if (best < 0)
+  {
+    sample(0);
+  }
+  if (steps.empty())
+  {
+    for (int i = 0; i < getParamCount(); i++)
+    {
+      const RaTuneParam& param = tuneParams[i];
+      steps.push_back(max((int)param.step, (param.high - param.low) / 4 / param.step * param.step));
+    }
+  }
+  round++;
+
+  const RaControlGains current = history[best].gains;
+  for (size_t p = 0; p < params.size(); p++)
+  {
+    const RaTuneParam& param = tuneParams[params[p]];
+    for (int direction = 1; direction >= -1; direction -= 2)
+    {
+      RaControlGains gains = current;
+      int value = getValue(current, params[p]) + direction * steps[params[p]];
+      setValue(gains, params[p], constrain(value, (int)param.low, (int)param.high));
+      repair(gains);
+      if (memcmp(&gains, &current, sizeof(RaControlGains)) != 0)
+      {
+        batch.push_back(gains);
+      }
+    }
+  }
+  evaluate(batch, indices);
+
+  int next = -1;
+  for (size_t i = 0; i < indices.size(); i++)
+  {
+    if (next < 0 || history[indices[i]].score.score > history[next].score.score)
+    {
+      next = indices[i];
+    }
+  }
+  if (next >= 0 && history[next].score.score > history[best].score.score)
+  {
+    best = next;
+    return true;
+  }
+
+  bool smaller = false;
+  for (size_t p = 0; p < params.size(); p++)
+  {
+    int step = tuneParams[params[p]].step;
+    if (steps[params[p]] > step)
+    {
+      steps[params[p]] = max(step, steps[params[p]] / 2 / step * step);
+      smaller = true;
+    }
+  }
+  return smaller;
+}
+
+int RaSimTuner::getCandidateCount()
+{
+  return history.size();
+}
+
+const RaTuneCandidate& RaSimTuner::getCandidate(int index)
+{
+  return history[index];
+}
+
+/**
+ * @brief Meilleur jeu essayé, au plus haut score (le premier en cas d'égalité).
+ */
+const RaTuneCandidate& RaSimTuner::getBest()
+{
+  return history[best];
+}
+
+/**
+ * @brief Front de Pareto des jeux essayés : ceux qu'aucun autre ne bat à la fois en vitesse,
+ * en erreur et en collisions (voir dominates).
+ *
+ * @return std::vector<int> leurs numéros, du plus rapide au plus lent.
+ */
+std::vector<int> RaSimTuner::getParetoFront()
+{
+  std::vector<int> front;
+
+  for (size_t i = 0; i < history.size(); i++)
+  {
+    bool dominated = false;
+    for (size_t j = 0; j < history.size() && !dominated; j++)
+    {
+      dominated = dominates(history[j].score, history[i].score);
+    }
+    if (!dominated)
+    {
+      front.push_back(i);
+    }
+  }
+  std::stable_sort(front.begin(), front.end(), [this](int a, int b) {
+    return history[a].score.speed > history[b].score.speed;
+  });
+  return front;
+}
+
+int RaSimTuner::getTunedCount()
+{
+  return params.size();
+}
+
+/**
+ * @brief Réglage recherché.
+ *
+ * @param index de 0 à getTunedCount() - 1.
+ * @return int son numéro dans la table des réglages (getParam).
+ */
+int RaSimTuner::getTuned(int index)
+{
+  return params[index];
+}
+
+int RaSimTuner::getParamCount()
+{
+  return sizeof(tuneParams) / sizeof(tuneParams[0]);
+}
+
+const RaTuneParam& RaSimTuner::getParam(int index)
+{
+  return tuneParams[index];
+}
+
+int RaSimTuner::getValue(const RaControlGains& gains, int param)
+{
+  const uint8_t* field = (const uint8_t*)&gains + tuneParams[param].offset;
+
+  return tuneParams[param].size == 1 ? *field : *(const uint16_t*)field;
+}
+
+void RaSimTuner::setValue(RaControlGains& gains, int param, int value)
+{
+  uint8_t* field = (uint8_t*)&gains + tuneParams[param].offset;
+
+  if (tuneParams[param].size == 1)
+  {
+    *field = value;
+  }
+  else
+  {
+    *(uint16_t*)field = value;
+  }
+}
+
+/**
+ * @brief Compare deux mesures : a domine b s'il est au moins aussi rapide, avec au plus autant
+ * d'erreur et de collisions, et meilleur sur au moins un des trois.
+ */
+bool RaSimTuner::dominates(const RaTuneScore& a, const RaTuneScore& b)
+{
+  return a.speed >= b.speed && a.error <= b.error && a.collisions <= b.collisions
+         && (a.speed > b.speed || a.error < b.error || a.collisions < b.collisions);
+}
+
+/**
+ * @brief Écrit les réglages dans un en-tête C : "#define GAINS_TUNED {...}", à charger dans un programme
+ * par "RaControlGains gains = GAINS_TUNED;" puis setGains(gains) et saveGains().
+ *
+ * @param gains les réglages.
+ * @param path le fichier.
+ * @return bool false si le fichier ne peut pas être écrit.
+ */
+bool RaSimTuner::writeHeader(const RaControlGains& gains, const char* path)
+{
+  FILE* out = fopen(path, "w");
+
+  if (!out)
+  {
+    return false;
+  }
+  fprintf(out, "// Control gains found by ra_tune, in the RaControlGains field order\n");
+  fprintf(out, "#define GAINS_TUNED {");
+  for (int i = 0; i < getParamCount(); i++)
+  {
+    fprintf(out, "%s%d", i ? ", " : "", getValue(gains, i));
+  }
+  fprintf(out, "}\n");
+  return fclose(out) == 0;
+}
+
+/**
+ * @brief Écrit l'image EEPROM des réglages (celle de saveGains) au format Intel HEX,
+ * à programmer sur la carte (avrdude -U eeprom:w:gains.eep:i) pour que loadGains la trouve.
+ *
+ * @param gains les réglages.
+ * @param path le fichier, en général .eep.
+ * @param address l'adresse en EEPROM, celle passée à loadGains.
+ * @return bool false si le fichier ne peut pas être écrit.
+ */
+bool RaSimTuner::writeEeprom(const RaControlGains& gains, const char* path, int address)
+{
+  RaSmartCar4WD car;
+  FILE* out;
+
+  car.setGains(gains);
+  car.saveGains(address);
+  out = fopen(path, "w");
+  if (!out)
+  {
+    return false;
+  }
+
+  const uint8_t* image = car.getHardware().getEeprom();
+  int end = address + sizeof(RaControlGains) + 3;
+  for (int start = address; start < end; start += TUNE_HEX_RECORD)
+  {
+    int length = min(TUNE_HEX_RECORD, end - start);
+    uint8_t sum = length + (start >> 8) + start;
+    fprintf(out, ":%02X%04X00", length, start);
+    for (int i = 0; i < length; i++)
+    {
+      fprintf(out, "%02X", image[start + i]);
+      sum += image[start + i];
+    }
+    fprintf(out, "%02X\n", (uint8_t)-sum);
+  }
+  fprintf(out, ":00000001FF\n");
+  return fclose(out) == 0;
+}
@@ -0,0 +1,102 @@
+#ifndef RA_SIM_TUNER_H
+#define RA_SIM_TUNER_H
+
+#include <RaSimFleet.h>
+
+// Score of a candidate (higher is better):
+//   speed / TUNE_SPEED_UNIT - errorWeight * error / TUNE_ERROR_UNIT - collisionWeight * (collisions + contact)
+#define TUNE_SPEED_UNIT 0.1f // m/s
+#define TUNE_ERROR_UNIT 10   // mm
+#define TUNE_ERROR_WEIGHT 1.0f
+#define TUNE_COLLISION_WEIGHT 1.0f
+
+/**
+ * Réglage recherché : un champ de RaControlGains, ses bornes, son pas, et les modes qui s'en servent.
+ */
+struct RaTuneParam
+{
+  const char* name;
+  uint8_t offset; // in RaControlGains
+  uint8_t size;   // 1 or 2 bytes
+  uint16_t low;
+  uint16_t high;
+  uint16_t step;
+  unsigned int modes; // 1 << BT_MODE_*
+};
+
+/**
+ * Mesures d'un jeu de réglages, en moyenne sur ses courses (parcours x graines).
+ */
+struct RaTuneScore
+{
+  float speed;      // m/s, distance travelled over the run duration
+  float error;      // mm, cross-track RMS on the lines, distance error when following
+  float collisions; // per run
+  float contact;    // s per run, in contact with an obstacle or a wall
+  float score;
+};
+
+/**
+ * Jeu de réglages essayé, avec ses mesures et l'étape de la recherche qui l'a proposé.
+ */
+struct RaTuneCandidate
+{
+  RaControlGains gains;
+  RaTuneScore score;
+  int round; // 0 = sampling, then the refinement round
+};
+
+/**
+ * Recherche des réglages des modes automatiques (RaControlGains) par simulation : un tirage
+ * aléatoire (les réglages par défaut en premier), puis un affinage par coordonnées, chaque réglage
+ * essayé plus haut et plus bas d'un pas qui est divisé par deux quand aucun voisin n'est meilleur.
+ * Les voisins d'une étape sont essayés ensemble, une voiture par parcours et par graine sur la
+ * réserve de threads : le résultat ne dépend pas du nombre de threads.
+ * Tous les jeux essayés sont gardés, pour le front de Pareto vitesse / erreur / collisions.
+ */
+class RaSimTuner
+{
+private:
+  RaSimPool& pool;
+  RaSimRandom random;
+  std::vector<RaSimScenario> scenarios;
+  int seeds;
+  float errorWeight;
+  float collisionWeight;
+  std::vector<int> params; // tuned, indices in the parameter table
+  std::vector<RaTuneCandidate> history;
+  int best;
+  int round;
+  std::vector<int> steps;
+
+  int find(const RaControlGains& gains);
+  void evaluate(const std::vector<RaControlGains>& batch, std::vector<int>& indices);
+  RaTuneScore score(const RaSimCar* runs, int count);
+
+public:
+  RaSimTuner(RaSimPool& threads, unsigned long seed);
+
+  void addScenario(const RaSimScenario& scenario);
+  void setSeeds(int count);
+  void setWeights(float error, float collision);
+
+  void sample(int count);
+  bool refine();
+
+  int getCandidateCount();
+  const RaTuneCandidate& getCandidate(int index);
+  const RaTuneCandidate& getBest();
+  std::vector<int> getParetoFront();
+  int getTunedCount();
+  int getTuned(int index);
+
+  static int getParamCount();
+  static const RaTuneParam& getParam(int index);
+  static int getValue(const RaControlGains& gains, int param);
+  static void setValue(RaControlGains& gains, int param, int value);
+  static bool dominates(const RaTuneScore& a, const RaTuneScore& b);
+  static bool writeHeader(const RaControlGains& gains, const char* path);
+  static bool writeEeprom(const RaControlGains& gains, const char* path, int address = GAINS_EEPROM_ADDRESS);
+};
+
+#endif
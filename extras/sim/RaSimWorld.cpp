@@ -0,0 +1,628 @@
+#include <RaSimWorld.h>
+
+#define SIM_PI 3.14159265f
+#define SIM_NO_HIT (SIM_RANGING_RANGE + 1.0f)
+#define SIM_NEAREST_WINDOW 8 // segments searched around the last nearest one
+
+/**
+ * Constructeur de la classe RaSimRandom.
+ *
+ * @param seed la graine, 0 est remplacé par une valeur fixe (xorshift reste à 0 sinon).
+ */
+RaSimRandom::RaSimRandom(unsigned long seed)
+{
+  state = (uint32_t)(seed * 2654435761UL) ^ 0x9E3779B9UL;
+  if (state == 0)
+  {
+    state = 0x9E3779B9UL;
+  }
+}
+
+uint32_t RaSimRandom::next()
+{
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/**
+ * @brief Tire un nombre uniformément entre deux bornes.
+ */
+float RaSimRandom::uniform(float low, float high)
+{
+  return low + (high - low) * (next() >> 8) * (1.0f / 16777216.0f);
+}
+
+/**
+ * Constructeur de la classe RaSimWorld : un monde vide (ni ligne, ni obstacle, ni mur),
+ * la voiture à l'origine, tournée vers les x croissants.
+ *
+ * @param simulatedCar la voiture, compilée avec la couche matérielle simulée.
+ * @param seed la graine des bruits (position de départ, capteurs).
+ */
+RaSimWorld::RaSimWorld(RaSmartCar4WD& simulatedCar, unsigned long seed)
+  : car(simulatedCar), hw(simulatedCar.getHardware()), random(seed)
+{
+  trackLength = 0;
+  arenaWidth = 0;
+  arenaHeight = 0;
+  followTarget = -1;
+  startNoise = 0.01f;
+  trackingNoise = 0.001f;
+  rangingNoise = 0.005f;
+
+  pose.x = 0;
+  pose.y = 0;
+  pose.heading = 0;
+  leftSpeed = 0;
+  rightSpeed = 0;
+  headAngle = 90;
+  time = 0;
+  nextTick = 0;
+  triggerHigh = false;
+  echoPending = false;
+  echoHigh = false;
+  echoRise = 0;
+  echoFall = 0;
+  contact = false;
+  nearestHint = -1;
+
+  progress = 0;
+  lastPosition = 0;
+  lastLapTime = 0;
+  crossTrackSquares = 0;
+  crossTrackMax = 0;
+  crossTrackSamples = 0;
+  collisions = 0;
+  contactMicros = 0;
+  travelled = 0;
+  followErrorSum = 0;
+  followSamples = 0;
+}
+
+/**
+ * @brief Trace la ligne au sol : une polyligne fermée (le dernier point est relié au premier).
+ *
+ * @param points les points, en mètres.
+ * @param count le nombre de points.
+ */
+void RaSimWorld::setTrack(const RaSimPoint* points, int count)
+{
+  track.assign(points, points + count);
+  trackPosition.resize(count);
+  trackLength = 0;
+  for (int i = 0; i < count; i++)
+  {
+    const RaSimPoint& a = track[i];
+    const RaSimPoint& b = track[(i + 1) % count];
+    trackPosition[i] = trackLength;
+    trackLength += hypotf(b.x - a.x, b.y - a.y);
+  }
+  nearestHint = -1;
+}
+
+/**
+ * @brief Ferme le monde par les murs d'une arène rectangulaire, de (0, 0) à (width, height).
+ *
+ * @param width la largeur en mètres, 0 = pas de murs.
+ * @param height la hauteur en mètres.
+ */
+void RaSimWorld::setArena(float width, float height)
+{
+  arenaWidth = width;
+  arenaHeight = height;
+}
+
+void RaSimWorld::addObstacle(const RaSimObstacle& obstacle)
+{
+  obstacles.push_back(obstacle);
+}
+
+/**
+ * @brief Choisit l'obstacle que la voiture doit suivre à SIM_FOLLOW_GAP m (voir getFollowError).
+ *
+ * @param index le numéro de l'obstacle dans l'ordre des addObstacle, -1 = aucun.
+ */
+void RaSimWorld::setFollowTarget(int index)
+{
+  followTarget = index;
+}
+
+/**
+ * @brief Place la voiture, avant start() qui y ajoute le bruit de départ.
+ *
+ * @param x la position en mètres.
+ * @param y la position en mètres.
+ * @param heading le cap en radians.
+ */
+void RaSimWorld::setPose(float x, float y, float heading)
+{
+  pose.x = x;
+  pose.y = y;
+  pose.heading = heading;
+}
+
+/**
+ * @brief Règle les bruits tirés à partir de la graine.
+ *
+ * @param start l'écart maximal de la position de départ, en mètres (le cap varie de 3 fois autant en radians).
+ * @param tracking la probabilité qu'un capteur de suivi de ligne se trompe, à chaque milliseconde.
+ * @param ranging l'erreur maximale d'une mesure ultrason, en mètres.
+ */
+void RaSimWorld::setNoise(float start, float tracking, float ranging)
+{
+  startNoise = start;
+  trackingNoise = tracking;
+  rangingNoise = ranging;
+}
+
+/**
+ * @brief Branche le monde sur l'horloge de la voiture, après sa construction et init().
+ */
+void RaSimWorld::start()
+{
+  pose.x += random.uniform(-startNoise, startNoise);
+  pose.y += random.uniform(-startNoise, startNoise);
+  pose.heading += 3 * random.uniform(-startNoise, startNoise);
+  time = hw.micros();
+  nextTick = time;
+  lastLapTime = time / 1000;
+  if (!track.empty())
+  {
+    nearest(pose.x, pose.y, &lastPosition);
+  }
+  hw.setSimulation(step, this);
+}
+
+/**
+ * @brief Débranche le monde de l'horloge : les entrées de la voiture ne changent plus.
+ */
+void RaSimWorld::stop()
+{
+  hw.setSimulation(NULL, NULL);
+}
+
+unsigned long RaSimWorld::step(void* context, unsigned long now)
+{
+  return ((RaSimWorld*)context)->update(now);
+}
+
+/**
+ * @brief Fait avancer le monde jusqu'à une date : physique, écho en cours, déclenchement
+ * du capteur ultrason, échantillonnage des capteurs et des mesures chaque milliseconde.
+ *
+ * @param now la date en microsecondes.
+ * @return unsigned long la date du prochain évènement.
+ */
+unsigned long RaSimWorld::update(unsigned long now)
+{
+  while ((long)(now - time) > 0)
+  {
+    unsigned long dt = min(now - time, (unsigned long)SIM_STEP_US);
+    move(dt * 1e-6f);
+    time += dt;
+  }
+
+  if (echoPending && !echoHigh && (long)(now - echoRise) >= 0)
+  {
+    hw.setInput(PIN_ECHO, HIGH);
+    echoHigh = true;
+  }
+  if (echoPending && echoHigh && (long)(now - echoFall) >= 0)
+  {
+    hw.setInput(PIN_ECHO, LOW);
+    hw.setPulse(PIN_ECHO, 0);
+    echoHigh = false;
+    echoPending = false;
+  }
+
+  bool high = hw.getOutput(PIN_TRIGGER) == HIGH;
+  if (high && !triggerHigh && !echoPending)
+  {
+    trigger(now);
+  }
+  triggerHigh = high;
+
+  if ((long)(now - nextTick) >= 0)
+  {
+    sample();
+    while ((long)(now - nextTick) >= 0)
+    {
+      nextTick += SIM_STEP_US;
+    }
+  }
+
+  unsigned long next = nextTick;
+  if (echoPending)
+  {
+    unsigned long edge = echoHigh ? echoFall : echoRise;
+    if ((long)(edge - next) < 0)
+    {
+      next = edge;
+    }
+  }
+  return next;
+}
+
+/**
+ * @brief Un pas de physique : réponse des moteurs, déplacement, collisions, rotation de la tête.
+ *
+ * @param dt la durée en secondes.
+ */
+void RaSimWorld::move(float dt)
+{
+  float alpha = dt / (SIM_MOTOR_TIME_CONSTANT + dt);
+
+  leftSpeed += (wheelTarget(PIN_MOTOR_L_PWM, PIN_MOTOR_L_CTRL) - leftSpeed) * alpha;
+  rightSpeed += (wheelTarget(PIN_MOTOR_R_PWM, PIN_MOTOR_R_CTRL) - rightSpeed) * alpha;
+
+  float speed = (leftSpeed + rightSpeed) / 2;
+  pose.heading += (rightSpeed - leftSpeed) / SIM_TRACK_WIDTH * dt;
+  if (pose.heading > SIM_PI)
+  {
+    pose.heading -= 2 * SIM_PI;
+  }
+  else if (pose.heading < -SIM_PI)
+  {
+    pose.heading += 2 * SIM_PI;
+  }
+
+  // A move that gets deeper into an obstacle or a wall is blocked, moving out of it is allowed
+  float x = pose.x + speed * cosf(pose.heading) * dt;
+  float y = pose.y + speed * sinf(pose.heading) * dt;
+  float before = penetration(pose.x, pose.y);
+  float after = penetration(x, y);
+  bool blocked = after > 0 && after >= before;
+  if (!blocked)
+  {
+    travelled += fabsf(speed) * dt;
+    pose.x = x;
+    pose.y = y;
+  }
+
+  bool touching = blocked || before > 0;
+  if (touching && !contact)
+  {
+    collisions++;
+  }
+  if (touching)
+  {
+    contactMicros += (unsigned long)(dt * 1e6f + 0.5f);
+  }
+  contact = touching;
+
+#if RA_USE_SERVO
+  float travel = SIM_SERVO_SPEED * dt * 1000;
+  headAngle += constrain(car.getServoAngle() - headAngle, -travel, travel);
+#endif
+}
+
+/**
+ * @brief Échantillonne les capteurs de suivi de ligne et les mesures de la course.
+ */
+void RaSimWorld::sample()
+{
+  static const uint8_t trackingPins[3] = {PIN_TRACKING_LEFT, PIN_TRACKING_MIDDLE, PIN_TRACKING_RIGHT};
+
+  if (!track.empty())
+  {
+    float position;
+    float centre = nearest(pose.x, pose.y, &position);
+    (void)centre;
+
+    for (int i = 0; i < 3; i++)
+    {
+      RaSimPoint sensor = ahead(SIM_TRACKING_OFFSET, SIM_TRACKING_SPACING * (1 - i));
+      float distance = nearest(sensor.x, sensor.y, NULL);
+      bool line = distance <= (SIM_LINE_WIDTH + SIM_TRACKING_SPOT) / 2;
+      if (random.uniform(0, 1) < trackingNoise)
+      {
+        line = !line;
+      }
+      hw.setInput(trackingPins[i], line ? HIGH : LOW);
+
+      if (i == 1)
+      {
+        crossTrackSquares += (double)distance * distance;
+        crossTrackMax = max(crossTrackMax, distance);
+        crossTrackSamples++;
+      }
+    }
+
+    // Arc length driven along the line, backwards counted off; a lap for each track length
+    float delta = position - lastPosition;
+    if (delta > trackLength / 2)
+    {
+      delta -= trackLength;
+    }
+    else if (delta < -trackLength / 2)
+    {
+      delta += trackLength;
+    }
+    lastPosition = position;
+    progress += delta;
+    if (progress >= (lapTimes.size() + 1) * trackLength)
+    {
+      unsigned long lapTime = time / 1000;
+      lapTimes.push_back(lapTime - lastLapTime);
+      lastLapTime = lapTime;
+    }
+  }
+
+  if (followTarget >= 0 && followTarget < (int)obstacles.size())
+  {
+    const RaSimObstacle& target = obstacles[followTarget];
+    RaSimPoint centre = obstaclePosition(target);
+    float gap = hypotf(centre.x - pose.x, centre.y - pose.y) - SIM_CAR_RADIUS - target.radius;
+    followErrorSum += fabsf(gap - SIM_FOLLOW_GAP);
+    followSamples++;
+  }
+}
+
+/**
+ * @brief Répond au déclenchement du capteur ultrason : la distance la plus courte du cône
+ * donne la durée de l'écho, déposée pour pulseIn et jouée en fronts sur la broche ECHO.
+ * Sans obstacle à portée, aucun écho ne revient.
+ *
+ * @param now la date du déclenchement.
+ */
+void RaSimWorld::trigger(unsigned long now)
+{
+  RaSimPoint sensor = ahead(SIM_RANGING_OFFSET, 0);
+  float bearing = pose.heading + (headAngle - 90) * SIM_PI / 180;
+  float distance = SIM_NO_HIT;
+
+  for (int i = 0; i < SIM_RANGING_RAYS; i++)
+  {
+    float offset = SIM_RANGING_CONE * (2.0f * i / (SIM_RANGING_RAYS - 1) - 1) * SIM_PI / 180;
+    distance = min(distance, castRay(sensor.x, sensor.y, bearing + offset));
+  }
+  distance += random.uniform(-rangingNoise, rangingNoise);
+  if (distance > SIM_RANGING_RANGE)
+  {
+    hw.setPulse(PIN_ECHO, 0);
+    return;
+  }
+
+  unsigned long width = (unsigned long)(max(distance, SIM_RANGING_MIN) * SIM_ECHO_US_PER_M + 0.5f);
+  hw.setPulse(PIN_ECHO, width);
+  echoPending = true;
+  echoHigh = false;
+  echoRise = now + SIM_ECHO_DELAY;
+  echoFall = echoRise + width;
+}
+
+/**
+ * @brief Vitesse que la commande d'un moteur donne aux roues de son côté.
+ *
+ * @return float la vitesse en m/s, négative en arrière.
+ */
+float RaSimWorld::wheelTarget(uint8_t pwmPin, uint8_t ctrlPin)
+{
+  int pwm = hw.getPwm(pwmPin);
+
+  if (pwm <= SIM_MOTOR_DEADBAND)
+  {
+    return 0;
+  }
+  float speed = (pwm - SIM_MOTOR_DEADBAND) * SIM_MOTOR_SPEED_MAX / (255 - SIM_MOTOR_DEADBAND);
+  return hw.getOutput(ctrlPin) == HIGH ? speed : -speed;
+}
+
+/**
+ * @brief Position d'un obstacle à la date courante, en aller-retour régulier sur son trajet.
+ */
+RaSimPoint RaSimWorld::obstaclePosition(const RaSimObstacle& obstacle)
+{
+  RaSimPoint position = {obstacle.x, obstacle.y};
+
+  if (obstacle.period)
+  {
+    float phase = (float)((time / 1000) % obstacle.period) / obstacle.period;
+    float travel = phase < 0.5f ? 2 * phase : 2 - 2 * phase;
+    position.x += obstacle.dx * travel;
+    position.y += obstacle.dy * travel;
+  }
+  return position;
+}
+
+/**
+ * @brief Profondeur à laquelle la voiture, centrée en (x, y), entre dans un obstacle ou un mur.
+ *
+ * @return float la profondeur en mètres, négative (la distance au plus proche) sans contact.
+ */
+float RaSimWorld::penetration(float x, float y)
+{
+  float deepest = -SIM_NO_HIT;
+
+  for (size_t i = 0; i < obstacles.size(); i++)
+  {
+    RaSimPoint centre = obstaclePosition(obstacles[i]);
+    deepest = max(deepest, SIM_CAR_RADIUS + obstacles[i].radius - hypotf(centre.x - x, centre.y - y));
+  }
+  if (arenaWidth > 0)
+  {
+    deepest = max(deepest, SIM_CAR_RADIUS - x);
+    deepest = max(deepest, SIM_CAR_RADIUS - y);
+    deepest = max(deepest, x + SIM_CAR_RADIUS - arenaWidth);
+    deepest = max(deepest, y + SIM_CAR_RADIUS - arenaHeight);
+  }
+  return deepest;
+}
+
+/**
+ * @brief Distance du premier obstacle ou mur dans une direction.
+ *
+ * @return float la distance en mètres, SIM_NO_HIT si rien n'est touché.
+ */
+float RaSimWorld::castRay(float x, float y, float angle)
+{
+  float dx = cosf(angle);
+  float dy = sinf(angle);
+  float hit = SIM_NO_HIT;
+
+  for (size_t i = 0; i < obstacles.size(); i++)
+  {
+    RaSimPoint centre = obstaclePosition(obstacles[i]);
+    float ox = centre.x - x;
+    float oy = centre.y - y;
+    float along = ox * dx + oy * dy;
+    float across = ox * dy - oy * dx;
+    float radius = obstacles[i].radius;
+    if (along > 0 && fabsf(across) < radius)
+    {
+      hit = min(hit, along - sqrtf(radius * radius - across * across));
+    }
+  }
+  if (arenaWidth > 0)
+  {
+    if (dx > 0)
+    {
+      hit = min(hit, (arenaWidth - x) / dx);
+    }
+    else if (dx < 0)
+    {
+      hit = min(hit, -x / dx);
+    }
+    if (dy > 0)
+    {
+      hit = min(hit, (arenaHeight - y) / dy);
+    }
+    else if (dy < 0)
+    {
+      hit = min(hit, -y / dy);
+    }
+  }
+  return hit;
+}
+
+/**
+ * @brief Distance d'un point à la ligne, cherchée autour du dernier segment le plus proche
+ * (sur toute la ligne si elle s'en est éloignée).
+ *
+ * @param position reçoit l'abscisse le long de la ligne du point le plus proche, si non NULL.
+ * @return float la distance en mètres.
+ */
+float RaSimWorld::nearest(float x, float y, float* position)
+{
+  int count = track.size();
+  int first = 0;
+  int last = count - 1;
+
+  if (nearestHint >= 0)
+  {
+    first = nearestHint - SIM_NEAREST_WINDOW;
+    last = nearestHint + SIM_NEAREST_WINDOW;
+  }
+
+  float best = SIM_NO_HIT * 1000;
+  int bestIndex = 0;
+  float bestAlong = 0;
+  for (int k = first; k <= last; k++)
+  {
+    int i = (k % count + count) % count;
+    const RaSimPoint& a = track[i];
+    const RaSimPoint& b = track[(i + 1) % count];
+    float sx = b.x - a.x;
+    float sy = b.y - a.y;
+    float length2 = sx * sx + sy * sy;
+    float t = length2 > 0 ? constrain(((x - a.x) * sx + (y - a.y) * sy) / length2, 0.0f, 1.0f) : 0;
+    float distance = hypotf(a.x + t * sx - x, a.y + t * sy - y);
+    if (distance < best)
+    {
+      best = distance;
+      bestIndex = i;
+      bestAlong = t * sqrtf(length2);
+    }
+  }
+
+  if (nearestHint >= 0 && best > SIM_CAR_RADIUS)
+  {
+    nearestHint = -1;
+    return nearest(x, y, position);
+  }
+  if (position)
+  {
+    nearestHint = bestIndex;
+    *position = trackPosition[bestIndex] + bestAlong;
+  }
+  return best;
+}
+
+/**
+ * @brief Point lié à la voiture.
+ *
+ * @param forward la distance devant son centre, en mètres.
+ * @param left la distance à gauche de son axe, en mètres.
+ */
+RaSimPoint RaSimWorld::ahead(float forward, float left)
+{
+  float c = cosf(pose.heading);
+  float s = sinf(pose.heading);
+  RaSimPoint point = {pose.x + forward * c - left * s, pose.y + forward * s + left * c};
+  return point;
+}
+
+const RaSimPose& RaSimWorld::getPose()
+{
+  return pose;
+}
+
+/**
+ * @brief Récupère le temps de chaque tour de ligne terminé, le premier compté depuis start().
+ *
+ * @return const std::vector<unsigned long>& les temps en millisecondes.
+ */
+const std::vector<unsigned long>& RaSimWorld::getLapTimes()
+{
+  return lapTimes;
+}
+
+/**
+ * @brief Récupère l'écart quadratique moyen entre le capteur du milieu et la ligne.
+ *
+ * @return float l'écart en mètres.
+ */
+float RaSimWorld::getCrossTrackRms()
+{
+  return crossTrackSamples ? sqrt(crossTrackSquares / crossTrackSamples) : 0;
+}
+
+float RaSimWorld::getCrossTrackMax()
+{
+  return crossTrackMax;
+}
+
+/**
+ * @brief Récupère le nombre de contacts avec un obstacle ou un mur (un contact qui dure compte une fois).
+ */
+unsigned long RaSimWorld::getCollisions()
+{
+  return collisions;
+}
+
+unsigned long RaSimWorld::getContactMillis()
+{
+  return contactMicros / 1000;
+}
+
+/**
+ * @brief Récupère la distance parcourue, en avant comme en arrière.
+ *
+ * @return float la distance en mètres.
+ */
+float RaSimWorld::getTravelled()
+{
+  return travelled;
+}
+
+/**
+ * @brief Récupère l'écart moyen entre la distance à la cible suivie et SIM_FOLLOW_GAP.
+ *
+ * @return float l'écart en mètres, 0 sans cible.
+ */
+float RaSimWorld::getFollowError()
+{
+  return followSamples ? followErrorSum / followSamples : 0;
+}
@@ -0,0 +1,176 @@
+#ifndef RA_SIM_WORLD_H
+#define RA_SIM_WORLD_H
+
+#include <vector>
+#include <RaSmartCar4WD.h>
+
+// Physics step and sensor sampling period (us)
+#define SIM_STEP_US 1000
+
+// Motors: wheel speed at full PWM, PWM below which the wheels do not turn, response time
+#define SIM_MOTOR_SPEED_MAX 0.6f     // m/s
+#define SIM_MOTOR_DEADBAND 30
+#define SIM_MOTOR_TIME_CONSTANT 0.08f // s
+#define SIM_TRACK_WIDTH 0.25f         // m, effective width of the skid-steered wheel base
+
+// Body, seen from above as a circle
+#define SIM_CAR_RADIUS 0.1f // m
+
+// Line tracking sensors: 3 sensors across the car, ahead of its centre
+#define SIM_LINE_WIDTH 0.018f       // m
+#define SIM_TRACKING_OFFSET 0.06f   // m ahead of the centre
+#define SIM_TRACKING_SPACING 0.02f  // m between two sensors
+#define SIM_TRACKING_SPOT 0.006f    // m, diameter of the spot seen by a sensor
+
+// HC-SR04 on the head: a cone of rays, echo width proportional to the distance
+#define SIM_RANGING_OFFSET 0.08f  // m ahead of the centre
+#define SIM_RANGING_CONE 15.0f    // degrees, half angle
+#define SIM_RANGING_RAYS 5
+#define SIM_RANGING_MIN 0.02f     // m
+#define SIM_RANGING_RANGE 4.0f    // m
+#define SIM_ECHO_US_PER_M 5820.0f // round trip
+#define SIM_ECHO_DELAY 100        // us between the trigger and the rising edge
+#define SIM_SERVO_SPEED 0.5f      // degrees per ms
+
+// Follow scenario: gap the car should keep to its target (m)
+#define SIM_FOLLOW_GAP 0.2f
+
+/**
+ * Générateur pseudo-aléatoire déterministe (xorshift) : une graine donne toujours la même suite,
+ * quel que soit le thread ou la machine.
+ */
+class RaSimRandom
+{
+private:
+  uint32_t state;
+
+public:
+  RaSimRandom(unsigned long seed);
+
+  uint32_t next();
+  float uniform(float low, float high);
+};
+
+struct RaSimPoint
+{
+  float x; // m
+  float y; // m
+};
+
+struct RaSimPose
+{
+  float x;       // m
+  float y;       // m
+  float heading; // rad, 0 = along x, counterclockwise
+};
+
+/**
+ * Obstacle rond, fixe ou en mouvement : il va de (x, y) à (x + dx, y + dy) et revient
+ * en period ms (0 = fixe).
+ */
+struct RaSimObstacle
+{
+  float x;
+  float y;
+  float radius;
+  float dx;
+  float dy;
+  unsigned long period;
+};
+
+/**
+ * Monde simulé autour d'une voiture RaSmartCar4WD compilée pour l'ordinateur (RA_HOST) :
+ * ligne au sol (polyligne fermée), obstacles ronds, murs d'une arène rectangulaire,
+ * moteurs (zone morte, temps de réponse), capteurs de suivi de ligne, capteur ultrason sur la tête.
+ *
+ * Branchée sur l'horloge de la couche matérielle (RaHostHardware::setSimulation), la physique avance
+ * aussi pendant les attentes de la voiture (delay, pulseIn), et l'écho répond au déclenchement
+ * du capteur à la microseconde près, pour les mesures bloquantes comme pour celles par interruption.
+ * Elle relève les mesures de la course : tours et temps au tour, écart à la ligne, collisions,
+ * distance parcourue, écart au suivi d'une cible.
+ */
+class RaSimWorld
+{
+private:
+  RaSmartCar4WD& car;
+  RaHostHardware& hw;
+  RaSimRandom random;
+
+  // World
+  std::vector<RaSimPoint> track;
+  std::vector<float> trackPosition; // arc length at each point
+  float trackLength;
+  std::vector<RaSimObstacle> obstacles;
+  float arenaWidth;
+  float arenaHeight;
+  int followTarget;
+  float startNoise;
+  float trackingNoise;
+  float rangingNoise;
+
+  // Car
+  RaSimPose pose;
+  float leftSpeed;
+  float rightSpeed;
+  float headAngle;
+  unsigned long time; // us
+  unsigned long nextTick;
+  bool triggerHigh;
+  bool echoPending;
+  bool echoHigh;
+  unsigned long echoRise;
+  unsigned long echoFall;
+  bool contact;
+  int nearestHint;
+
+  // Metrics
+  float progress;
+  float lastPosition;
+  unsigned long lastLapTime;
+  std::vector<unsigned long> lapTimes;
+  double crossTrackSquares;
+  float crossTrackMax;
+  unsigned long crossTrackSamples;
+  unsigned long collisions;
+  unsigned long contactMicros;
+  float travelled;
+  double followErrorSum;
+  unsigned long followSamples;
+
+  static unsigned long step(void* context, unsigned long now);
+  unsigned long update(unsigned long now);
+  void move(float dt);
+  void sample();
+  void trigger(unsigned long now);
+  float wheelTarget(uint8_t pwmPin, uint8_t ctrlPin);
+  RaSimPoint obstaclePosition(const RaSimObstacle& obstacle);
+  float penetration(float x, float y);
+  float castRay(float x, float y, float angle);
+  float nearest(float x, float y, float* position);
+  RaSimPoint ahead(float forward, float left);
+
+public:
+  RaSimWorld(RaSmartCar4WD& simulatedCar, unsigned long seed);
+
+  // World
+  void setTrack(const RaSimPoint* points, int count);
+  void setArena(float width, float height);
+  void addObstacle(const RaSimObstacle& obstacle);
+  void setFollowTarget(int index);
+  void setPose(float x, float y, float heading);
+  void setNoise(float start, float tracking, float ranging);
+  void start();
+  void stop();
+
+  // Metrics
+  const RaSimPose& getPose();
+  const std::vector<unsigned long>& getLapTimes();
+  float getCrossTrackRms();
+  float getCrossTrackMax();
+  unsigned long getCollisions();
+  unsigned long getContactMillis();
+  float getTravelled();
+  float getFollowError();
+};
+
+#endif
@@ -0,0 +1,174 @@
+#include <RaSimulator.h>
+
+// Oval line: two straights joined by two half circles, driven counterclockwise
+#define SIM_OVAL_STRAIGHT 1.2f // m
+#define SIM_OVAL_RADIUS 0.45f  // m
+#define SIM_OVAL_SEGMENT 0.1f  // m, straight pieces
+#define SIM_OVAL_ARC_STEPS 24  // pieces of each half circle
+
+static void buildOval(RaSimWorld& world)
+{
+  std::vector<RaSimPoint> points;
+  float half = SIM_OVAL_STRAIGHT / 2;
+  int steps = (int)(SIM_OVAL_STRAIGHT / SIM_OVAL_SEGMENT + 0.5f);
+
+  for (int side = 0; side < 2; side++)
+  {
+    // Bottom straight towards +x then right half circle, top straight towards -x then left half circle
+    float direction = side ? -1 : 1;
+    for (int i = 0; i < steps; i++)
+    {
+      RaSimPoint point = {direction * (-half + i * SIM_OVAL_SEGMENT), -direction * SIM_OVAL_RADIUS};
+      points.push_back(point);
+    }
+    for (int i = 0; i < SIM_OVAL_ARC_STEPS; i++)
+    {
+      float angle = -1.5707963f + side * 3.1415927f + 3.1415927f * i / SIM_OVAL_ARC_STEPS;
+      RaSimPoint point = {direction * half + SIM_OVAL_RADIUS * cosf(angle), SIM_OVAL_RADIUS * sinf(angle)};
+      points.push_back(point);
+    }
+  }
+  world.setTrack(points.data(), points.size());
+  world.setPose(-0.3f, -SIM_OVAL_RADIUS, 0);
+}
+
+static void buildGuardedOval(RaSimWorld& world)
+{
+  // Crosses the top straight, in 10 s there and back
+  RaSimObstacle crossing = {0, SIM_OVAL_RADIUS + 0.5f, 0.05f, 0, -0.5f, 10000};
+
+  buildOval(world);
+  world.addObstacle(crossing);
+}
+
+static void buildAvoidArena(RaSimWorld& world)
+{
+  static const RaSimObstacle pillars[] = {
+    {1.2f, 0.6f, 0.08f, 0, 0, 0},
+    {2.2f, 1.4f, 0.08f, 0, 0, 0},
+    {1.7f, 1.1f, 0.08f, 0, 0, 0},
+    {0.9f, 1.5f, 0.08f, 0, 0, 0}
+  };
+
+  world.setArena(3.0f, 2.0f);
+  for (size_t i = 0; i < sizeof(pillars) / sizeof(pillars[0]); i++)
+  {
+    world.addObstacle(pillars[i]);
+  }
+  world.setPose(0.4f, 1.0f, 0);
+}
+
+static void buildFollowCorridor(RaSimWorld& world)
+{
+  // Walks 1.5 m away and back in 30 s
+  RaSimObstacle target = {0.75f, 0.5f, 0.05f, 1.5f, 0, 30000};
+
+  world.setArena(4.0f, 1.0f);
+  world.addObstacle(target);
+  world.setFollowTarget(0);
+  world.setPose(0.4f, 0.5f, 0);
+}
+
+static const RaSimScenario scenarios[] = {
+  {"line", BT_MODE_LINE_TRACKING, 0, 90000, buildOval},
+  {"guarded", BT_MODE_LINE_GUARDED, 0, 90000, buildGuardedOval},
+#if RA_USE_SERVO && RA_USE_RANGING
+  {"avoid", BT_MODE_AVOID, 150, 60000, buildAvoidArena},
+#endif
+#if RA_USE_RANGING
+  {"follow", BT_MODE_FOLLOWING, 150, 40000, buildFollowCorridor},
+#endif
+};
+
+int RaSimulator::getScenarioCount()
+{
+  return sizeof(scenarios) / sizeof(scenarios[0]);
+}
+
+const RaSimScenario& RaSimulator::getScenario(int index)
+{
+  return scenarios[index];
+}
+
+/**
+ * @brief Cherche un parcours par son nom.
+ *
+ * @return int son numéro, -1 s'il n'existe pas.
+ */
+int RaSimulator::findScenario(const char* name)
+{
+  for (int i = 0; i < getScenarioCount(); i++)
+  {
+    if (strcmp(scenarios[i].name, name) == 0)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Fait une course : la voiture démarre, prend les réglages, et reste dans le mode
+ * du parcours le temps de sa durée, une mise à jour (update) par SIM_LOOP_US.
+ *
+ * @param scenario le parcours.
+ * @param gains les réglages des modes automatiques.
+ * @param seed la graine des bruits (départ, capteurs).
+ * @return RaSimResult les mesures de la course.
+ */
+RaSimResult RaSimulator::run(const RaSimScenario& scenario, const RaControlGains& gains, unsigned long seed)
+{
+  RaSmartCar4WD car;
+  RaHostHardware& hw = car.getHardware();
+  RaSimWorld world(car, seed);
+  RaSimResult result;
+  unsigned long long latency = 0;
+
+  memset(&result, 0, sizeof(result));
+  scenario.build(world);
+  car.init();
+  car.setGains(gains);
+  car.setSpeed(scenario.speed);
+  car.setProfiling(true);
+  car.resetStats();
+  world.start();
+  hw.resetCounters();
+  car.setMode(scenario.mode);
+
+  unsigned long start = hw.millis();
+  while (hw.millis() - start < scenario.duration)
+  {
+    unsigned long before = hw.micros();
+    car.update();
+    unsigned long elapsed = hw.micros() - before;
+
+    result.loops++;
+    latency += elapsed;
+    result.loopMaxMicros = max(result.loopMaxMicros, elapsed);
+    hw.advance(SIM_LOOP_US);
+  }
+  world.stop();
+
+  const std::vector<unsigned long>& laps = world.getLapTimes();
+  result.laps = laps.size();
+  for (size_t i = 0; i < laps.size(); i++)
+  {
+    result.bestLapMillis = i == 0 ? laps[i] : min(result.bestLapMillis, laps[i]);
+    result.meanLapMillis += laps[i];
+  }
+  if (result.laps)
+  {
+    result.meanLapMillis /= result.laps;
+  }
+  result.crossTrackRms = world.getCrossTrackRms();
+  result.crossTrackMax = world.getCrossTrackMax();
+  result.collisions = world.getCollisions();
+  result.contactMillis = world.getContactMillis();
+  result.travelled = world.getTravelled();
+  result.followError = world.getFollowError();
+  result.blockedMillis = car.getBlockedMillis();
+  result.loopMeanMicros = result.loops ? latency / result.loops : 0;
+  result.modeStats = car.getModeStats(scenario.mode);
+  result.counters = hw.getCounters();
+  return result;
+}
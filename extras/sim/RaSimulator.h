@@ -0,0 +1,59 @@
+#ifndef RA_SIMULATOR_H
+#define RA_SIMULATOR_H
+
+#include <RaSimWorld.h>
+
+// Simulated time between two calls of update(), like a loop() with nothing else to do (us)
+#define SIM_LOOP_US 1000
+
+/**
+ * Parcours de simulation : le monde (construit par build), le mode et la vitesse de la voiture,
+ * la durée de la course.
+ */
+struct RaSimScenario
+{
+  const char* name;
+  int mode;                 // BT_MODE_*
+  int speed;                // setSpeed, for the modes that use it
+  unsigned long duration;   // ms
+  void (*build)(RaSimWorld& world);
+};
+
+/**
+ * Mesures d'une course simulée.
+ */
+struct RaSimResult
+{
+  unsigned long loops;
+  unsigned long laps;
+  unsigned long bestLapMillis; // 0 without a lap
+  unsigned long meanLapMillis;
+  float crossTrackRms;         // m
+  float crossTrackMax;         // m
+  unsigned long collisions;
+  unsigned long contactMillis;
+  float travelled;             // m
+  float followError;           // m
+  unsigned long blockedMillis; // in the mode waits
+  unsigned long loopMeanMicros; // simulated duration of update()
+  unsigned long loopMaxMicros;
+  RaModeStats modeStats;        // of the scenario mode
+  RaHostCounters counters;      // hardware calls during the run
+};
+
+/**
+ * Courses en boucle fermée : le code de la voiture (RA_HOST) pilote les moteurs d'une voiture simulée
+ * dans un RaSimWorld, le temps d'un parcours. Une course ne dépend que du parcours, des réglages
+ * et de la graine : elle donne les mêmes mesures à chaque fois, sur n'importe quel thread.
+ */
+class RaSimulator
+{
+public:
+  static int getScenarioCount();
+  static const RaSimScenario& getScenario(int index);
+  static int findScenario(const char* name);
+
+  static RaSimResult run(const RaSimScenario& scenario, const RaControlGains& gains, unsigned long seed);
+};
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * Sketch used by extras/size/size_table.sh: a car driven by the usual loop, so that the linker keeps
+ * what a real sketch uses, and the duration of init() printed on the serial port at each boot.
+ */
+#include <RaSmartCar4WD.h>
+
+RaSmartCar4WD car;
+unsigned long initMicros;
+
+void setup()
+{
+  unsigned long start = micros();
+  car.init();
+  initMicros = micros() - start;
+
+  // Without RA_USE_BLUETOOTH and RA_USE_DEBUG, init() leaves the serial port stopped
+  Serial.begin(SERIAL_BAUD);
+  Serial.print("init_us=");
+  Serial.println(initMicros);
+}
+
+void loop()
+{
+#if RA_USE_BLUETOOTH
+  car.enableBluetoothControl();
+#else
+  car.update();
+#endif
+}
@@ -0,0 +1,59 @@
+#!/bin/sh
+# Flash, SRAM and init() duration of the library for each subsystem configuration (see RaConfig.h).
+#
+# Needs arduino-cli with the arduino:avr core and the libraries the car uses (Servo and the
+# Keyestudio IR remote library), and avr-size. Sizes only by default; with a board on PORT, each
+# build is also uploaded and the duration of init() read back from the serial port:
+#
+#   extras/size/size_table.sh [PORT]
+#
+# Prints a Markdown table. FQBN selects another board (arduino:avr:uno by default).
+set -e
+
+ROOT=$(cd "$(dirname "$0")/../.." && pwd)
+SKETCH="$ROOT/extras/size/boot_time"
+FQBN=${FQBN:-arduino:avr:uno}
+PORT=$1
+BAUD=9600
+BUILD=$(mktemp -d)
+trap 'rm -rf "$BUILD"' EXIT
+
+# name|flags
+CONFIGS="all|
+no debug|-DRA_USE_DEBUG=0
+no IR|-DRA_USE_IR=0
+no Bluetooth|-DRA_USE_BLUETOOTH=0
+no matrix|-DRA_USE_MATRIX=0
+no servo|-DRA_USE_SERVO=0
+no grid|-DRA_USE_GRID=0
+no ranging|-DRA_USE_RANGING=0
+line tracking only|-DRA_USE_IR=0 -DRA_USE_BLUETOOTH=0 -DRA_USE_MATRIX=0 -DRA_USE_SERVO=0 -DRA_USE_RANGING=0 -DRA_USE_DEBUG=0"
+
+# Waits for the line printed by the sketch at boot (opening the port resets the board)
+read_init() {
+  stty -F "$PORT" "$BAUD" raw -echo
+  line=$(timeout 10 grep -m 1 '^init_us=' < "$PORT" || true)
+  line=$(echo "$line" | tr -d '\r' | sed 's/^init_us=//')
+  echo "${line:-?}"
+}
+
+echo "| Configuration | Flash (bytes) | SRAM (bytes) | init() (us) |"
+echo "|---|---:|---:|---:|"
+echo "$CONFIGS" | while IFS='|' read -r name flags; do
+  rm -rf "$BUILD"/*
+  arduino-cli compile --fqbn "$FQBN" --library "$ROOT" --output-dir "$BUILD" \
+    --build-property "build.extra_flags=$flags" "$SKETCH" > "$BUILD/compile.log" 2>&1 \
+    || { echo "| $name | build failed | | |"; continue; }
+
+  # Berkeley format: text data bss; flash = text + data, static SRAM = data + bss
+  set -- $(avr-size "$BUILD/boot_time.ino.elf" | tail -n 1)
+  flash=$(($1 + $2))
+  sram=$(($2 + $3))
+
+  boot="-"
+  if [ -n "$PORT" ]; then
+    arduino-cli upload --fqbn "$FQBN" --port "$PORT" --input-dir "$BUILD" "$SKETCH" > /dev/null 2>&1
+    boot=$(read_init)
+  fi
+  echo "| $name | $flash | $sram | $boot |"
+done
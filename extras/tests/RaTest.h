@@ -0,0 +1,60 @@
+#ifndef RA_TEST_H
+#define RA_TEST_H
+
+#include <stdio.h>
+#include <RaSmartCar4WD.h>
+
+/*
+ * Host test helpers: each test file is a program that returns a non-zero status
+ * when a check fails (see CMakeLists.txt).
+ */
+static int raTestFailures = 0;
+
+#define CHECK(condition)                                                           \
+  do                                                                               \
+  {                                                                                \
+    if(!(condition))                                                               \
+    {                                                                              \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      raTestFailures++;                                                            \
+    }                                                                              \
+  } while(0)
+
+#define CHECK_EQUAL(expected, actual)                                                              \
+  do                                                                                               \
+  {                                                                                                \
+    long e_ = (long)(expected);                                                                    \
+    long a_ = (long)(actual);                                                                      \
+    if(e_ != a_)                                                                                   \
+    {                                                                                              \
+      fprintf(stderr, "%s:%d: %s = %ld, expected %ld\n", __FILE__, __LINE__, #actual, a_, e_); \
+      raTestFailures++;                                                                            \
+    }                                                                                              \
+  } while(0)
+
+#define TEST_RESULT() (raTestFailures ? 1 : 0)
+
+// Runs the loop for a while, one update per millisecond; echo = 0: no echo edges, else an echo
+// of this width (us) at the start of each millisecond
+inline void run(RaSmartCar4WD& car, unsigned long ms, unsigned long echo = 0)
+{
+  RaHostHardware& hw = car.getHardware();
+
+  for (unsigned long i = 0; i < ms; i++)
+  {
+    if(echo)
+    {
+      hw.setInput(PIN_ECHO, HIGH);
+      hw.advance(echo);
+      hw.setInput(PIN_ECHO, LOW);
+      hw.advance(1000 - echo);
+    }
+    else
+    {
+      hw.advance(1000);
+    }
+    car.update();
+  }
+}
+
+#endif
@@ -0,0 +1,108 @@
+#include <RaSmartCar4WD.h>
+#include "RaTest.h"
+
+/*
+ * Link supervision: worst-case stopping latency, LED signal and trip log.
+ */
+
+#define PRESS_PERIOD 50 // ms, an application repeating its command
+
+// Drives forward with repeated presses, then releases: time from the last command to stopped wheels
+static unsigned long stopLatency(RaSmartCar4WD& car, unsigned long timeout)
+{
+  RaHostHardware& hw = car.getHardware();
+
+  car.setLinkTimeout(timeout);
+  car.setMode(BT_MODE_REMOTE);
+  for (int i = 0; i < 10; i++)
+  {
+    hw.getRemote().press(IR_KEY_UP);
+    run(car, PRESS_PERIOD);
+  }
+  CHECK(hw.getPwm(PIN_MOTOR_L_PWM) > 0);
+
+  hw.getRemote().press(IR_KEY_UP);
+  run(car, 1);
+  unsigned long last = hw.millis();
+  while(hw.getPwm(PIN_MOTOR_L_PWM) > 0 || hw.getPwm(PIN_MOTOR_R_PWM) > 0)
+  {
+    run(car, 1);
+    if(hw.millis() - last > 10 * timeout)
+    {
+      break;
+    }
+  }
+  return hw.millis() - last;
+}
+
+static void testWorstCaseLatency()
+{
+  const unsigned long timeouts[] = {100, 300, 1000};
+
+  for (unsigned int i = 0; i < sizeof(timeouts) / sizeof(timeouts[0]); i++)
+  {
+    RaSmartCar4WD car;
+    car.init();
+    car.setSpeed(200);
+
+    unsigned long latency = stopLatency(car, timeouts[i]);
+    // Documented bound: timeout + ramp + one loop (1 ms here)
+    CHECK(latency > timeouts[i]);
+    CHECK(latency <= timeouts[i] + FAILSAFE_RAMP_TIME + 1);
+    printf("timeout %lu ms: wheels stopped %lu ms after the last command\n", timeouts[i], latency);
+  }
+}
+
+static void testLinkLostSignalEnds()
+{
+  RaSmartCar4WD car;
+  RaHostHardware& hw = car.getHardware();
+
+  car.init();
+  car.setSpeed(200);
+  car.setLedStatus(LED_STATUS_READY);
+  stopLatency(car, 200);
+  CHECK_EQUAL(LED_STATUS_LINK_LOST, car.getLedStatus());
+
+  // Still blinking while the link is lost, back to the permanent state with the next command
+  run(car, 1000);
+  CHECK_EQUAL(LED_STATUS_LINK_LOST, car.getLedStatus());
+  hw.getRemote().press(IR_KEY_UP);
+  run(car, 1);
+  CHECK_EQUAL(LED_STATUS_READY, car.getLedStatus());
+}
+
+static void testTripLog()
+{
+  RaSmartCar4WD car;
+  RaHostHardware& hw = car.getHardware();
+
+  car.init();
+  car.setSpeed(200);
+  CHECK_EQUAL(0, car.getTripCount());
+  CHECK_EQUAL(FAILSAFE_NONE, car.getTrip(0).reason);
+
+  stopLatency(car, 200);
+  CHECK_EQUAL(1, car.getTripCount());
+  CHECK_EQUAL(FAILSAFE_LINK_IR, car.getTrip(0).reason);
+  unsigned long first = car.getTrip(0).time;
+  CHECK(first > 0 && first <= hw.millis());
+
+  // The log keeps the last ones, most recent first
+  for (int i = 0; i < FAILSAFE_LOG_SIZE + 1; i++)
+  {
+    stopLatency(car, 200);
+  }
+  CHECK_EQUAL(FAILSAFE_LOG_SIZE + 2, car.getTripCount());
+  CHECK(car.getTrip(0).time > car.getTrip(1).time);
+  CHECK(car.getTrip(FAILSAFE_LOG_SIZE - 1).time > first);
+  CHECK_EQUAL(FAILSAFE_NONE, car.getTrip(FAILSAFE_LOG_SIZE).reason);
+}
+
+int main()
+{
+  testWorstCaseLatency();
+  testLinkLostSignalEnds();
+  testTripLog();
+  return TEST_RESULT();
+}
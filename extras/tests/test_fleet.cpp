@@ -0,0 +1,173 @@
+#include <RaSimFleet.h>
+#include "RaTest.h"
+
+/*
+ * Fleet simulator: the cars share nothing, their results do not depend on the thread count.
+ */
+
+#define FLEET_CARS 8
+#define FLEET_DURATION 5000
+
+static void fill(RaSimFleet& fleet, unsigned long seed)
+{
+  RaControlGains gains = GAINS_DEFAULT;
+
+  for (int i = 0; i < FLEET_CARS; i++)
+  {
+    RaSimScenario scenario = RaSimulator::getScenario(i % RaSimulator::getScenarioCount());
+    scenario.duration = FLEET_DURATION;
+    fleet.add(scenario, gains, seed + i);
+  }
+}
+
+static void countJob(void* context, int index)
+{
+  ((std::atomic<int>*)context)[index]++;
+}
+
+static void testPoolRunsEachJobOnce()
+{
+  RaSimPool pool(4);
+  std::atomic<int> runs[100];
+
+  for (int i = 0; i < 100; i++)
+  {
+    runs[i] = 0;
+  }
+  // Several batches in a row: a late thread must not take the jobs of the next one
+  for (int batch = 0; batch < 20; batch++)
+  {
+    pool.run(100, countJob, runs);
+  }
+  CHECK_EQUAL(4, pool.getThreadCount());
+  for (int i = 0; i < 100; i++)
+  {
+    CHECK_EQUAL(20, runs[i]);
+  }
+}
+
+// Batches of different tasks, contexts and sizes: a job of one batch must never run with another
+struct PoolBatch
+{
+  int size;
+  std::atomic<int> runs[64];
+  std::atomic<int> stray; // out of range indices
+};
+
+static void markJob(void* context, int index)
+{
+  PoolBatch* batch = (PoolBatch*)context;
+
+  if (index < 0 || index >= batch->size)
+  {
+    batch->stray++;
+    return;
+  }
+  batch->runs[index]++;
+}
+
+static void markTwiceJob(void* context, int index)
+{
+  PoolBatch* batch = (PoolBatch*)context;
+
+  if (index < 0 || index >= batch->size)
+  {
+    batch->stray++;
+    return;
+  }
+  batch->runs[index] += 2;
+}
+
+static void testPoolBatchesDiffer()
+{
+  RaSimPool pool(8);
+  int wrong = 0;
+
+  for (int i = 0; i < 2000; i++)
+  {
+    // A new context for each batch, on the stack like the fleets of RaSimTuner::evaluate
+    PoolBatch batch;
+    bool large = i % 2 == 0;
+    batch.size = large ? 64 : 3;
+    batch.stray = 0;
+    for (int j = 0; j < 64; j++)
+    {
+      batch.runs[j] = 0;
+    }
+    pool.run(batch.size, large ? markJob : markTwiceJob, &batch);
+
+    for (int j = 0; j < 64; j++)
+    {
+      wrong += batch.runs[j] != (j < batch.size ? (large ? 1 : 2) : 0);
+    }
+    wrong += batch.stray;
+  }
+  CHECK_EQUAL(0, wrong);
+}
+
+static void testParallelMatchesSerial()
+{
+  RaSimPool serialPool(1);
+  RaSimPool pool(FLEET_CARS);
+  RaSimFleet serial(serialPool);
+  RaSimFleet parallel(pool);
+
+  fill(serial, 1);
+  fill(parallel, 1);
+  serial.run();
+  parallel.run();
+  CHECK(parallel.matches(serial));
+  for (int i = 0; i < FLEET_CARS; i++)
+  {
+    const RaSimResult& a = serial.getCar(i).result;
+    const RaSimResult& b = parallel.getCar(i).result;
+    CHECK(a.loops > 0);
+    CHECK_EQUAL(a.loops, b.loops);
+    CHECK_EQUAL(a.collisions, b.collisions);
+    CHECK_EQUAL(a.counters.digitalWrites, b.counters.digitalWrites);
+    CHECK_EQUAL(a.counters.pulseIns, b.counters.pulseIns);
+    CHECK(a.travelled > 0 && a.travelled == b.travelled);
+  }
+
+  // Another seed changes the runs
+  RaSimFleet other(pool);
+  fill(other, 100);
+  other.run();
+  CHECK(!other.matches(serial));
+}
+
+static void testStats()
+{
+  RaSimPool pool(2);
+  RaSimFleet fleet(pool);
+
+  fill(fleet, 1);
+  fleet.run();
+  RaSimFleetStats stats = fleet.getStats();
+  unsigned long collisions = 0;
+  unsigned long loopMax = 0;
+  for (int i = 0; i < fleet.getCarCount(); i++)
+  {
+    collisions += fleet.getCar(i).result.collisions;
+    loopMax = max(loopMax, fleet.getCar(i).result.loopMaxMicros);
+  }
+  CHECK_EQUAL(FLEET_CARS, stats.cars);
+  CHECK(stats.carSeconds == FLEET_CARS * FLEET_DURATION / 1000.0);
+  CHECK(stats.wallSeconds > 0);
+  CHECK_EQUAL(collisions, stats.collisions);
+  CHECK_EQUAL(loopMax, stats.loopMaxMicros);
+  CHECK(stats.loopMeanMicros <= stats.loopMaxMicros);
+  printf("%d cars: %.0f car-seconds per second\n", stats.cars, stats.carSeconds / stats.wallSeconds);
+
+  fleet.clear();
+  CHECK_EQUAL(0, fleet.getCarCount());
+}
+
+int main()
+{
+  testPoolRunsEachJobOnce();
+  testPoolBatchesDiffer();
+  testParallelMatchesSerial();
+  testStats();
+  return TEST_RESULT();
+}
@@ -0,0 +1,69 @@
+#include <RaSmartCar4WD.h>
+#include "RaTest.h"
+
+/*
+ * Multi-rate sensor fusion: the guarded line tracking mode and its hand-over to the remote mode.
+ */
+
+static void testHandOverKeepsKey(uint8_t key, uint8_t left, uint8_t right)
+{
+  RaSmartCar4WD car;
+  RaHostHardware& hw = car.getHardware();
+
+  car.init();
+  car.setSpeed(200);
+  hw.setInput(PIN_TRACKING_MIDDLE, HIGH);
+  car.setMode(BT_MODE_LINE_GUARDED);
+  // Still until the first ping times out: the way is clear
+  run(car, RANGING_ECHO_TIMEOUT + 10);
+  CHECK_EQUAL(car.getGains().lineSpeed, hw.getPwm(PIN_MOTOR_L_PWM));
+
+  // One press: the remote mode takes over, then applies the same key on its first step
+  hw.getRemote().press(key);
+  run(car, 1);
+  CHECK_EQUAL(BT_MODE_REMOTE, car.getMode());
+  CHECK_EQUAL(key, car.getWorld().irKey);
+  run(car, 1);
+  CHECK_EQUAL(200, hw.getPwm(PIN_MOTOR_L_PWM));
+  CHECK_EQUAL(left, hw.getOutput(PIN_MOTOR_L_CTRL));
+  CHECK_EQUAL(right, hw.getOutput(PIN_MOTOR_R_CTRL));
+  CHECK_EQUAL(IR_KEY_NONE, car.getWorld().irKey);
+
+  // Applied once: the next updates keep the command
+  run(car, 10);
+  CHECK_EQUAL(200, hw.getPwm(PIN_MOTOR_L_PWM));
+}
+
+static void testGuardStopsBeforeObstacle()
+{
+  RaSmartCar4WD car;
+  RaHostHardware& hw = car.getHardware();
+
+  car.init();
+  hw.setInput(PIN_TRACKING_MIDDLE, HIGH);
+  car.setMode(BT_MODE_LINE_GUARDED);
+  // No distance yet: the car waits until the first ping times out, the way is then clear
+  run(car, 20);
+  CHECK_EQUAL(0, hw.getPwm(PIN_MOTOR_L_PWM));
+  run(car, RANGING_ECHO_TIMEOUT);
+  CHECK(hw.getPwm(PIN_MOTOR_L_PWM) > 0);
+
+  // A 10 cm echo every millisecond: the ranging array only listens after its own pings
+  for (int i = 0; i < 200; i++)
+  {
+    hw.setInput(PIN_ECHO, HIGH);
+    hw.advance(600);
+    hw.setInput(PIN_ECHO, LOW);
+    run(car, 1);
+  }
+  CHECK_EQUAL(10, car.getWorld().distance);
+  CHECK_EQUAL(0, hw.getPwm(PIN_MOTOR_L_PWM));
+}
+
+int main()
+{
+  testHandOverKeepsKey(IR_KEY_UP, HIGH, HIGH);
+  testHandOverKeepsKey(IR_KEY_LEFT, LOW, HIGH);
+  testGuardStopsBeforeObstacle();
+  return TEST_RESULT();
+}
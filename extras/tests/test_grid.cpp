@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <RaOccupancyGrid.h>
+#include "RaTest.h"
+
+/*
+ * Occupancy grid: rays mark the crossed cells free and the obstacle cell occupied, clearance
+ * reads the map back, the odometry follows the commanded speeds and the window scrolls with the
+ * car over its circular storage.
+ */
+
+static void testRay()
+{
+  RaOccupancyGrid grid;
+
+  // Straight ahead, 55 cm: cells 0 to 4 crossed, cell 5 hit, nothing beyond
+  grid.addRange(0, 55);
+  for (long cx = 0; cx < 5; cx++)
+  {
+    CHECK_EQUAL(-GRID_MISS, grid.getCell(cx, 0));
+  }
+  CHECK_EQUAL(GRID_HIT, grid.getCell(5, 0));
+  CHECK_EQUAL(0, grid.getCell(6, 0));
+  CHECK_EQUAL(0, grid.getCell(5, 1));
+
+  // Nothing seen on the left: free up to the edge of the window
+  grid.addRange(90, 0);
+  for (long cy = 1; cy < GRID_SIZE / 2; cy++)
+  {
+    CHECK_EQUAL(-GRID_MISS, grid.getCell(0, cy));
+  }
+  CHECK_EQUAL(-2 * GRID_MISS, grid.getCell(0, 0));
+
+  // Behind, 30 cm: the hit is on the cell at -3
+  grid.addRange(180, 30);
+  CHECK_EQUAL(GRID_HIT, grid.getCell(-3, 0));
+  CHECK_EQUAL(-GRID_MISS, grid.getCell(-2, 0));
+
+  // The log-odds saturate
+  for (int i = 0; i < GRID_LIMIT / GRID_MISS; i++)
+  {
+    grid.addRange(0, 55);
+  }
+  CHECK_EQUAL(GRID_LIMIT, grid.getCell(5, 0));
+  CHECK_EQUAL(-GRID_LIMIT, grid.getCell(1, 0));
+}
+
+static void testClearance()
+{
+  RaOccupancyGrid grid;
+
+  // Nothing observed yet
+  CHECK_EQUAL(-1, grid.clearance(0));
+
+  // One hit is not enough to call a cell occupied: free up to the edge of the window; two are
+  grid.addRange(0, 55);
+  CHECK(GRID_HIT <= GRID_OCCUPIED);
+  CHECK_EQUAL(GRID_SIZE / 2 * GRID_CELL, grid.clearance(0));
+  grid.addRange(0, 55);
+  CHECK_EQUAL(50, grid.clearance(0));
+
+  // Free to the edge of the window on the left, unknown on the right
+  grid.addRange(90, 0);
+  // (90 degrees is 16380 heading units: the ray leans by a few mm)
+  CHECK(abs(grid.clearance(90) - GRID_SIZE / 2 * GRID_CELL) < GRID_CELL);
+  CHECK_EQUAL(-1, grid.clearance(-90));
+}
+
+static void testStraightOdometry()
+{
+  RaOccupancyGrid grid;
+
+  // Full speed for one second: ODOMETRY_SPEED
+  grid.move(1000, 255, 255);
+  grid.move(2000, 255, 255);
+  CHECK_EQUAL(ODOMETRY_SPEED / 10, grid.getX());
+  CHECK_EQUAL(0, grid.getY());
+  CHECK_EQUAL(0, grid.getHeading());
+
+  // Half speed backwards for one second: half the way back
+  grid.move(2000, -128, -128);
+  grid.move(3000, 0, 0);
+  CHECK(abs(grid.getX() - ODOMETRY_SPEED / 20) <= 1);
+
+  // Stopped: no move however long
+  grid.move(60000, 0, 0);
+  CHECK(abs(grid.getX() - ODOMETRY_SPEED / 20) <= 1);
+  CHECK_EQUAL(0, grid.getY());
+}
+
+static void testTurnOdometry()
+{
+  RaOccupancyGrid grid;
+  long tolerance = HEADING_DEGREES(1);
+
+  // Spin left for a quarter of ODOMETRY_TURN_RATE: on the spot, a quarter turn
+  grid.move(0, -255, 255);
+  grid.move(90000 / ODOMETRY_TURN_RATE, 0, 0);
+  CHECK(labs((long)grid.getHeading() - HEADING_DEGREES(90)) <= tolerance);
+  CHECK_EQUAL(0, grid.getX());
+  CHECK_EQUAL(0, grid.getY());
+
+  // Forward along the new heading: y grows
+  grid.move(1000, 255, 255);
+  grid.move(2000, 0, 0);
+  CHECK(abs(grid.getX()) <= 1);
+  CHECK(abs(grid.getY() - ODOMETRY_SPEED / 10) <= 1);
+
+  // The ray follows the heading: straight ahead is now the y axis
+  grid.addRange(0, 35);
+  CHECK_EQUAL(GRID_HIT, grid.getCell(0, (ODOMETRY_SPEED / 10 + 35) / GRID_CELL));
+
+  // Spin right for a half turn
+  grid.move(2000, 255, -255);
+  grid.move(2000 + 180000 / ODOMETRY_TURN_RATE, 0, 0);
+  CHECK(labs((long)(int16_t)grid.getHeading() - HEADING_DEGREES(-90)) <= 2 * tolerance);
+}
+
+static void testScroll()
+{
+  RaOccupancyGrid grid;
+
+  // An obstacle behind, on the cell at -3; the window spans -8 to 7
+  grid.addRange(180, 30);
+  CHECK_EQUAL(GRID_HIT, grid.getCell(-3, 0));
+  CHECK_EQUAL(0, grid.getCell(-3 + GRID_SIZE, 0));
+
+  // 50 cm ahead: the window spans -3 to 12, the obstacle is on its edge and kept
+  grid.move(0, 255, 255);
+  grid.move(1000, 0, 0);
+  CHECK_EQUAL(5, grid.getX() / GRID_CELL);
+  CHECK_EQUAL(GRID_HIT, grid.getCell(-3, 0));
+  CHECK_EQUAL(-GRID_MISS, grid.getCell(-2, 0));
+  CHECK_EQUAL(0, grid.getCell(12, 0));
+
+  // 10 cm more: column -3 leaves, column 13 enters on the same storage, cleared
+  grid.move(1000, 255, 255);
+  grid.move(1200, 0, 0);
+  CHECK_EQUAL(6, grid.getX() / GRID_CELL);
+  CHECK_EQUAL(0, grid.getCell(-3, 0));
+  CHECK_EQUAL(0, grid.getCell(-3 + GRID_SIZE, 0));
+  CHECK_EQUAL(-GRID_MISS, grid.getCell(-2, 0));
+
+  // A hit on the entering column stays there and only there
+  grid.addRange(0, (-3 + GRID_SIZE) * GRID_CELL - grid.getX() + GRID_CELL / 2);
+  CHECK_EQUAL(GRID_HIT, grid.getCell(-3 + GRID_SIZE, 0));
+  CHECK_EQUAL(0, grid.getCell(-3, 0));
+
+  // Further than the window: every column has been cleared on its way in, nothing old shows through
+  for (unsigned long t = 1200; t < 5200; t += 1000)
+  {
+    grid.move(t, 255, 255);
+  }
+  grid.move(5200, 0, 0);
+  CHECK(grid.getX() / GRID_CELL >= 6 + GRID_SIZE);
+  for (long cx = grid.getX() / GRID_CELL - GRID_SIZE / 2; cx < grid.getX() / GRID_CELL + GRID_SIZE / 2; cx++)
+  {
+    CHECK_EQUAL(0, grid.getCell(cx, 0));
+  }
+}
+
+int main()
+{
+  testRay();
+  testClearance();
+  testStraightOdometry();
+  testTurnOdometry();
+  testScroll();
+  return TEST_RESULT();
+}
@@ -0,0 +1,168 @@
+#include <RaSmartCar4WD.h>
+#include "RaTest.h"
+
+/*
+ * The control code of the library, run against the simulated hardware layer.
+ */
+
+static void testRemoteDrivesMotors()
+{
+  RaSmartCar4WD car;
+  RaHostHardware& hw = car.getHardware();
+
+  car.init();
+  car.setSpeed(200);
+  car.setMode(BT_MODE_REMOTE);
+
+  hw.getRemote().press(IR_KEY_UP);
+  run(car, 1);
+  CHECK_EQUAL(200, hw.getPwm(PIN_MOTOR_L_PWM));
+  CHECK_EQUAL(200, hw.getPwm(PIN_MOTOR_R_PWM));
+  CHECK_EQUAL(HIGH, hw.getOutput(PIN_MOTOR_L_CTRL));
+  CHECK_EQUAL(HIGH, hw.getOutput(PIN_MOTOR_R_CTRL));
+
+  hw.getRemote().press(IR_KEY_LEFT);
+  run(car, 1);
+  CHECK_EQUAL(LOW, hw.getOutput(PIN_MOTOR_L_CTRL));
+  CHECK_EQUAL(HIGH, hw.getOutput(PIN_MOTOR_R_CTRL));
+
+  hw.getRemote().press(IR_KEY_DOWN);
+  run(car, 1);
+  CHECK_EQUAL(LOW, hw.getOutput(PIN_MOTOR_L_CTRL));
+  CHECK_EQUAL(LOW, hw.getOutput(PIN_MOTOR_R_CTRL));
+  CHECK_EQUAL(200, hw.getPwm(PIN_MOTOR_L_PWM));
+
+  hw.getRemote().press(IR_KEY_OK);
+  run(car, 1);
+  CHECK_EQUAL(0, hw.getPwm(PIN_MOTOR_L_PWM));
+  CHECK_EQUAL(0, hw.getPwm(PIN_MOTOR_R_PWM));
+}
+
+static void testLinkLossRamp()
+{
+  RaSmartCar4WD car;
+  RaHostHardware& hw = car.getHardware();
+
+  car.init();
+  car.setSpeed(200);
+  car.setLinkTimeout(200);
+  car.setMode(BT_MODE_REMOTE);
+  hw.getRemote().press(IR_KEY_UP);
+  run(car, 1);
+
+  // Still in time: full speed
+  run(car, 199);
+  CHECK_EQUAL(200, hw.getPwm(PIN_MOTOR_L_PWM));
+  CHECK_EQUAL(FAILSAFE_NONE, car.getFailsafeReason());
+
+  // Link lost: the speed only goes down, and the wheels stop within the ramp
+  int last = hw.getPwm(PIN_MOTOR_L_PWM);
+  bool ramped = false;
+  for (int i = 0; i < FAILSAFE_RAMP_TIME + 5; i++)
+  {
+    run(car, 1);
+    int pwm = hw.getPwm(PIN_MOTOR_L_PWM);
+    CHECK(pwm <= last);
+    ramped = ramped || (pwm > 0 && pwm < 200);
+    last = pwm;
+  }
+  CHECK(ramped);
+  CHECK_EQUAL(0, hw.getPwm(PIN_MOTOR_L_PWM));
+  CHECK_EQUAL(0, hw.getPwm(PIN_MOTOR_R_PWM));
+  CHECK_EQUAL(FAILSAFE_LINK_IR, car.getFailsafeReason());
+}
+
+static void testPulseInDistance()
+{
+  RaSmartCar4WD car;
+  RaHostHardware& hw = car.getHardware();
+
+  car.init();
+
+  // 58.2 us per cm, round trip
+  hw.setPulse(PIN_ECHO, 582);
+  CHECK_EQUAL(100, car.getDistanceTenths());
+
+  hw.setPulse(PIN_ECHO, 5820);
+  float distance = car.getDistance();
+  CHECK(distance > 99.8f && distance < 100.2f);
+
+  // No echo within the range: no reading, and the wait is bounded
+  unsigned long start = hw.micros();
+  CHECK_EQUAL(RANGING_NO_READING, car.getDistanceTenths());
+  CHECK(hw.micros() - start <= RaRangingArray::echoTimeout(RANGING_MAX_RANGE) + 100);
+}
+
+static void testCountersAndBusBytes()
+{
+  RaSmartCar4WD car;
+  RaHostHardware& hw = car.getHardware();
+
+  car.init();
+  hw.resetCounters();
+  car.goForward(200);
+  RaHostCounters counters = hw.getCounters();
+  CHECK_EQUAL(2, counters.digitalWrites);
+  CHECK_EQUAL(2, counters.analogWrites);
+  // Symbol sent to the matrix: data command, address, changed columns
+  CHECK(counters.matrixBytes > 2);
+
+  // The same symbol again changes no column
+  hw.resetCounters();
+  car.goForward(200);
+  CHECK_EQUAL(0, hw.getCounters().matrixBytes);
+
+  hw.resetCounters();
+  car.saveGains();
+  CHECK_EQUAL(sizeof(RaControlGains) + 3, hw.getCounters().eepromWrites);
+}
+
+struct Wakeups
+{
+  unsigned long calls;
+  unsigned long last;
+};
+
+static unsigned long wakeEveryMillisecond(void* context, unsigned long now)
+{
+  Wakeups* wakeups = (Wakeups*)context;
+  wakeups->calls++;
+  wakeups->last = now;
+  return now - now % 1000 + 1000;
+}
+
+static void testSimulationSteppedThroughWaits()
+{
+  RaHostHardware hw;
+  Wakeups wakeups = {0, 0};
+
+  hw.setSimulation(wakeEveryMillisecond, &wakeups);
+  CHECK_EQUAL(1, wakeups.calls);
+
+  // A 5 ms wait goes through each millisecond
+  hw.delay(5);
+  CHECK_EQUAL(6, wakeups.calls);
+  CHECK_EQUAL(5000, wakeups.last);
+
+  // An output change wakes it at once, an unchanged one does not
+  hw.delayMicroseconds(300);
+  hw.digitalWrite(PIN_TRIGGER, HIGH);
+  hw.digitalWrite(PIN_TRIGGER, HIGH);
+  hw.delayMicroseconds(10);
+  CHECK_EQUAL(7, wakeups.calls);
+  CHECK_EQUAL(5300, wakeups.last);
+
+  hw.setSimulation(NULL, NULL);
+  hw.delay(5);
+  CHECK_EQUAL(7, wakeups.calls);
+}
+
+int main()
+{
+  testRemoteDrivesMotors();
+  testLinkLossRamp();
+  testPulseInDistance();
+  testCountersAndBusBytes();
+  testSimulationSteppedThroughWaits();
+  return TEST_RESULT();
+}
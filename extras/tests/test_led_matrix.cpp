@@ -0,0 +1,215 @@
+#include <vector>
+#include <RaSmartCar4WD.h>
+#include "RaTest.h"
+
+/*
+ * AiP1640 driver: the clock and data edges are decoded back into transfers (start condition,
+ * bytes read LSB first on the rising clock edge, stop condition).
+ */
+
+struct BusDecoder
+{
+  RaHostHardware* hw;
+  bool clock;
+  bool data;
+  bool inTransfer;
+  uint8_t bits;
+  uint8_t value;
+  int edges;
+  int framingErrors;
+  std::vector<uint8_t> current;
+  std::vector<std::vector<uint8_t> > transfers;
+};
+
+static void onEdge(void* context)
+{
+  BusDecoder& bus = *(BusDecoder*)context;
+  bool clock = bus.hw->getOutput(PIN_MATRIX_CLOCK);
+  bool data = bus.hw->getOutput(PIN_MATRIX_DATA);
+
+  bus.edges++;
+  if (clock != bus.clock)
+  {
+    if (clock && bus.inTransfer)
+    {
+      bus.value |= data << bus.bits;
+      if (++bus.bits == 8)
+      {
+        bus.current.push_back(bus.value);
+        bus.bits = 0;
+        bus.value = 0;
+      }
+    }
+  }
+  else if (clock && data != bus.data)
+  {
+    if (!data)
+    {
+      // Start
+      bus.inTransfer = true;
+      bus.current.clear();
+      bus.bits = 0;
+      bus.value = 0;
+    }
+    else if (bus.inTransfer)
+    {
+      // Stop: the clock rises once more after the last byte, with the data low
+      bus.framingErrors += bus.bits != 1 || bus.value != 0;
+      bus.transfers.push_back(bus.current);
+      bus.inTransfer = false;
+    }
+  }
+  bus.clock = clock;
+  bus.data = data;
+}
+
+static void attach(RaHostHardware& hw, BusDecoder& bus)
+{
+  bus.hw = &hw;
+  bus.clock = hw.getOutput(PIN_MATRIX_CLOCK);
+  bus.data = hw.getOutput(PIN_MATRIX_DATA);
+  bus.inTransfer = false;
+  bus.bits = 0;
+  bus.value = 0;
+  bus.edges = 0;
+  bus.framingErrors = 0;
+  hw.attachChange(PIN_MATRIX_CLOCK, onEdge, &bus);
+  hw.attachChange(PIN_MATRIX_DATA, onEdge, &bus);
+}
+
+static void clear(BusDecoder& bus)
+{
+  bus.transfers.clear();
+  bus.edges = 0;
+}
+
+static void checkTransfer(BusDecoder& bus, size_t index, const uint8_t* bytes, size_t count)
+{
+  CHECK(index < bus.transfers.size());
+  if (index >= bus.transfers.size())
+  {
+    return;
+  }
+  const std::vector<uint8_t>& transfer = bus.transfers[index];
+  CHECK_EQUAL(count, transfer.size());
+  for (size_t i = 0; i < count && i < transfer.size(); i++)
+  {
+    CHECK_EQUAL(bytes[i], transfer[i]);
+  }
+}
+
+static void testFullFrame()
+{
+  RaHostHardware hw;
+  RaLedMatrix matrix(hw, PIN_MATRIX_CLOCK, PIN_MATRIX_DATA);
+  BusDecoder bus;
+  static const uint8_t command[] = {AIP1640_DATA_AUTO};
+  static const uint8_t control[] = {AIP1640_DISPLAY_ON | LED_MATRIX_BRIGHTNESS};
+  uint8_t frame[1 + LED_MATRIX_SIZE] = {AIP1640_ADDRESS};
+
+  attach(hw, bus);
+  matrix.init();
+  // Unknown content at startup: every column, then the display control (8A)
+  CHECK_EQUAL(3, bus.transfers.size());
+  checkTransfer(bus, 0, command, 1);
+  checkTransfer(bus, 1, frame, sizeof(frame));
+  checkTransfer(bus, 2, control, 1);
+  CHECK_EQUAL(0, bus.framingErrors);
+  CHECK(!matrix.isBusy());
+
+  unsigned char entries[LED_MATRIX_SIZE];
+  for (uint8_t i = 0; i < LED_MATRIX_SIZE; i++)
+  {
+    entries[i] = i * 16 + 1;
+    frame[1 + i] = entries[i];
+  }
+  clear(bus);
+  matrix.display(entries);
+  CHECK_EQUAL(2, bus.transfers.size());
+  checkTransfer(bus, 0, command, 1);
+  checkTransfer(bus, 1, frame, sizeof(frame));
+  CHECK_EQUAL(0, bus.framingErrors);
+}
+
+static void testPartialAndUnchanged()
+{
+  RaHostHardware hw;
+  RaLedMatrix matrix(hw, PIN_MATRIX_CLOCK, PIN_MATRIX_DATA);
+  BusDecoder bus;
+  static const uint8_t command[] = {AIP1640_DATA_AUTO};
+  static const uint8_t columns[] = {0xAA, 0x00, 0x55};
+  static const uint8_t expected[] = {AIP1640_ADDRESS | 3, 0xAA, 0x00, 0x55};
+
+  attach(hw, bus);
+  matrix.init();
+
+  // Columns 3 and 5 change: the range 3 to 5 is sent, column 4 with its old value
+  clear(bus);
+  matrix.write(3, columns, 3);
+  CHECK_EQUAL(2, bus.transfers.size());
+  checkTransfer(bus, 0, command, 1);
+  checkTransfer(bus, 1, expected, sizeof(expected));
+  CHECK_EQUAL(0, bus.framingErrors);
+
+  // The same columns again: nothing on the bus
+  clear(bus);
+  matrix.write(3, columns, 3);
+  unsigned char entries[LED_MATRIX_SIZE] = {0, 0, 0, 0xAA, 0x00, 0x55};
+  matrix.display(entries);
+  CHECK_EQUAL(0, bus.edges);
+  CHECK_EQUAL(0, bus.transfers.size());
+
+  // Brightness and display off: one control command each
+  static const uint8_t brightness[] = {AIP1640_DISPLAY_ON | 5};
+  static const uint8_t off[] = {AIP1640_DISPLAY_OFF | 5};
+  matrix.setBrightness(5);
+  matrix.setOn(false);
+  CHECK_EQUAL(2, bus.transfers.size());
+  checkTransfer(bus, 0, brightness, 1);
+  checkTransfer(bus, 1, off, 1);
+}
+
+static void testAsyncSteps()
+{
+  RaHostHardware hw;
+  RaLedMatrix matrix(hw, PIN_MATRIX_CLOCK, PIN_MATRIX_DATA);
+  BusDecoder bus;
+  static const uint8_t columns[] = {0x01, 0x02};
+
+  attach(hw, bus);
+  matrix.init();
+  matrix.setAsync(true);
+  clear(bus);
+
+  // write() returns at once: each step (one interrupt) sends one piece
+  matrix.write(0, columns, 2);
+  CHECK_EQUAL(0, bus.edges);
+  CHECK(matrix.isBusy());
+
+  CHECK(matrix.transferStep()); // finds the changed range
+  CHECK_EQUAL(0, bus.edges);
+  CHECK(matrix.transferStep()); // data command
+  CHECK_EQUAL(1, bus.transfers.size());
+  CHECK(matrix.transferStep()); // start and address
+  CHECK_EQUAL(1, bus.current.size());
+  CHECK_EQUAL(AIP1640_ADDRESS, bus.current[0]);
+  CHECK(matrix.transferStep()); // column 0
+  CHECK_EQUAL(2, bus.current.size());
+  CHECK_EQUAL(1, bus.transfers.size());
+  CHECK(matrix.transferStep()); // column 1 and stop
+  CHECK_EQUAL(2, bus.transfers.size());
+  CHECK(!matrix.transferStep());
+  CHECK(!matrix.isBusy());
+
+  static const uint8_t expected[] = {AIP1640_ADDRESS, 0x01, 0x02};
+  checkTransfer(bus, 1, expected, sizeof(expected));
+  CHECK_EQUAL(0, bus.framingErrors);
+}
+
+int main()
+{
+  testFullFrame();
+  testPartialAndUnchanged();
+  testAsyncSteps();
+  return TEST_RESULT();
+}
@@ -0,0 +1,50 @@
+#include <RaMatrixAnimation.h>
+#include "RaTest.h"
+
+/*
+ * Drawing primitives of the matrix animation engine.
+ */
+
+static int litColumns(RaMatrixAnimation& animation)
+{
+  int count = 0;
+  for (uint8_t x = 0; x < MATRIX_COLUMNS; x++)
+  {
+    count += animation.getBuffer()[x] != 0;
+  }
+  return count;
+}
+
+static void testDrawCharClipsColumns()
+{
+  RaMatrixAnimation animation;
+
+  // Right of the matrix, including positions that wrap once truncated to 8 bits
+  for (int x = MATRIX_COLUMNS; x < 300; x++)
+  {
+    animation.clear();
+    CHECK_EQUAL(FONT_WIDTH + FONT_SPACING, animation.drawChar(x, 'M'));
+    CHECK_EQUAL(0, litColumns(animation));
+  }
+
+  // Partly visible on both edges
+  animation.clear();
+  animation.drawChar(MATRIX_COLUMNS - 2, 'M');
+  CHECK_EQUAL(2, litColumns(animation));
+  CHECK(animation.getBuffer()[MATRIX_COLUMNS - 1] != 0);
+
+  animation.clear();
+  animation.drawChar(-3, 'M');
+  CHECK_EQUAL(2, litColumns(animation));
+  CHECK(animation.getBuffer()[0] != 0);
+
+  animation.clear();
+  animation.drawChar(-FONT_WIDTH, 'M');
+  CHECK_EQUAL(0, litColumns(animation));
+}
+
+int main()
+{
+  testDrawCharClipsColumns();
+  return TEST_RESULT();
+}
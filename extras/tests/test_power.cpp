@@ -0,0 +1,108 @@
+#include <RaSmartCar4WD.h>
+#include "RaTest.h"
+
+/*
+ * Power save: the idle car spaces its pings without losing its obstacle guard.
+ */
+
+static void testIdleKeepsGuard()
+{
+  RaSmartCar4WD car;
+  RaHostHardware& hw = car.getHardware();
+
+  car.init();
+  car.setPowerSave(true);
+  hw.setInput(PIN_TRACKING_MIDDLE, HIGH);
+  car.setMode(BT_MODE_LINE_GUARDED);
+
+  // Stopped by a 10 cm obstacle long enough to go idle
+  run(car, POWER_IDLE_DELAY + 500, 600);
+  CHECK(car.isPowerIdle());
+  CHECK_EQUAL(0, hw.getPwm(PIN_MOTOR_L_PWM));
+
+  // The obstacle stays: the wheels must never turn, and the distance stays fresh
+  unsigned long pings = car.getRangingArray().getPingCount();
+  int moving = 0;
+  for (int i = 0; i < 2000; i++)
+  {
+    run(car, 1, 600);
+    moving += hw.getPwm(PIN_MOTOR_L_PWM) > 0 || hw.getPwm(PIN_MOTOR_R_PWM) > 0;
+  }
+  CHECK_EQUAL(0, moving);
+  CHECK(car.getRangingArray().getPingCount() - pings >= 2000 / (RANGING_PERIOD + RANGING_GUARD_INTERVAL));
+  CHECK(car.isPowerIdle());
+}
+
+static void testIdleThrottlesBlockingMeasures()
+{
+  RaSmartCar4WD car;
+  RaHostHardware& hw = car.getHardware();
+
+  car.init();
+  car.setSpeed(200);
+  car.setPowerSave(true);
+  car.setMode(BT_MODE_FOLLOWING);
+
+  // Nothing to follow: stopped, then idle
+  run(car, POWER_IDLE_DELAY + 500);
+  CHECK(car.isPowerIdle());
+
+  unsigned long pings = car.getRangingArray().getPingCount();
+  unsigned long start = hw.millis();
+  run(car, 30000);
+  unsigned long idlePings = car.getRangingArray().getPingCount() - pings;
+  unsigned long elapsed = hw.millis() - start;
+  CHECK(idlePings <= elapsed / POWER_IDLE_RANGING_PERIOD + 1);
+  printf("idle in following mode: %lu pings in %lu ms\n", idlePings, elapsed);
+
+  // Something comes within range (one echo, the next pings get none): followed at the next measure
+  hw.setPulse(PIN_ECHO, 20 * 58);
+  bool moved = false;
+  for (int i = 0; i < POWER_IDLE_RANGING_PERIOD + MODE_PERIOD_RANGING; i++)
+  {
+    run(car, 1);
+    moved = moved || hw.getPwm(PIN_MOTOR_L_PWM) > 0;
+  }
+  CHECK(moved);
+  CHECK(!car.isPowerIdle());
+}
+
+static void testIdleLooksAround()
+{
+  RaSmartCar4WD car;
+  RaHostHardware& hw = car.getHardware();
+  RaControlGains gains = car.getGains();
+
+  // Looks shorter than the idle ping period
+  gains.avoidSettleTime = 20;
+  gains.avoidLookTime = 100;
+  car.setGains(gains);
+  car.init();
+  car.setSpeed(0);
+  car.setPowerSave(true);
+  car.setMode(BT_MODE_AVOID);
+  run(car, POWER_IDLE_DELAY + 500);
+  CHECK(car.isPowerIdle());
+
+  // An obstacle ahead: the front ping is the idle one, but each look measures again
+  hw.setPulse(PIN_ECHO, 10 * 58);
+  unsigned long pings = car.getRangingArray().getPingCount();
+  for (int i = 0; i < POWER_IDLE_RANGING_PERIOD + MODE_PERIOD_RANGING; i++)
+  {
+    run(car, 1);
+    if(car.getRangingArray().getPingCount() != pings)
+    {
+      break;
+    }
+  }
+  CHECK_EQUAL(3, car.getRangingArray().getPingCount() - pings);
+  CHECK_EQUAL(90, car.getServoAngle());
+}
+
+int main()
+{
+  testIdleKeepsGuard();
+  testIdleThrottlesBlockingMeasures();
+  testIdleLooksAround();
+  return TEST_RESULT();
+}
@@ -0,0 +1,112 @@
+#include <math.h>
+#include <RaRangingArray.h>
+#include "RaTest.h"
+
+/*
+ * Fixed-point echo conversion, checked against the floating-point formula over the whole range,
+ * and the round robin of the sensor array.
+ */
+
+static const RaRangingPins twoSensors[] PROGMEM = {{12, 13}, {10, A0}};
+
+// Sweeps every echo up to the longest one the library waits for
+static void checkScale(unsigned int scaleQ16, double usPerUnit)
+{
+  unsigned long maxEcho = RaRangingArray::echoTimeout(RANGING_MAX_RANGE);
+  // Rounding error, plus what the coefficient itself is off by at the end of the range
+  double coefficientError = fabs(scaleQ16 / 65536.0 - 1.0 / usPerUnit);
+  double worst = 0;
+  long failures = 0;
+
+  for (unsigned long echo = 0; echo <= maxEcho; echo++)
+  {
+    double reference = echo / usPerUnit;
+    double error = fabs(RaRangingArray::toDistance(echo, scaleQ16) - reference);
+    failures += error > 0.5 + echo * coefficientError + 1e-9;
+    worst = error > worst ? error : worst;
+  }
+  CHECK_EQUAL(0, failures);
+  CHECK(worst < 0.75);
+}
+
+static void testConversionAccuracy()
+{
+  checkScale(RANGING_MM_Q16, 2 * 2.91);
+  checkScale(RANGING_CM_Q16, 2 * 29.1);
+  checkScale(RANGING_TENTH_INCH_Q16, 2 * 7.4);
+}
+
+static void testRoundsToNearest()
+{
+  // 9.93 cm and 556.01 tenths of an inch, that truncation gave as 9 and 555
+  CHECK_EQUAL(10, RaRangingArray::toDistance(578, RANGING_CM_Q16));
+  CHECK_EQUAL(556, RaRangingArray::toDistance(8229, RANGING_TENTH_INCH_Q16));
+  CHECK_EQUAL(100, RaRangingArray::toDistance(1480, RANGING_TENTH_INCH_Q16));
+  CHECK_EQUAL(0, RaRangingArray::toDistance(0, RANGING_MM_Q16));
+}
+
+// Echo of every sensor at each millisecond, 1 ms = 600 us of echo + the rest
+static void runArray(RaHostHardware& hw, RaRangingArray& array, RaSensorTrace& trace, uint8_t sensors,
+                     unsigned long ms)
+{
+  for (unsigned long i = 0; i < ms; i++)
+  {
+    array.update(hw.millis(), trace, sensors);
+    hw.setInput(13, HIGH);
+    hw.setInput(A0, HIGH);
+    hw.advance(600);
+    hw.setInput(13, LOW);
+    hw.setInput(A0, LOW);
+    hw.advance(400);
+  }
+}
+
+static void testArrayFiresOnlySelectedSensors()
+{
+  RaHostHardware hw;
+  RaSensorTrace trace;
+  RaRangingArray array(hw, twoSensors, 2);
+
+  array.init();
+  hw.advance(1000);
+
+  // Front sensor left out: only the second one is read
+  runArray(hw, array, trace, RANGING_ALL_SENSORS & ~1, 200);
+  CHECK_EQUAL(RANGING_NO_READING, array.getReading(0).echo);
+  CHECK_EQUAL(600, array.getReading(1).echo);
+  CHECK(array.getAge(1, hw.millis()) <= RANGING_PERIOD + RANGING_GUARD_INTERVAL);
+  CHECK(array.getPingCount() >= 200 / (RANGING_PERIOD + RANGING_GUARD_INTERVAL));
+
+  // All of them
+  runArray(hw, array, trace, RANGING_ALL_SENSORS, 200);
+  CHECK_EQUAL(600, array.getReading(0).echo);
+  CHECK(array.getAge(0, hw.millis()) <= 2 * (RANGING_PERIOD + RANGING_GUARD_INTERVAL));
+}
+
+static void testShorterPeriodAppliesAtOnce()
+{
+  RaHostHardware hw;
+  RaSensorTrace trace;
+  RaRangingArray array(hw, twoSensors, 1);
+
+  array.init();
+  hw.advance(1000);
+  array.setPeriod(500, hw.millis());
+  runArray(hw, array, trace, RANGING_ALL_SENSORS, 100);
+  unsigned long pings = array.getPingCount();
+  CHECK_EQUAL(1, pings);
+
+  // Back to the normal period: the ping planned 400 ms ahead is pulled in
+  array.setPeriod(RANGING_PERIOD, hw.millis());
+  runArray(hw, array, trace, RANGING_ALL_SENSORS, RANGING_PERIOD + 1);
+  CHECK_EQUAL(pings + 1, array.getPingCount());
+}
+
+int main()
+{
+  testConversionAccuracy();
+  testRoundsToNearest();
+  testArrayFiresOnlySelectedSensors();
+  testShorterPeriodAppliesAtOnce();
+  return TEST_RESULT();
+}
@@ -0,0 +1,161 @@
+#include <vector>
+#include <RaSmartCar4WD.h>
+#include "RaTest.h"
+
+/*
+ * Sensor trace: a run recorded on the simulated car, replayed on another car without any
+ * input, must drive the motors exactly the same way.
+ */
+
+#define RUN_MS 4000
+
+/**
+ * Flux en mémoire : ce qui est écrit est relu dans l'ordre.
+ */
+class MemoryStream : public Stream
+{
+private:
+  std::vector<uint8_t> bytes;
+  size_t position;
+
+public:
+  MemoryStream() : position(0) {}
+
+  size_t write(uint8_t value) { bytes.push_back(value); return 1; }
+  using Print::write;
+  int available() { return bytes.size() - position; }
+  int read() { return position < bytes.size() ? bytes[position++] : -1; }
+  int peek() { return position < bytes.size() ? bytes[position] : -1; }
+  size_t size() { return bytes.size(); }
+};
+
+struct MotorSample
+{
+  int left;
+  int right;
+  uint8_t direction;
+};
+
+/**
+ * Runs the scenario; live = true feeds the simulated inputs (recording), false leaves them
+ * untouched (replay). The calls to the car are the same in both cases.
+ */
+static std::vector<MotorSample> runScenario(RaSmartCar4WD& car, bool live)
+{
+  RaHostHardware& hw = car.getHardware();
+  std::vector<MotorSample> samples;
+  unsigned long seed = 12345;
+
+  for (unsigned long t = 0; t < RUN_MS; t++)
+  {
+    if(live)
+    {
+      seed = seed * 1103515245UL + 12345UL;
+      if((seed >> 16) % 7 == 0)
+      {
+        hw.setInput(PIN_TRACKING_LEFT, (seed >> 20) & 1);
+        hw.setInput(PIN_TRACKING_MIDDLE, (seed >> 21) & 1);
+        hw.setInput(PIN_TRACKING_RIGHT, (seed >> 22) & 1);
+      }
+      // Distance wandering between 5 and 45 cm, for blocking and interrupt-driven pings
+      unsigned long echo = 300 + ((seed >> 8) % 2400);
+      hw.setPulse(PIN_ECHO, echo);
+      hw.setInput(PIN_ECHO, HIGH);
+      hw.advance(echo);
+      hw.setInput(PIN_ECHO, LOW);
+
+      switch (t)
+      {
+      case 10:
+        hw.getSerial().feed("X");
+        break;
+      case 1000:
+        hw.getSerial().feed("U");
+        break;
+      case 2000:
+        hw.getSerial().feed("Fa");
+        break;
+      case 2500:
+        hw.getSerial().feed("L");
+        break;
+      case 3400:
+        hw.getRemote().press(IR_KEY_RIGHT);
+        break;
+      }
+      hw.advance(1000 - echo);
+    }
+    else
+    {
+      hw.advance(1000);
+    }
+
+    if(t == 3000)
+    {
+      car.setMode(BT_MODE_LINE_GUARDED);
+    }
+    car.enableBluetoothControl();
+
+    MotorSample sample = {hw.getPwm(PIN_MOTOR_L_PWM), hw.getPwm(PIN_MOTOR_R_PWM),
+                          (uint8_t)(hw.getOutput(PIN_MOTOR_L_CTRL) << 1 | hw.getOutput(PIN_MOTOR_R_CTRL))};
+    samples.push_back(sample);
+  }
+  return samples;
+}
+
+static void testReplayMatchesRecording()
+{
+  MemoryStream stream;
+  RaSmartCar4WD recorder;
+  RaSmartCar4WD player;
+
+  recorder.init();
+  recorder.setSpeed(150);
+  recorder.startTraceRecording(stream);
+  std::vector<MotorSample> recorded = runScenario(recorder, true);
+  recorder.stopTrace();
+  CHECK(stream.size() > 0);
+
+  player.init();
+  player.setSpeed(150);
+  CHECK(player.startTraceReplay(stream));
+  std::vector<MotorSample> replayed = runScenario(player, false);
+  player.stopTrace();
+
+  // The scenario must exercise the motors for the comparison to mean something
+  int moving = 0;
+  int differences = 0;
+  for (size_t i = 0; i < recorded.size(); i++)
+  {
+    moving += recorded[i].left != 0 || recorded[i].right != 0;
+    differences += recorded[i].left != replayed[i].left || recorded[i].right != replayed[i].right
+                   || recorded[i].direction != replayed[i].direction;
+  }
+  CHECK(moving > RUN_MS / 4);
+  CHECK_EQUAL(0, differences);
+}
+
+static void testRecordingOnSerialRaisesBaudRate()
+{
+  RaSmartCar4WD car;
+  RaHostHardware& hw = car.getHardware();
+
+  car.init();
+  CHECK_EQUAL(SERIAL_BAUD, hw.getSerialBaud());
+  car.startTraceRecording(hw.serial());
+  CHECK_EQUAL(TRACE_SERIAL_BAUD, hw.getSerialBaud());
+  car.stopTrace();
+  CHECK_EQUAL(SERIAL_BAUD, hw.getSerialBaud());
+
+  // Another output leaves the port alone
+  MemoryStream stream;
+  car.startTraceRecording(stream);
+  CHECK_EQUAL(SERIAL_BAUD, hw.getSerialBaud());
+  car.stopTrace();
+}
+
+int main()
+{
+  testReplayMatchesRecording();
+  testRecordingOnSerialRaisesBaudRate();
+  return TEST_RESULT();
+}
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <RaSimTuner.h>
+#include "RaTest.h"
+
+/*
+ * Gain tuning: the search does not depend on the thread count, the Pareto front is not dominated,
+ * the winner written out is loaded back by the firmware.
+ */
+
+#define TUNE_DURATION 3000
+
+static void search(RaSimTuner& tuner)
+{
+  const char* names[] = {"line", "follow"};
+
+  for (int i = 0; i < 2; i++)
+  {
+    int index = RaSimulator::findScenario(names[i]);
+    if (index >= 0)
+    {
+      RaSimScenario scenario = RaSimulator::getScenario(index);
+      scenario.duration = TUNE_DURATION;
+      tuner.addScenario(scenario);
+    }
+  }
+  tuner.sample(4);
+  // A few refinement rounds, or until converged
+  int rounds = 0;
+  while (rounds < 3 && tuner.refine())
+  {
+    rounds++;
+  }
+}
+
+static void testParamTable()
+{
+  RaControlGains defaults = GAINS_DEFAULT;
+  int offset = 0;
+
+  // All the fields, in order: the header initializer follows the table
+  for (int i = 0; i < RaSimTuner::getParamCount(); i++)
+  {
+    const RaTuneParam& param = RaSimTuner::getParam(i);
+    int value = RaSimTuner::getValue(defaults, i);
+    CHECK_EQUAL(offset, param.offset);
+    CHECK(value >= param.low && value <= param.high);
+    CHECK_EQUAL(0, (value - param.low) % param.step);
+    offset += param.size;
+  }
+  CHECK_EQUAL(sizeof(RaControlGains), offset);
+}
+
+static void testSameOnAnyThreadCount()
+{
+  RaSimPool serialPool(1);
+  RaSimPool pool(3);
+  RaSimTuner serial(serialPool, 7);
+  RaSimTuner parallel(pool, 7);
+
+  search(serial);
+  search(parallel);
+  CHECK(serial.getTunedCount() > 0);
+  CHECK_EQUAL(serial.getCandidateCount(), parallel.getCandidateCount());
+  for (int i = 0; i < serial.getCandidateCount() && i < parallel.getCandidateCount(); i++)
+  {
+    const RaTuneCandidate& a = serial.getCandidate(i);
+    const RaTuneCandidate& b = parallel.getCandidate(i);
+    CHECK(memcmp(&a.gains, &b.gains, sizeof(RaControlGains)) == 0);
+    CHECK(a.score.score == b.score.score);
+  }
+  // The defaults are tried first: the winner is at least as good
+  CHECK(serial.getBest().score.score >= serial.getCandidate(0).score.score);
+  printf("tuned: score %.2f, defaults %.2f, %d candidates\n", serial.getBest().score.score,
+         serial.getCandidate(0).score.score, serial.getCandidateCount());
+}
+
+static void testParetoFront()
+{
+  RaSimPool pool(2);
+  RaSimTuner tuner(pool, 3);
+
+  search(tuner);
+  std::vector<int> front = tuner.getParetoFront();
+  std::vector<bool> inFront(tuner.getCandidateCount(), false);
+  CHECK(!front.empty());
+  for (size_t i = 0; i < front.size(); i++)
+  {
+    inFront[front[i]] = true;
+    CHECK(i == 0 || tuner.getCandidate(front[i - 1]).score.speed >= tuner.getCandidate(front[i]).score.speed);
+  }
+  for (int i = 0; i < tuner.getCandidateCount(); i++)
+  {
+    // Nothing dominates a member of the front; a member of the front dominates every other candidate
+    bool dominated = false;
+    bool byFront = false;
+    for (int j = 0; j < tuner.getCandidateCount(); j++)
+    {
+      bool wins = RaSimTuner::dominates(tuner.getCandidate(j).score, tuner.getCandidate(i).score);
+      dominated = dominated || wins;
+      byFront = byFront || (wins && inFront[j]);
+    }
+    CHECK(inFront[i] ? !dominated : byFront);
+  }
+}
+
+static void testWrittenGainsLoad()
+{
+  RaControlGains gains = GAINS_DEFAULT;
+  gains.lineSpeed = 180;
+  gains.followMaxDistance = 42;
+  gains.avoidLookTime = 650;
+
+  // Intel HEX image, programmed into the EEPROM of another car
+  CHECK(RaSimTuner::writeEeprom(gains, "tune_gains.eep", 16));
+  RaSmartCar4WD car;
+  RaHostHardware& hw = car.getHardware();
+  FILE* in = fopen("tune_gains.eep", "r");
+  char line[80];
+  bool end = false;
+  CHECK(in != NULL);
+  while (in && fgets(line, sizeof(line), in))
+  {
+    unsigned int length, address, type, value;
+    CHECK(sscanf(line, ":%2x%4x%2x", &length, &address, &type) == 3);
+    unsigned int sum = length + (address >> 8) + (address & 0xFF) + type;
+    for (unsigned int i = 0; i <= length; i++)
+    {
+      sscanf(line + 9 + 2 * i, "%2x", &value);
+      sum += value;
+      if (i < length)
+      {
+        hw.eepromWrite(address + i, value);
+      }
+    }
+    CHECK_EQUAL(0, sum & 0xFF);
+    end = end || type == 1;
+  }
+  if (in)
+  {
+    fclose(in);
+  }
+  CHECK(end);
+  CHECK(!car.loadGains());
+  CHECK(car.loadGains(16));
+  CHECK(memcmp(&car.getGains(), &gains, sizeof(RaControlGains)) == 0);
+
+  // C initializer
+  CHECK(RaSimTuner::writeHeader(gains, "tune_gains.h"));
+  in = fopen("tune_gains.h", "r");
+  bool found = false;
+  while (in && fgets(line, sizeof(line), in))
+  {
+    if (strcmp(line, "#define GAINS_TUNED {180, 200, 70, 9, 8, 13, 42, 15, 20, 100, 650, 300}\n") == 0)
+    {
+      found = true;
+    }
+  }
+  if (in)
+  {
+    fclose(in);
+  }
+  CHECK(found);
+}
+
+int main()
+{
+  testParamTable();
+  testSameOnAnyThreadCount();
+  testParetoFront();
+  testWrittenGainsLoad();
+  return TEST_RESULT();
+}
@@ -0,0 +1,353 @@
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <RaSimulator.h>
+
+/*
+ * Benchmark of the car code on the simulated hardware:
+ *  - micro: the hardware primitives (pin, pulse, delay, EEPROM, serial and matrix bus operations)
+ *    called by one car operation,
+ *  - scenario: closed-loop runs of each simulation scenario with the default gains (laps, lap time,
+ *    cross-track error, collisions, time blocked in the mode waits, loop latency, operations per loop).
+ * The results are written as CSV ("section,name,metric,value"). With --check, they are compared
+ * to a baseline written by an earlier run: a worse value than the metric tolerance fails (exit 1).
+ *
+ *   ra_bench [--output results.csv] [--check baseline.csv] [--seed n]
+ */
+
+#define BENCH_LOWER 1  // lower is better
+#define BENCH_HIGHER 2 // higher is better
+#define BENCH_INFO 0   // not checked (wall-clock times, counts that may go either way)
+
+struct BenchRule
+{
+  const char* metric; // exact name, or suffix when it starts with '_'
+  int direction;
+  double tolerance; // relative
+  double slack;     // absolute
+};
+
+// Simulated metrics are deterministic: the tolerances only absorb floating point differences
+// between compilers. The micro operation counts must not grow at all.
+static const BenchRule rules[] = {
+  {"laps", BENCH_HIGHER, 0, 0},
+  {"best_lap_ms", BENCH_LOWER, 0.05, 0},
+  {"mean_lap_ms", BENCH_LOWER, 0.05, 0},
+  {"cross_track_rms_mm", BENCH_LOWER, 0.10, 0.5},
+  {"cross_track_max_mm", BENCH_LOWER, 0.10, 0.5},
+  {"collisions", BENCH_LOWER, 0, 0},
+  {"contact_ms", BENCH_LOWER, 0.10, 50},
+  {"travelled_mm", BENCH_HIGHER, 0.10, 0},
+  {"follow_error_mm", BENCH_LOWER, 0.10, 1},
+  {"blocked_ms", BENCH_LOWER, 0.10, 10},
+  {"loop_mean_us", BENCH_LOWER, 0.10, 5},
+  {"loop_max_us", BENCH_LOWER, 0.10, 5},
+  {"mode_mean_us", BENCH_LOWER, 0.10, 5},
+  {"mode_calls", BENCH_INFO, 0, 0},
+  {"wall_ns_per_loop", BENCH_INFO, 0, 0},
+  {"_per_1k_loops", BENCH_LOWER, 0.02, 1},
+};
+
+struct BenchRow
+{
+  std::string section;
+  std::string name;
+  std::string metric;
+  double value;
+};
+
+static std::vector<BenchRow> results;
+
+static void add(const char* section, const char* name, const char* metric, double value)
+{
+  BenchRow row = {section, name, metric, value};
+  results.push_back(row);
+}
+
+static BenchRule findRule(const std::string& metric)
+{
+  BenchRule exact = {"", BENCH_LOWER, 0, 0};
+
+  for (size_t i = 0; i < sizeof(rules) / sizeof(rules[0]); i++)
+  {
+    std::string name = rules[i].metric;
+    bool suffix = name[0] == '_' && metric.size() > name.size()
+                  && metric.compare(metric.size() - name.size(), name.size(), name) == 0;
+    if (name == metric || suffix)
+    {
+      return rules[i];
+    }
+  }
+  return exact;
+}
+
+static void addCounters(const char* section, const char* name, const RaHostCounters& counters,
+                        const char* suffix, double scale)
+{
+  const char* names[] = {"pin_modes", "digital_writes", "digital_reads", "analog_writes", "pulse_ins",
+                         "delays", "eeprom_writes", "serial_bytes", "matrix_bytes"};
+  unsigned long values[] = {counters.pinModes, counters.digitalWrites, counters.digitalReads,
+                            counters.analogWrites, counters.pulseIns, counters.delays,
+                            counters.eepromWrites, counters.serialBytes, counters.matrixBytes};
+
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+  {
+    std::string metric = std::string(names[i]) + suffix;
+    add(section, name, metric.c_str(), values[i] * scale);
+  }
+}
+
+// One car operation, on a car fresh from init()
+typedef void (*MicroOperation)(RaSmartCar4WD& car);
+
+static void goForward(RaSmartCar4WD& car)
+{
+  car.goForward(200);
+}
+
+static void turnLeft(RaSmartCar4WD& car)
+{
+  car.turnLeft(200);
+}
+
+static void stop(RaSmartCar4WD& car)
+{
+  car.stop();
+}
+
+static void updateIdle(RaSmartCar4WD& car)
+{
+  car.update();
+}
+
+static void updateOnLine(RaSmartCar4WD& car)
+{
+  car.getHardware().setInput(PIN_TRACKING_MIDDLE, HIGH);
+  car.update();
+}
+
+static void saveGains(RaSmartCar4WD& car)
+{
+  car.saveGains();
+}
+
+#if RA_USE_RANGING
+static void getDistance(RaSmartCar4WD& car)
+{
+  car.getHardware().setPulse(PIN_ECHO, 582);
+  car.getDistanceTenths();
+}
+#endif
+
+#if RA_USE_MATRIX
+static void displayForward(RaSmartCar4WD& car)
+{
+  car.displayForward();
+}
+#endif
+
+struct MicroBench
+{
+  const char* name;
+  int mode; // set before the counters start
+  MicroOperation operation;
+};
+
+static const MicroBench microBenches[] = {
+  {"goForward", BT_MODE_NONE, goForward},
+  {"turnLeft", BT_MODE_NONE, turnLeft},
+  {"stop", BT_MODE_NONE, stop},
+  {"update_idle", BT_MODE_NONE, updateIdle},
+  {"update_line", BT_MODE_LINE_TRACKING, updateOnLine},
+  {"update_guarded", BT_MODE_LINE_GUARDED, updateOnLine},
+  {"saveGains", BT_MODE_NONE, saveGains},
+#if RA_USE_RANGING
+  {"getDistanceTenths", BT_MODE_NONE, getDistance},
+#endif
+#if RA_USE_MATRIX
+  {"displayForward", BT_MODE_NONE, displayForward},
+#endif
+};
+
+static void runMicro()
+{
+  for (size_t i = 0; i < sizeof(microBenches) / sizeof(microBenches[0]); i++)
+  {
+    const MicroBench& bench = microBenches[i];
+    RaSmartCar4WD car;
+    RaHostHardware& hw = car.getHardware();
+
+    car.init();
+    car.setMode(bench.mode);
+    hw.advance(SIM_LOOP_US);
+    hw.resetCounters();
+    unsigned long start = hw.micros();
+    bench.operation(car);
+    add("micro", bench.name, "sim_us", hw.micros() - start);
+    addCounters("micro", bench.name, hw.getCounters(), "", 1);
+  }
+}
+
+static void runScenarios(unsigned long seed)
+{
+  RaControlGains gains = GAINS_DEFAULT;
+
+  for (int i = 0; i < RaSimulator::getScenarioCount(); i++)
+  {
+    const RaSimScenario& scenario = RaSimulator::getScenario(i);
+    const char* name = scenario.name;
+
+    std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+    RaSimResult result = RaSimulator::run(scenario, gains, seed);
+    double wall = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - wallStart).count();
+
+    add("scenario", name, "laps", result.laps);
+    add("scenario", name, "best_lap_ms", result.bestLapMillis);
+    add("scenario", name, "mean_lap_ms", result.meanLapMillis);
+    add("scenario", name, "cross_track_rms_mm", result.crossTrackRms * 1000);
+    add("scenario", name, "cross_track_max_mm", result.crossTrackMax * 1000);
+    add("scenario", name, "collisions", result.collisions);
+    add("scenario", name, "contact_ms", result.contactMillis);
+    add("scenario", name, "travelled_mm", result.travelled * 1000);
+    add("scenario", name, "follow_error_mm", result.followError * 1000);
+    add("scenario", name, "blocked_ms", result.blockedMillis);
+    add("scenario", name, "loop_mean_us", result.loopMeanMicros);
+    add("scenario", name, "loop_max_us", result.loopMaxMicros);
+    add("scenario", name, "mode_calls", result.modeStats.calls);
+    add("scenario", name, "mode_mean_us",
+        result.modeStats.calls ? (double)result.modeStats.totalMicros / result.modeStats.calls : 0);
+    addCounters("scenario", name, result.counters, "_per_1k_loops", result.loops ? 1000.0 / result.loops : 0);
+    add("scenario", name, "wall_ns_per_loop", result.loops ? wall / result.loops : 0);
+  }
+}
+
+static bool writeResults(const char* path)
+{
+  FILE* out = fopen(path, "w");
+
+  if (!out)
+  {
+    fprintf(stderr, "ra_bench: cannot write %s\n", path);
+    return false;
+  }
+  fprintf(out, "# section,name,metric,value\n");
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const BenchRow& row = results[i];
+    fprintf(out, "%s,%s,%s,%.1f\n", row.section.c_str(), row.name.c_str(), row.metric.c_str(), row.value);
+  }
+  fclose(out);
+  return true;
+}
+
+/**
+ * Compares the results to a baseline file, prints each regression.
+ * @return the number of regressions, -1 if the baseline cannot be read.
+ */
+static int checkBaseline(const char* path)
+{
+  std::map<std::string, double> current;
+  char line[256];
+  int regressions = 0;
+  FILE* in = fopen(path, "r");
+
+  if (!in)
+  {
+    fprintf(stderr, "ra_bench: cannot read %s\n", path);
+    return -1;
+  }
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    current[results[i].section + "," + results[i].name + "," + results[i].metric] = results[i].value;
+  }
+
+  while (fgets(line, sizeof(line), in))
+  {
+    std::string text(line);
+    size_t end = text.rfind(',');
+    if (text.empty() || text[0] == '#' || end == std::string::npos)
+    {
+      continue;
+    }
+    std::string key = text.substr(0, end);
+    double baseline = atof(text.c_str() + end + 1);
+    BenchRule rule = findRule(key.substr(key.rfind(',') + 1));
+    if (rule.direction == BENCH_INFO)
+    {
+      continue;
+    }
+
+    std::map<std::string, double>::iterator found = current.find(key);
+    if (found == current.end())
+    {
+      printf("REGRESSION %s: missing\n", key.c_str());
+      regressions++;
+      continue;
+    }
+    double value = found->second;
+    double margin = fabs(baseline) * rule.tolerance + rule.slack;
+    bool worse = rule.direction == BENCH_LOWER ? value > baseline + margin : value < baseline - margin;
+    bool better = rule.direction == BENCH_LOWER ? value < baseline : value > baseline;
+    if (worse)
+    {
+      printf("REGRESSION %s: %.1f, baseline %.1f\n", key.c_str(), value, baseline);
+      regressions++;
+    }
+    else if (better && fabs(value - baseline) > margin)
+    {
+      printf("improved   %s: %.1f, baseline %.1f (update the baseline)\n", key.c_str(), value, baseline);
+    }
+  }
+  fclose(in);
+  return regressions;
+}
+
+int main(int argc, char** argv)
+{
+  const char* output = "ra_bench.csv";
+  const char* baseline = NULL;
+  unsigned long seed = 1;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+    {
+      output = argv[++i];
+    }
+    else if (strcmp(argv[i], "--check") == 0 && i + 1 < argc)
+    {
+      baseline = argv[++i];
+    }
+    else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+    {
+      seed = strtoul(argv[++i], NULL, 0);
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [--output results.csv] [--check baseline.csv] [--seed n]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  runMicro();
+  runScenarios(seed);
+  if (!writeResults(output))
+  {
+    return 2;
+  }
+  printf("%u results written to %s\n", (unsigned)results.size(), output);
+
+  if (baseline)
+  {
+    int regressions = checkBaseline(baseline);
+    if (regressions != 0)
+    {
+      printf("%d regression(s) against %s\n", regressions < 0 ? 0 : regressions, baseline);
+      return 1;
+    }
+    printf("no regression against %s\n", baseline);
+  }
+  return 0;
+}
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <RaSimFleet.h>
+
+/*
+ * Fleet simulator: many independent cars, each on its own copy of a scenario with its own seed,
+ * run in parallel on a thread pool. Prints the aggregated collisions, lap times and loop latency,
+ * and the throughput in simulated car-seconds per wall-clock second.
+ *
+ *   ra_fleet [--cars n] [--threads n] [--scenario name|all] [--seconds s] [--seed n]
+ *            [--output cars.csv] [--scaling]
+ *
+ * Car i has the seed (seed + i); with "all", the cars take the scenarios in turn.
+ * --scaling runs the same fleet on 1, 2, 4... threads up to the core count (or --threads), checks
+ * that the results do not change, and prints the throughput and speedup of each run: close to the
+ * thread count while there are free cores, the cars sharing nothing.
+ */
+
+struct FleetOptions
+{
+  int cars;
+  int threads;
+  int scenario; // -1 = all
+  unsigned long duration; // ms, 0 = the scenario duration
+  unsigned long seed;
+  const char* output;
+  bool scaling;
+};
+
+static void fillFleet(RaSimFleet& fleet, const FleetOptions& options)
+{
+  RaControlGains gains = GAINS_DEFAULT;
+
+  for (int i = 0; i < options.cars; i++)
+  {
+    int index = options.scenario >= 0 ? options.scenario : i % RaSimulator::getScenarioCount();
+    RaSimScenario scenario = RaSimulator::getScenario(index);
+    if (options.duration)
+    {
+      scenario.duration = options.duration;
+    }
+    fleet.add(scenario, gains, options.seed + i);
+  }
+}
+
+static void printStats(const RaSimFleetStats& stats, int threads)
+{
+  printf("cars: %d on %d thread(s), %.0f car-seconds in %.2f s: %.0f car-seconds per second\n",
+         stats.cars, threads, stats.carSeconds, stats.wallSeconds,
+         stats.wallSeconds > 0 ? stats.carSeconds / stats.wallSeconds : 0);
+  printf("collisions: %lu (%d car(s))\n", stats.collisions, stats.carsWithCollision);
+  printf("laps: %lu, best %lu ms, mean %lu ms, slowest car %lu ms\n",
+         stats.laps, stats.bestLapMillis, stats.meanLapMillis, stats.worstLapMillis);
+  printf("loop latency: mean %lu us, max %lu us, blocked %lu ms\n",
+         stats.loopMeanMicros, stats.loopMaxMicros, stats.blockedMillis);
+}
+
+static bool writeCars(RaSimFleet& fleet, const char* path)
+{
+  FILE* out = fopen(path, "w");
+
+  if (!out)
+  {
+    fprintf(stderr, "ra_fleet: cannot write %s\n", path);
+    return false;
+  }
+  fprintf(out, "# car,scenario,seed,laps,best_lap_ms,mean_lap_ms,cross_track_rms_mm,collisions,contact_ms,"
+               "travelled_mm,blocked_ms,loop_mean_us,loop_max_us\n");
+  for (int i = 0; i < fleet.getCarCount(); i++)
+  {
+    const RaSimCar& car = fleet.getCar(i);
+    const RaSimResult& result = car.result;
+    fprintf(out, "%d,%s,%lu,%lu,%lu,%lu,%.1f,%lu,%lu,%.0f,%lu,%lu,%lu\n", i, car.scenario.name, car.seed,
+            result.laps, result.bestLapMillis, result.meanLapMillis, result.crossTrackRms * 1000,
+            result.collisions, result.contactMillis, result.travelled * 1000, result.blockedMillis,
+            result.loopMeanMicros, result.loopMaxMicros);
+  }
+  fclose(out);
+  return true;
+}
+
+static int runScaling(const FleetOptions& options)
+{
+  int cores = options.threads > 0 ? options.threads : RaSimPool::getCoreCount();
+  RaSimPool serialPool(1);
+  RaSimFleet serial(serialPool);
+  bool same = true;
+
+  fillFleet(serial, options);
+  serial.run();
+  RaSimFleetStats serialStats = serial.getStats();
+  double serialRate = serialStats.carSeconds / serialStats.wallSeconds;
+
+  printf("# threads,wall_s,car_seconds_per_s,speedup,efficiency\n");
+  printf("1,%.3f,%.0f,1.00,1.00\n", serialStats.wallSeconds, serialRate);
+  for (int threads = 2; threads <= cores; threads = threads < cores && threads * 2 > cores ? cores : threads * 2)
+  {
+    RaSimPool pool(threads);
+    RaSimFleet fleet(pool);
+    fillFleet(fleet, options);
+    fleet.run();
+
+    RaSimFleetStats stats = fleet.getStats();
+    double rate = stats.carSeconds / stats.wallSeconds;
+    printf("%d,%.3f,%.0f,%.2f,%.2f\n", threads, stats.wallSeconds, rate, rate / serialRate,
+           rate / serialRate / threads);
+    if (!fleet.matches(serial))
+    {
+      printf("results on %d threads differ from the serial run\n", threads);
+      same = false;
+    }
+  }
+  return same ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+  FleetOptions options = {0, 0, -1, 0, 1, NULL, false};
+
+  for (int i = 1; i < argc; i++)
+  {
+    bool value = i + 1 < argc;
+    if (strcmp(argv[i], "--cars") == 0 && value)
+    {
+      options.cars = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--threads") == 0 && value)
+    {
+      options.threads = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--scenario") == 0 && value)
+    {
+      const char* name = argv[++i];
+      options.scenario = strcmp(name, "all") == 0 ? -1 : RaSimulator::findScenario(name);
+      if (options.scenario < 0 && strcmp(name, "all") != 0)
+      {
+        fprintf(stderr, "ra_fleet: unknown scenario %s\n", name);
+        return 2;
+      }
+    }
+    else if (strcmp(argv[i], "--seconds") == 0 && value)
+    {
+      options.duration = strtoul(argv[++i], NULL, 0) * 1000;
+    }
+    else if (strcmp(argv[i], "--seed") == 0 && value)
+    {
+      options.seed = strtoul(argv[++i], NULL, 0);
+    }
+    else if (strcmp(argv[i], "--output") == 0 && value)
+    {
+      options.output = argv[++i];
+    }
+    else if (strcmp(argv[i], "--scaling") == 0)
+    {
+      options.scaling = true;
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [--cars n] [--threads n] [--scenario name|all] [--seconds s] [--seed n]"
+                      " [--output cars.csv] [--scaling]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (options.cars <= 0)
+  {
+    options.cars = 4 * RaSimPool::getCoreCount();
+  }
+
+  if (options.scaling)
+  {
+    return runScaling(options);
+  }
+
+  RaSimPool pool(options.threads);
+  RaSimFleet fleet(pool);
+  fillFleet(fleet, options);
+  fleet.run();
+  printStats(fleet.getStats(), pool.getThreadCount());
+  if (options.output && !writeCars(fleet, options.output))
+  {
+    return 2;
+  }
+  return 0;
+}
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <RaSimTuner.h>
+
+/*
+ * Tuning of the automatic mode gains (RaControlGains) on the simulation scenarios: random search
+ * (the defaults first), then coordinate refinement until no neighbour does better with the smallest
+ * steps. Each candidate runs every scenario with each seed; the runs of a step are spread over the
+ * thread pool. Prints the Pareto front of speed versus error and collisions, and the winner.
+ *
+ *   ra_tune [--scenario name|all] [--seconds s] [--seeds n] [--samples n] [--rounds n] [--threads n]
+ *           [--seed n] [--error-weight w] [--collision-weight w]
+ *           [--output candidates.csv] [--header gains.h] [--eeprom gains.eep] [--address n]
+ *
+ * The winner is written as a C initializer (--header, "#define GAINS_TUNED {...}" for setGains)
+ * and as the EEPROM image of saveGains in Intel HEX (--eeprom, for avrdude -U eeprom:w:gains.eep:i),
+ * found by loadGains at startup.
+ */
+
+struct TuneOptions
+{
+  int scenario; // -1 = all
+  unsigned long duration; // ms, 0 = the scenario duration
+  int seeds;
+  int samples;
+  int rounds;
+  int threads;
+  unsigned long seed;
+  float errorWeight;
+  float collisionWeight;
+  const char* output;
+  const char* header;
+  const char* eeprom;
+  int address;
+};
+
+static void printScore(const char* label, const RaTuneScore& score)
+{
+  printf("%s: score %.2f, speed %.3f m/s, error %.1f mm, collisions %.2f, contact %.2f s\n",
+         label, score.score, score.speed, score.error, score.collisions, score.contact);
+}
+
+static void printGains(RaSimTuner& tuner, const RaControlGains& gains)
+{
+  for (int i = 0; i < tuner.getTunedCount(); i++)
+  {
+    int param = tuner.getTuned(i);
+    printf("%s%s=%d", i ? ", " : "  ", RaSimTuner::getParam(param).name, RaSimTuner::getValue(gains, param));
+  }
+  printf("\n");
+}
+
+static bool writeCandidates(RaSimTuner& tuner, const char* path)
+{
+  FILE* out = fopen(path, "w");
+  std::vector<int> front = tuner.getParetoFront();
+  std::vector<bool> pareto(tuner.getCandidateCount(), false);
+
+  if (!out)
+  {
+    fprintf(stderr, "ra_tune: cannot write %s\n", path);
+    return false;
+  }
+  for (size_t i = 0; i < front.size(); i++)
+  {
+    pareto[front[i]] = true;
+  }
+  fprintf(out, "# candidate,round,pareto,score,speed_mps,error_mm,collisions,contact_s");
+  for (int p = 0; p < RaSimTuner::getParamCount(); p++)
+  {
+    fprintf(out, ",%s", RaSimTuner::getParam(p).name);
+  }
+  fprintf(out, "\n");
+  for (int i = 0; i < tuner.getCandidateCount(); i++)
+  {
+    const RaTuneCandidate& candidate = tuner.getCandidate(i);
+    const RaTuneScore& score = candidate.score;
+    fprintf(out, "%d,%d,%d,%.3f,%.4f,%.2f,%.3f,%.3f", i, candidate.round, pareto[i] ? 1 : 0, score.score,
+            score.speed, score.error, score.collisions, score.contact);
+    for (int p = 0; p < RaSimTuner::getParamCount(); p++)
+    {
+      fprintf(out, ",%d", RaSimTuner::getValue(candidate.gains, p));
+    }
+    fprintf(out, "\n");
+  }
+  fclose(out);
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  TuneOptions options = {-1, 30000, 2, 32, 30, 0, 1, TUNE_ERROR_WEIGHT, TUNE_COLLISION_WEIGHT,
+                         NULL, NULL, NULL, GAINS_EEPROM_ADDRESS};
+
+  for (int i = 1; i < argc; i++)
+  {
+    bool value = i + 1 < argc;
+    if (strcmp(argv[i], "--scenario") == 0 && value)
+    {
+      const char* name = argv[++i];
+      options.scenario = strcmp(name, "all") == 0 ? -1 : RaSimulator::findScenario(name);
+      if (options.scenario < 0 && strcmp(name, "all") != 0)
+      {
+        fprintf(stderr, "ra_tune: unknown scenario %s\n", name);
+        return 2;
+      }
+    }
+    else if (strcmp(argv[i], "--seconds") == 0 && value)
+    {
+      options.duration = strtoul(argv[++i], NULL, 0) * 1000;
+    }
+    else if (strcmp(argv[i], "--seeds") == 0 && value)
+    {
+      options.seeds = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--samples") == 0 && value)
+    {
+      options.samples = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--rounds") == 0 && value)
+    {
+      options.rounds = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--threads") == 0 && value)
+    {
+      options.threads = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--seed") == 0 && value)
+    {
+      options.seed = strtoul(argv[++i], NULL, 0);
+    }
+    else if (strcmp(argv[i], "--error-weight") == 0 && value)
+    {
+      options.errorWeight = atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--collision-weight") == 0 && value)
+    {
+      options.collisionWeight = atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--output") == 0 && value)
+    {
+      options.output = argv[++i];
+    }
+    else if (strcmp(argv[i], "--header") == 0 && value)
+    {
+      options.header = argv[++i];
+    }
+    else if (strcmp(argv[i], "--eeprom") == 0 && value)
+    {
+      options.eeprom = argv[++i];
+    }
+    else if (strcmp(argv[i], "--address") == 0 && value)
+    {
+      options.address = atoi(argv[++i]);
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [--scenario name|all] [--seconds s] [--seeds n] [--samples n] [--rounds n]"
+                      " [--threads n] [--seed n] [--error-weight w] [--collision-weight w] [--output candidates.csv]"
+                      " [--header gains.h] [--eeprom gains.eep] [--address n]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  RaSimPool pool(options.threads);
+  RaSimTuner tuner(pool, options.seed);
+  for (int i = 0; i < RaSimulator::getScenarioCount(); i++)
+  {
+    if (options.scenario < 0 || options.scenario == i)
+    {
+      RaSimScenario scenario = RaSimulator::getScenario(i);
+      if (options.duration)
+      {
+        scenario.duration = options.duration;
+      }
+      tuner.addScenario(scenario);
+    }
+  }
+  tuner.setSeeds(options.seeds);
+  tuner.setWeights(options.errorWeight, options.collisionWeight);
+
+  printf("tuning %d gain(s) on %d thread(s)\n", tuner.getTunedCount(), pool.getThreadCount());
+  tuner.sample(options.samples);
+  printScore("defaults", tuner.getCandidate(0).score);
+  printScore("sampling", tuner.getBest().score);
+  for (int round = 1; round <= options.rounds && tuner.refine(); round++)
+  {
+    char label[24];
+    snprintf(label, sizeof(label), "round %d", round);
+    printScore(label, tuner.getBest().score);
+  }
+
+  std::vector<int> front = tuner.getParetoFront();
+  printf("pareto front: %d of %d candidates\n", (int)front.size(), tuner.getCandidateCount());
+  printf("# speed_mps,error_mm,collisions,score\n");
+  for (size_t i = 0; i < front.size(); i++)
+  {
+    const RaTuneScore& score = tuner.getCandidate(front[i]).score;
+    printf("%.3f,%.1f,%.2f,%.2f\n", score.speed, score.error, score.collisions, score.score);
+  }
+
+  const RaControlGains& gains = tuner.getBest().gains;
+  printScore("best", tuner.getBest().score);
+  printGains(tuner, gains);
+  printf("RaControlGains gains = {");
+  for (int p = 0; p < RaSimTuner::getParamCount(); p++)
+  {
+    printf("%s%d", p ? ", " : "", RaSimTuner::getValue(gains, p));
+  }
+  printf("};\n");
+
+  if (options.output && !writeCandidates(tuner, options.output))
+  {
+    return 2;
+  }
+  if (options.header && !RaSimTuner::writeHeader(gains, options.header))
+  {
+    fprintf(stderr, "ra_tune: cannot write %s\n", options.header);
+    return 2;
+  }
+  if (options.eeprom && !RaSimTuner::writeEeprom(gains, options.eeprom, options.address))
+  {
+    fprintf(stderr, "ra_tune: cannot write %s\n", options.eeprom);
+    return 2;
+  }
+  return 0;
+}